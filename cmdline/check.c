@@ -63,6 +63,14 @@ struct failed_struct {
 	struct snapraid_handle* handle; /**< The handle containing the failed block, or 0 for a DELETED block */
 };
 
+/**
+ * Data block read, waiting for the hash comparison.
+ */
+struct snapraid_verify {
+	unsigned char hash[HASH_MAX]; /**< Hash computed from the data read. */
+	unsigned failed_pos; /**< Position of the block in the failed set. */
+};
+
 /**
  * Check if a block hash matches the specified buffer.
  * Return ==0 if equal
@@ -96,7 +104,7 @@ static int blockcmp(struct snapraid_state* state, int rehash, struct snapraid_bl
 /**
  * Check if the hash of all the failed block we are expecting to recover are now matching.
  */
-static int is_hash_matching(struct snapraid_state* state, int rehash, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void* buffer_zero)
+static int is_hash_matching(struct snapraid_state* state, struct snapraid_logbuf* logbuf, int rehash, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void* buffer_zero)
 {
 	unsigned j;
 	int hash_checked;
@@ -113,7 +121,7 @@ static int is_hash_matching(struct snapraid_state* state, int rehash, unsigned d
 			/* if a hash doesn't match, fail the check */
 			unsigned pos_size = file_block_size(failed[failed_map[j]].file, failed[failed_map[j]].file_pos, state->block_size);
 			if (blockcmp(state, rehash, failed[failed_map[j]].block, pos_size, buffer[failed[failed_map[j]].index], buffer_zero) != 0) {
-				log_tag("hash_error: Hash mismatch on entry %u\n", failed_map[j]);
+				logbuf_tag(logbuf, "hash_error: Hash mismatch on entry %u\n", failed_map[j]);
 				return 0;
 			}
 
@@ -132,7 +140,7 @@ static int is_hash_matching(struct snapraid_state* state, int rehash, unsigned d
 
 	/* if we checked something, and no block failed the check */
 	/* recompute all the redundancy information */
-	raid_gen(diskmax, state->level, state->block_size, buffer);
+	raid_gen_cached(diskmax, state->level, state->block_size, buffer);
 	return 1;
 }
 
@@ -142,36 +150,258 @@ static int is_hash_matching(struct snapraid_state* state, int rehash, unsigned d
 static int is_parity_matching(struct snapraid_state* state, unsigned diskmax, unsigned i, void** buffer, void** buffer_recov)
 {
 	/* recompute parity, note that we don't need parity over i */
-	raid_gen(diskmax, i + 1, state->block_size, buffer);
+	raid_gen_cached(diskmax, i + 1, state->block_size, buffer);
 
 	/* if the recovered parity block matches */
 	if (memcmp(buffer[diskmax + i], buffer_recov[i], state->block_size) == 0) {
 		/* recompute all the redundancy information */
-		raid_gen(diskmax, state->level, state->block_size, buffer);
+		raid_gen_cached(diskmax, state->level, state->block_size, buffer);
 		return 1;
 	}
 
 	return 0;
 }
 
+/****************************************************************************/
+/* combination cache */
+
+/**
+ * Number of combinations remembered.
+ */
+#define REPAIR_CACHE_MAX 8
+
+/**
+ * Combination of parities that recovered a set of failed disks.
+ */
+struct snapraid_repair_combo {
+	int has_hash; /**< If the recovering was checked with the hash. */
+	unsigned failed_count; /**< Number of failed disks. */
+	int id[LEV_MAX]; /**< Indexes of the failed disks. */
+	unsigned r; /**< Number of parities used. */
+	int ip[LEV_MAX]; /**< Indexes of the parities used. */
+};
+
+/**
+ * Cache of the latest combinations that recovered with success.
+ *
+ * Near blocks usually have the same failures, and they are recovered
+ * with the same parities, so that combination is tried first.
+ *
+ * Each repair thread has its own cache.
+ */
+struct snapraid_repair_cache {
+	struct snapraid_repair_combo map[REPAIR_CACHE_MAX]; /**< Combinations, the most recent first. */
+	unsigned count; /**< Number of combinations. */
+	uint64_t search; /**< Number of searches of a combination, with more than one choice. */
+	uint64_t hit; /**< Number of searches solved by the cached combination. */
+};
+
+static void repair_cache_init(struct snapraid_repair_cache* cache)
+{
+	cache->count = 0;
+	cache->search = 0;
+	cache->hit = 0;
+}
+
+/**
+ * Get the combination that recovered the same failures.
+ * Return 0 if not found.
+ */
+static int repair_cache_get(struct snapraid_repair_cache* cache, int has_hash, unsigned failed_count, int* id, unsigned r, int* ip)
+{
+	unsigned k;
+
+	for (k = 0; k < cache->count; ++k) {
+		struct snapraid_repair_combo* combo = &cache->map[k];
+
+		if (combo->has_hash == has_hash
+			&& combo->failed_count == failed_count
+			&& combo->r == r
+			&& memcmp(combo->id, id, failed_count * sizeof(int)) == 0
+		) {
+			memcpy(ip, combo->ip, r * sizeof(int));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Remember the combination that recovered the failures.
+ */
+static void repair_cache_set(struct snapraid_repair_cache* cache, int has_hash, unsigned failed_count, int* id, unsigned r, int* ip)
+{
+	struct snapraid_repair_combo combo;
+	unsigned k;
+
+	combo.has_hash = has_hash;
+	combo.failed_count = failed_count;
+	memcpy(combo.id, id, failed_count * sizeof(int));
+	combo.r = r;
+	memcpy(combo.ip, ip, r * sizeof(int));
+
+	/* search the same failures, or use the oldest entry */
+	for (k = 0; k < cache->count; ++k) {
+		struct snapraid_repair_combo* other = &cache->map[k];
+
+		if (other->has_hash == has_hash
+			&& other->failed_count == failed_count
+			&& other->r == r
+			&& memcmp(other->id, id, failed_count * sizeof(int)) == 0
+		)
+			break;
+	}
+	if (k == REPAIR_CACHE_MAX)
+		--k;
+	else if (k == cache->count)
+		++cache->count;
+
+	/* move it in front */
+	memmove(&cache->map[1], &cache->map[0], k * sizeof(struct snapraid_repair_combo));
+	cache->map[0] = combo;
+}
+
+/****************************************************************************/
+/* repair */
+
+/**
+ * Log a combination of parities that failed to recover.
+ */
+static void repair_log_mismatch(struct snapraid_logbuf* logbuf, unsigned pos, unsigned r, int* ip, const char* reason)
+{
+	unsigned i;
+
+	logbuf_tag(logbuf, "parity_error:%u:", pos);
+	for (i = 0; i < r; ++i) {
+		if (i != 0)
+			logbuf_tag(logbuf, "/");
+		logbuf_tag(logbuf, "%s", lev_config_name(ip[i]));
+	}
+	logbuf_tag(logbuf, ":%s\n", reason);
+}
+
+/**
+ * Try to recover using a combination of parities.
+ *
+ * If ::has_hash, the ::r parities are used to recover, and the result is checked with the hash.
+ * Otherwise, the first ::r - 1 parities are used to recover, and the last one to check the result.
+ *
+ * Return 1 if recovered, 0 if the result is wrong, or -1 if a parity is missing.
+ */
+static int repair_try(struct snapraid_state* state, struct snapraid_logbuf* logbuf, int rehash, int has_hash, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, int* id, unsigned r, int* ip, void** buffer, void** buffer_recov, void* buffer_zero)
+{
+	unsigned i;
+
+	/* if a parity is missing, do nothing */
+	for (i = 0; i < r; ++i) {
+		if (buffer_recov[ip[i]] == 0)
+			return -1;
+	}
+
+	if (!has_hash) {
+		/* copy the parities to use, one less because the last is used for checking */
+		for (i = 0; i < r - 1; ++i)
+			memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
+
+		/* recover using one less parity, the ip[r-1] one */
+		raid_data(r - 1, id, ip, diskmax, state->block_size, buffer);
+
+		/* use the remaining ip[r-1] parity to check the result */
+		return is_parity_matching(state, diskmax, ip[r - 1], buffer, buffer_recov);
+	}
+
+	/* copy the parities to use */
+	for (i = 0; i < r; ++i)
+		memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
+
+	/* recover */
+	raid_data(r, id, ip, diskmax, state->block_size, buffer);
+
+	/* use the hash to check the result */
+	return is_hash_matching(state, logbuf, rehash, diskmax, failed, failed_map, failed_count, buffer, buffer_zero);
+}
+
+/**
+ * Try all the combinations of ::r parities of ::n, starting from the cached one.
+ *
+ * Return 0 on success, or the number of failed attempts.
+ */
+static int repair_search(struct snapraid_state* state, struct snapraid_repair_cache* cache, struct snapraid_logbuf* logbuf, int rehash, int has_hash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, int* id, unsigned r, unsigned n, void** buffer, void** buffer_recov, void* buffer_zero)
+{
+	const char* reason = has_hash ? "hash: Hash mismatch" : "parity: Parity mismatch";
+	int ip_cached[LEV_MAX];
+	int ip[LEV_MAX];
+	int cached;
+	int error;
+	int ret;
+
+	error = 0;
+
+	/* with only one combination, there is nothing to remember */
+	cached = 0;
+	if (r < n) {
+		++cache->search;
+
+		/* try first the combination that recovered the same failures */
+		cached = repair_cache_get(cache, has_hash, failed_count, id, r, ip_cached);
+		if (cached) {
+			ret = repair_try(state, logbuf, rehash, has_hash, diskmax, failed, failed_map, failed_count, id, r, ip_cached, buffer, buffer_recov, buffer_zero);
+			if (ret > 0) {
+				++cache->hit;
+				return 0;
+			}
+			if (ret == 0) {
+				repair_log_mismatch(logbuf, pos, r, ip_cached, reason);
+				++error;
+			}
+		}
+	}
+
+	/* all combinations (r of n) parities */
+	combination_first(r, n, ip);
+	do {
+		/* skip the one already tried */
+		if (cached && memcmp(ip, ip_cached, r * sizeof(int)) == 0)
+			continue;
+
+		ret = repair_try(state, logbuf, rehash, has_hash, diskmax, failed, failed_map, failed_count, id, r, ip, buffer, buffer_recov, buffer_zero);
+		if (ret > 0) {
+			if (r < n)
+				repair_cache_set(cache, has_hash, failed_count, id, r, ip);
+			return 0;
+		}
+		if (ret == 0) {
+			repair_log_mismatch(logbuf, pos, r, ip, reason);
+			++error;
+		}
+	} while (combination_next(r, n, ip));
+
+	/* if nothing tried, return a failure anyway */
+	if (error == 0)
+		return -1;
+
+	return error;
+}
+
 /**
  * Repair errors.
  * Return <0 if failure for missing strategy, >0 if data is wrong and we cannot rebuild correctly, 0 on success.
  * If success, the parity are computed in the buffer variable.
  */
-static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
+static int repair_step(struct snapraid_state* state, struct snapraid_repair_cache* cache, struct snapraid_logbuf* logbuf, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
 {
 	unsigned i, n;
 	int error;
 	int has_hash;
 	int id[LEV_MAX];
-	int ip[LEV_MAX];
+	int ret;
 
 	/* no fix required, already checked at higher level, but just to be sure */
 	if (failed_count == 0) {
 		/* LCOV_EXCL_START */
 		/* recompute only the parity */
-		raid_gen(diskmax, state->level, state->block_size, buffer);
+		raid_gen_cached(diskmax, state->level, state->block_size, buffer);
 		return 0;
 		/* LCOV_EXCL_STOP */
 	}
@@ -201,38 +431,11 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 		/* number of parity to use, one more to check the recovering */
 		unsigned r = failed_count + 1;
 
-		/* all combinations (r of n) parities */
-		combination_first(r, n, ip);
-		do {
-			/* if a parity is missing, do nothing */
-			for (i = 0; i < r; ++i) {
-				if (buffer_recov[ip[i]] == 0)
-					break;
-			}
-			if (i != r)
-				continue;
-
-			/* copy the parities to use, one less because the last is used for checking */
-			for (i = 0; i < r - 1; ++i)
-				memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
-
-			/* recover using one less parity, the ip[r-1] one */
-			raid_data(r - 1, id, ip, diskmax, state->block_size, buffer);
-
-			/* use the remaining ip[r-1] parity to check the result */
-			if (is_parity_matching(state, diskmax, ip[r - 1], buffer, buffer_recov))
-				return 0;
-
-			/* log */
-			log_tag("parity_error:%u:", pos);
-			for (i = 0; i < r; ++i) {
-				if (i != 0)
-					log_tag("/");
-				log_tag("%s", lev_config_name(ip[i]));
-			}
-			log_tag(":parity: Parity mismatch\n");
-			++error;
-		} while (combination_next(r, n, ip));
+		ret = repair_search(state, cache, logbuf, rehash, 0, pos, diskmax, failed, failed_map, failed_count, id, r, n, buffer, buffer_recov, buffer_zero);
+		if (ret == 0)
+			return 0;
+		if (ret > 0)
+			error += ret;
 	}
 
 	/* if we have a hash, and enough parities */
@@ -241,50 +444,23 @@ static int repair_step(struct snapraid_state* state, int rehash, unsigned pos, u
 		/* number of parities to use equal at the number of failures */
 		unsigned r = failed_count;
 
-		/* all combinations (r of n) parities */
-		combination_first(r, n, ip);
-		do {
-			/* if a parity is missing, do nothing */
-			for (i = 0; i < r; ++i) {
-				if (buffer_recov[ip[i]] == 0)
-					break;
-			}
-			if (i != r)
-				continue;
-
-			/* copy the parities to use */
-			for (i = 0; i < r; ++i)
-				memcpy(buffer[diskmax + ip[i]], buffer_recov[ip[i]], state->block_size);
-
-			/* recover */
-			raid_data(r, id, ip, diskmax, state->block_size, buffer);
-
-			/* use the hash to check the result */
-			if (is_hash_matching(state, rehash, diskmax, failed, failed_map, failed_count, buffer, buffer_zero))
-				return 0;
-
-			/* log */
-			log_tag("parity_error:%u:", pos);
-			for (i = 0; i < r; ++i) {
-				if (i != 0)
-					log_tag("/");
-				log_tag("%s", lev_config_name(ip[i]));
-			}
-			log_tag(":hash: Hash mismatch\n");
-			++error;
-		} while (combination_next(r, n, ip));
+		ret = repair_search(state, cache, logbuf, rehash, 1, pos, diskmax, failed, failed_map, failed_count, id, r, n, buffer, buffer_recov, buffer_zero);
+		if (ret == 0)
+			return 0;
+		if (ret > 0)
+			error += ret;
 	}
 
 	/* return the number of failed attempts, or -1 if no strategy */
 	if (error)
 		return error;
 
-	log_tag("strategy_error:%u: No strategy to recover from %u failures with %u parity %s hash\n",
+	logbuf_tag(logbuf, "strategy_error:%u: No strategy to recover from %u failures with %u parity %s hash\n",
 		pos, failed_count, n, has_hash ? "with" : "without");
 	return -1;
 }
 
-static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
+static int repair(struct snapraid_state* state, struct snapraid_repair_cache* cache, struct snapraid_logbuf* logbuf, int rehash, unsigned pos, unsigned diskmax, struct failed_struct* failed, unsigned* failed_map, unsigned failed_count, void** buffer, void** buffer_recov, void* buffer_zero)
 {
 	int ret;
 	int error;
@@ -298,7 +474,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 
 	/* if nothing failed, just recompute the parity */
 	if (failed_count == 0) {
-		raid_gen(diskmax, state->level, state->block_size, buffer);
+		raid_gen_cached(diskmax, state->level, state->block_size, buffer);
 		return 0;
 	}
 
@@ -338,9 +514,9 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 			struct snapraid_file* file = failed[j].file;
 			block_off_t file_pos = failed[j].file_pos;
 
-			log_tag("entry:%u:%s:%s:%s:%s:%s:%u:\n", j, desc, hash, data, disk->name, esc_tag(file->sub, esc_buffer), file_pos);
+			logbuf_tag(logbuf, "entry:%u:%s:%s:%s:%s:%s:%u:\n", j, desc, hash, data, disk->name, esc_tag(file->sub, esc_buffer), file_pos);
 		} else {
-			log_tag("entry:%u:%s:%s:%s:\n", j, desc, hash, data);
+			logbuf_tag(logbuf, "entry:%u:%s:%s:%s:\n", j, desc, hash, data);
 		}
 	}
 
@@ -375,7 +551,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 					|| state_search_fetch(state, rehash, failed[j].file, failed[j].file_pos, failed[j].block, buffer[failed[j].index]) == 0)
 			) {
 				/* we already have corrected it! */
-				log_tag("hash_import: Fixed entry %u\n", j);
+				logbuf_tag(logbuf, "hash_import: Fixed entry %u\n", j);
 			} else {
 				/* otherwise try to recover it */
 				failed_map[n] = j;
@@ -389,14 +565,14 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 
 	/* if nothing to fix */
 	if (!something_to_recover) {
-		log_tag("recover_sync:%u:%u: Skipped for already recovered\n", pos, n);
+		logbuf_tag(logbuf, "recover_sync:%u:%u: Skipped for already recovered\n", pos, n);
 
 		/* recompute only the parity */
-		raid_gen(diskmax, state->level, state->block_size, buffer);
+		raid_gen_cached(diskmax, state->level, state->block_size, buffer);
 		return 0;
 	}
 
-	ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
+	ret = repair_step(state, cache, logbuf, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
 	if (ret == 0) {
 		/* reprocess the CHG blocks, for which we don't have a hash to check */
 		/* if they were BAD we have to use some heuristics to ensure that we have recovered  */
@@ -423,7 +599,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 					/* it may contain garbage */
 					failed[j].is_outofdate = 1;
 
-					log_tag("hash_unknown: Unknown hash on entry %u\n", j);
+					logbuf_tag(logbuf, "hash_unknown: Unknown hash on entry %u\n", j);
 				} else if (hash_is_zero(failed[j].block->hash)) {
 					/* if the block is not filled with 0, we are sure to have */
 					/* restored it to the state after the 'sync' */
@@ -434,7 +610,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 						/* it may contain garbage */
 						failed[j].is_outofdate = 1;
 
-						log_tag("hash_unknown: Maybe old zero on entry %u\n", j);
+						logbuf_tag(logbuf, "hash_unknown: Maybe old zero on entry %u\n", j);
 					}
 				} else {
 					/* if the hash is different than the previous one, we are sure to have */
@@ -447,7 +623,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 						/* it may contain garbage */
 						failed[j].is_outofdate = 1;
 
-						log_tag("hash_unknown: Maybe old data on entry %u\n", j);
+						logbuf_tag(logbuf, "hash_unknown: Maybe old data on entry %u\n", j);
 					}
 				}
 			}
@@ -459,9 +635,9 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 		error += ret;
 
 	if (ret < 0)
-		log_tag("recover_sync:%u:%u: Failed with no attempts\n", pos, n);
+		logbuf_tag(logbuf, "recover_sync:%u:%u: Failed with no attempts\n", pos, n);
 	else
-		log_tag("recover_sync:%u:%u: Failed with %d attempts\n", pos, n, ret);
+		logbuf_tag(logbuf, "recover_sync:%u:%u: Failed with %d attempts\n", pos, n, ret);
 
 	/* Now assume that the parity IS NOT updated at the current state, */
 	/* but still represent the state before the last 'sync' process. */
@@ -539,7 +715,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 	/* if nothing to fix, we just don't try */
 	/* if nothing unsynced we also don't retry, because it's the same try as before */
 	if (something_to_recover && something_unsynced) {
-		ret = repair_step(state, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
+		ret = repair_step(state, cache, logbuf, rehash, pos, diskmax, failed, failed_map, n, buffer, buffer_recov, buffer_zero);
 		if (ret == 0) {
 			/* reprocess the REP and CHG blocks, for which we have recovered and old state */
 			/* that we don't want to save into disk */
@@ -557,7 +733,7 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 						/* and we don't want to write it to the disk */
 						failed[j].is_outofdate = 1;
 
-						log_tag("hash_unknown: Surely old data on entry %u\n", j);
+						logbuf_tag(logbuf, "hash_unknown: Surely old data on entry %u\n", j);
 					}
 				}
 			}
@@ -568,11 +744,11 @@ static int repair(struct snapraid_state* state, int rehash, unsigned pos, unsign
 			error += ret;
 
 		if (ret < 0)
-			log_tag("recover_unsync:%u:%u: Failed with no attempts\n", pos, n);
+			logbuf_tag(logbuf, "recover_unsync:%u:%u: Failed with no attempts\n", pos, n);
 		else
-			log_tag("recover_unsync:%u:%u: Failed with %d attempts\n", pos, n, ret);
+			logbuf_tag(logbuf, "recover_unsync:%u:%u: Failed with %d attempts\n", pos, n, ret);
 	} else {
-		log_tag("recover_unsync:%u:%u: Skipped for%s%s\n", pos, n,
+		logbuf_tag(logbuf, "recover_unsync:%u:%u: Skipped for%s%s\n", pos, n,
 			!something_to_recover ? " nothing to recover" : "",
 			!something_unsynced ? " nothing unsynced" : ""
 		);
@@ -814,56 +990,670 @@ static int block_is_enabled(struct snapraid_state* state, block_off_t i, struct
 		return info_get_bad(info);
 	}
 
-	/* filter for the parity */
-	if (state->opt.badfileonly) {
-		snapraid_info info;
+	/* filter for the parity */
+	if (state->opt.badfileonly) {
+		snapraid_info info;
+
+		/* get block specific info */
+		info = info_get(&state->infoarr, i);
+
+		/*
+		 * If the block is bad, it has to be processed
+		 *
+		 * This is not necessary in normal cases because if a block is bad,
+		 * it necessary needs to have a file related to it, and files with
+		 * bad blocks are fully included.
+		 *
+		 * But some files may be excluded by additional filter options,
+		 * so it's not always true, and this ensures to always check all
+		 * the bad blocks.
+		 */
+		if (info_get_bad(info))
+			return 1;
+	} else {
+		/* if a parity is not excluded, include all blocks, even unused ones */
+		for (l = 0; l < state->level; ++l) {
+			if (!state->parity[l].is_excluded_by_filter) {
+				return 1;
+			}
+		}
+	}
+
+	/* filter for the files */
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_block* block;
+
+		/* if no disk, nothing to check */
+		if (!handle[j].disk)
+			continue;
+
+		block = fs_par2block_find(handle[j].disk, i);
+
+		/* try to recover all files, even the ones without hash */
+		/* because in some cases we can recover also them */
+		if (block_has_file(block)) {
+			struct snapraid_file* file = fs_par2file_get(handle[j].disk, i, 0);
+			if (!file_flag_has(file, FILE_IS_EXCLUDED)) { /* only if the file is not filtered out */
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Check if the blocks to process are only the ones of the files not excluded.
+ *
+ * In such case they can be selected from the files, without
+ * checking all the blocks of the array.
+ */
+static int block_is_targeted(struct snapraid_state* state)
+{
+	unsigned l;
+
+	/* bad blocks are selected also without a file */
+	if (state->opt.badblockonly || state->opt.badfileonly)
+		return 0;
+
+	/* if a parity is not excluded, all blocks are included */
+	for (l = 0; l < state->level; ++l) {
+		if (!state->parity[l].is_excluded_by_filter)
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Select the blocks of the files not excluded.
+ *
+ * This gives the same result of block_is_enabled() on all the blocks,
+ * but it follows only the extents of the selected files.
+ * Return the number of blocks selected.
+ */
+static block_off_t block_select(block_off_t blockstart, block_off_t blockmax, struct snapraid_handle* handle, unsigned diskmax, bit_vect_t* block_enabled)
+{
+	block_off_t countmax;
+	unsigned j;
+
+	countmax = 0;
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_disk* disk = handle[j].disk;
+		tommy_node* node;
+
+		if (!disk)
+			continue;
+
+		for (node = disk->filelist; node != 0; node = node->next) {
+			struct snapraid_file* file = node->data;
+			block_off_t file_pos;
+
+			if (file_flag_has(file, FILE_IS_EXCLUDED))
+				continue;
+
+			/* sequential positions in the file are resolved using the last extent */
+			for (file_pos = 0; file_pos < file->blockmax; ++file_pos) {
+				block_off_t pos = fs_file2par_find(disk, file, file_pos);
+
+				if (pos == POS_NULL || pos < blockstart || pos >= blockmax)
+					continue;
+
+				/* blocks of different disks at the same position are counted once */
+				if (bit_vect_test(block_enabled, pos))
+					continue;
+
+				bit_vect_set(block_enabled, pos);
+				++countmax;
+			}
+		}
+	}
+
+	return countmax;
+}
+
+/**
+ * Check if reading the specified block index ::i requires to change
+ * a file open for fixing in some handle.
+ *
+ * The pending blocks are written using the handles, so they must not change.
+ */
+static int block_is_switching(int fix, block_off_t i, struct snapraid_handle* handle, unsigned diskmax)
+{
+	unsigned j;
+
+	/* when only checking, nothing is written */
+	if (!fix)
+		return 0;
+
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_block* block;
+		struct snapraid_file* file;
+
+		/* if no disk or no file open, nothing to change */
+		if (!handle[j].disk || !handle[j].file)
+			continue;
+
+		/* excluded files are never written */
+		if (file_flag_has(handle[j].file, FILE_IS_EXCLUDED))
+			continue;
+
+		block = fs_par2block_find(handle[j].disk, i);
+		if (!block_has_file(block))
+			continue;
+
+		file = fs_par2file_get(handle[j].disk, i, 0);
+		if (handle[j].file != file)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Check if the specified block index ::i is the last one of some file to fix.
+ *
+ * The file is finished when writing back the block, so the following ones
+ * have to wait.
+ */
+static int block_is_last(int fix, block_off_t i, struct snapraid_handle* handle, unsigned diskmax)
+{
+	unsigned j;
+
+	/* when only checking, nothing is finished */
+	if (!fix)
+		return 0;
+
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_block* block;
+		struct snapraid_file* file;
+		block_off_t file_pos;
+
+		if (!handle[j].disk)
+			continue;
+
+		block = fs_par2block_find(handle[j].disk, i);
+		if (!block_has_file(block))
+			continue;
+
+		file = fs_par2file_get(handle[j].disk, i, &file_pos);
+		if (file_block_is_last(file, file_pos) && !file_flag_has(file, FILE_IS_EXCLUDED))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Get the disk to rebuild.
+ *
+ * It's the only disk with files to fix, like when fixing a disk with -d.
+ */
+static struct snapraid_disk* rebuild_disk(struct snapraid_handle* handle, unsigned diskmax)
+{
+	struct snapraid_disk* rebuild;
+	unsigned j;
+
+	rebuild = 0;
+	for (j = 0; j < diskmax; ++j) {
+		struct snapraid_disk* disk = handle[j].disk;
+		tommy_node* node;
+
+		if (!disk)
+			continue;
+
+		/* search a file to fix */
+		for (node = disk->filelist; node != 0; node = node->next) {
+			struct snapraid_file* file = node->data;
+			if (!file_flag_has(file, FILE_IS_EXCLUDED))
+				break;
+		}
+		if (!node)
+			continue;
+
+		/* if more than one disk, we don't rebuild */
+		if (rebuild)
+			return 0;
+
+		rebuild = disk;
+	}
+
+	return rebuild;
+}
+
+/****************************************************************************/
+/* plan */
+
+/**
+ * Order of processing of the blocks.
+ *
+ * When rebuilding a disk, the blocks of its files are processed following
+ * the files, to write each one sequentially from the start to the end,
+ * even if fragmented in the parity.
+ * All the other blocks are then processed in parity order.
+ */
+struct snapraid_plan {
+	bit_vect_t* block_enabled; /**< Blocks still to process. */
+	block_off_t blockstart; /**< First block to process. */
+	block_off_t blockmax; /**< Last block to process, excluded. */
+	struct snapraid_disk* disk; /**< Disk to rebuild, or 0 if none. */
+	tommy_node* node; /**< Current file of the disk to rebuild. */
+	block_off_t file_pos; /**< Next block of the current file. */
+	block_off_t pos; /**< Next block in parity order. */
+};
+
+static void plan_init(struct snapraid_plan* plan, bit_vect_t* block_enabled, block_off_t blockstart, block_off_t blockmax, struct snapraid_disk* disk)
+{
+	plan->block_enabled = block_enabled;
+	plan->blockstart = blockstart;
+	plan->blockmax = blockmax;
+	plan->disk = disk;
+	plan->node = disk ? disk->filelist : 0;
+	plan->file_pos = 0;
+	plan->pos = blockstart;
+}
+
+/**
+ * Get the next block to process.
+ * Return ::blockmax at the end.
+ */
+static block_off_t plan_next(struct snapraid_plan* plan)
+{
+	/* first the files of the disk to rebuild */
+	while (plan->node) {
+		struct snapraid_file* file = plan->node->data;
+
+		if (plan->file_pos < file->blockmax && !file_flag_has(file, FILE_IS_EXCLUDED)) {
+			block_off_t pos = fs_file2par_find(plan->disk, file, plan->file_pos);
+
+			++plan->file_pos;
+
+			if (pos != POS_NULL
+				&& pos >= plan->blockstart
+				&& pos < plan->blockmax
+				&& bit_vect_test(plan->block_enabled, pos)
+			) {
+				/* don't process it again in parity order */
+				bit_vect_clear(plan->block_enabled, pos);
+				return pos;
+			}
+
+			continue;
+		}
+
+		/* next file */
+		plan->node = plan->node->next;
+		plan->file_pos = 0;
+	}
+
+	/* then all the others in parity order */
+	while (plan->pos < plan->blockmax) {
+		block_off_t pos = plan->pos;
+
+		/* skip at once the ranges without blocks, like when selecting few files */
+		if (pos % BIT_VECT_SIZE == 0 && plan->block_enabled[pos / BIT_VECT_SIZE] == 0) {
+			plan->pos += BIT_VECT_SIZE;
+			continue;
+		}
+
+		++plan->pos;
+
+		if (bit_vect_test(plan->block_enabled, pos))
+			return pos;
+	}
+
+	return plan->blockmax;
+}
+
+/****************************************************************************/
+/* repair */
+
+/**
+ * Default max number of threads used to repair.
+ *
+ * Each thread needs its own set of buffers, so we don't use all the
+ * processors of big systems.
+ */
+#define REPAIR_THREAD_DEFAULT 8
+
+#define REPAIR_STATE_EMPTY 0 /**< Not yet read. */
+#define REPAIR_STATE_READY 1 /**< Read, and waiting to be repaired. */
+#define REPAIR_STATE_RUNNING 2 /**< Repair in progress. */
+#define REPAIR_STATE_DONE 3 /**< Repaired, and waiting to be written back. */
+
+/**
+ * Block read from the disks, and processed by the repair threads.
+ */
+struct snapraid_repair_task {
+	int state; /**< State of the task. One of the REPAIR_STATE_*. */
+	block_off_t pos; /**< Parity position. */
+	int rehash; /**< If we have to use the old hash. */
+	int valid_parity; /**< If the parity is valid. */
+	int used_parity; /**< If the parity is used by at least one file. */
+	void* buffer_alloc;
+	void** buffer; /**< Data and parity buffers. */
+	void* buffer_recov[LEV_MAX]; /**< Parity read, or 0 if not available. */
+	struct failed_struct* failed; /**< Failed blocks. */
+	unsigned* failed_map; /**< Map of the failed blocks used by repair(). */
+	unsigned failed_count; /**< Number of failed blocks. */
+	int ret; /**< Result of repair(). */
+	struct snapraid_logbuf logbuf; /**< Tags of repair(), written with the task. */
+};
+
+/**
+ * Pool of threads repairing blocks.
+ *
+ * Tasks are used as a circular queue. The main thread reads the blocks
+ * in a free task, and writes back the repaired ones in order.
+ */
+struct snapraid_repair_pool {
+	struct snapraid_state* state;
+	unsigned diskmax; /**< Number of data disks. */
+	unsigned buffermax; /**< Number of buffers of each task. */
+	struct snapraid_repair_task* task_map;
+	unsigned task_max; /**< Number of tasks. */
+	unsigned task_first; /**< First pending task. The next to write back. */
+	unsigned task_count; /**< Number of pending tasks. */
+	unsigned thread_max; /**< Number of threads. 0 to repair in the main thread. */
+	struct snapraid_repair_cache cache; /**< Cache of the main thread, and at the end the stats of all the threads. */
+#if HAVE_THREAD
+	thread_id_t thread_map[REPAIR_THREAD_MAX];
+	thread_mutex_t mutex;
+	thread_cond_t ready_cond; /**< Signaled when a task is ready. */
+	thread_cond_t done_cond; /**< Signaled when a task is done. */
+	int done; /**< If the threads have to terminate. */
+#endif
+};
+
+static void repair_task_run(struct snapraid_repair_pool* pool, struct snapraid_repair_cache* cache, struct snapraid_repair_task* task)
+{
+	task->ret = repair(pool->state, cache, &task->logbuf, task->rehash, task->pos, pool->diskmax, task->failed, task->failed_map, task->failed_count, task->buffer, task->buffer_recov, task->buffer[pool->buffermax - 1]);
+}
+
+#if HAVE_THREAD
+static void* repair_thread(void* arg)
+{
+	struct snapraid_repair_pool* pool = arg;
+	struct snapraid_repair_cache cache;
+
+	repair_cache_init(&cache);
+
+	thread_mutex_lock(&pool->mutex);
+
+	while (!pool->done) {
+		struct snapraid_repair_task* task;
+		unsigned k;
+
+		/* search the first task ready */
+		task = 0;
+		for (k = 0; k < pool->task_count; ++k) {
+			unsigned t = (pool->task_first + k) % pool->task_max;
+			if (pool->task_map[t].state == REPAIR_STATE_READY) {
+				task = &pool->task_map[t];
+				break;
+			}
+		}
+
+		if (!task) {
+			thread_cond_wait(&pool->ready_cond, &pool->mutex);
+			continue;
+		}
+
+		task->state = REPAIR_STATE_RUNNING;
+
+		thread_mutex_unlock(&pool->mutex);
+
+		repair_task_run(pool, &cache, task);
+
+		thread_mutex_lock(&pool->mutex);
+
+		task->state = REPAIR_STATE_DONE;
+
+		/* only the main thread waits for it */
+		thread_cond_signal(&pool->done_cond);
+	}
+
+	/* collect the stats */
+	pool->cache.search += cache.search;
+	pool->cache.hit += cache.hit;
+
+	thread_mutex_unlock(&pool->mutex);
+
+	return 0;
+}
+#endif
+
+static void repair_init(struct snapraid_repair_pool* pool, struct snapraid_state* state, unsigned diskmax, unsigned buffermax)
+{
+	unsigned thread_max;
+	uint64_t task_size;
+	unsigned t;
+
+	/* with only one thread, repair in the main thread */
+	thread_max = state->opt.repair_thread;
+	if (thread_max == 0) {
+		thread_max = cpu_count();
+		if (thread_max > REPAIR_THREAD_DEFAULT)
+			thread_max = REPAIR_THREAD_DEFAULT;
+	}
+#if HAVE_THREAD
+	/* when only hashing, there is nothing to repair */
+	if (thread_max < 2 || state->opt.auditonly)
+		thread_max = 0;
+#else
+	thread_max = 0;
+#endif
+
+	/* reduce the threads to stay in the memory limit */
+	task_size = (uint64_t)buffermax * state->block_size;
+	if (thread_max != 0) {
+		uint64_t available = state_memory_available(state);
+		unsigned thread_req = thread_max;
+
+		while (thread_max >= 2 && (thread_max + 2) * task_size > available)
+			--thread_max;
+		if (thread_max < 2)
+			thread_max = 0;
+
+		if (thread_max != thread_req)
+			log_tag("memory:repair:%u:%u\n", thread_req, thread_max);
+	}
+
+	pool->state = state;
+	pool->diskmax = diskmax;
+	pool->buffermax = buffermax;
+	pool->thread_max = thread_max;
+	pool->task_first = 0;
+	pool->task_count = 0;
+	repair_cache_init(&pool->cache);
+
+	/* two more tasks to read and to write back while all the threads are busy */
+	if (thread_max != 0)
+		pool->task_max = thread_max + 2;
+	else
+		pool->task_max = 1;
+
+	/* fail early if even a single task doesn't fit */
+	state_memory_check(state, "the repair buffers", pool->task_max * task_size);
+
+	pool->task_map = malloc_nofail(pool->task_max * sizeof(struct snapraid_repair_task));
+
+	for (t = 0; t < pool->task_max; ++t) {
+		struct snapraid_repair_task* task = &pool->task_map[t];
+
+		task->state = REPAIR_STATE_EMPTY;
+		task->buffer = malloc_nofail_vector_huge_align(diskmax, buffermax, state->block_size, &task->buffer_alloc);
+		if (!state->opt.skip_self)
+			mtest_vector(buffermax, state->block_size, task->buffer);
+
+		/* fill up the zero buffer */
+		memset(task->buffer[buffermax - 1], 0, state->block_size);
+
+		task->failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
+		task->failed_map = malloc_nofail(diskmax * sizeof(unsigned));
+		logbuf_init(&task->logbuf);
+	}
+
+	raid_zero(pool->task_map[0].buffer[buffermax - 1]);
+
+#if HAVE_THREAD
+	if (thread_max != 0) {
+		thread_mutex_init(&pool->mutex);
+		thread_cond_init(&pool->ready_cond);
+		thread_cond_init(&pool->done_cond);
+		pool->done = 0;
+
+		for (t = 0; t < thread_max; ++t)
+			thread_create(&pool->thread_map[t], repair_thread, pool);
+	}
+#endif
+}
+
+static void repair_done(struct snapraid_repair_pool* pool)
+{
+	unsigned t;
+
+#if HAVE_THREAD
+	if (pool->thread_max != 0) {
+		/* stop the threads, even if some task is still pending */
+		thread_mutex_lock(&pool->mutex);
+		pool->done = 1;
+		thread_cond_broadcast_and_unlock(&pool->ready_cond, &pool->mutex);
+
+		for (t = 0; t < pool->thread_max; ++t) {
+			void* retval;
+			thread_join(pool->thread_map[t], &retval);
+		}
+
+		thread_mutex_destroy(&pool->mutex);
+		thread_cond_destroy(&pool->ready_cond);
+		thread_cond_destroy(&pool->done_cond);
+	}
+#endif
+
+	for (t = 0; t < pool->task_max; ++t) {
+		struct snapraid_repair_task* task = &pool->task_map[t];
+
+		logbuf_done(&task->logbuf);
+		free(task->failed);
+		free(task->failed_map);
+		free_huge(task->buffer_alloc);
+		free(task->buffer);
+	}
+
+	free(pool->task_map);
+}
+
+/**
+ * Get the task where to read the next block.
+ *
+ * There must be a free task.
+ */
+static struct snapraid_repair_task* repair_get(struct snapraid_repair_pool* pool)
+{
+	assert(pool->task_count < pool->task_max);
+
+	return &pool->task_map[(pool->task_first + pool->task_count) % pool->task_max];
+}
+
+/**
+ * Schedule the repair of the task just read.
+ */
+static void repair_submit(struct snapraid_repair_pool* pool, struct snapraid_repair_task* task)
+{
+	/* when only hashing, there is nothing to repair */
+	if (pool->state->opt.auditonly) {
+		task->state = REPAIR_STATE_DONE;
+		++pool->task_count;
+		return;
+	}
+
+#if HAVE_THREAD
+	if (pool->thread_max != 0) {
+		thread_mutex_lock(&pool->mutex);
+		task->state = REPAIR_STATE_READY;
+		++pool->task_count;
+		thread_cond_signal_and_unlock(&pool->ready_cond, &pool->mutex);
+		return;
+	}
+#endif
+
+	repair_task_run(pool, &pool->cache, task);
+	task->state = REPAIR_STATE_DONE;
+	++pool->task_count;
+}
+
+/**
+ * Check if there is a pending task to write back.
+ *
+ * If ::flush is set, all the pending tasks have to be written back,
+ * otherwise only the already repaired ones, or if no task is free.
+ */
+static int repair_pending(struct snapraid_repair_pool* pool, int flush)
+{
+	int ret;
+
+	if (pool->task_count == 0)
+		return 0;
+
+	if (flush || pool->task_count == pool->task_max)
+		return 1;
+
+#if HAVE_THREAD
+	if (pool->thread_max != 0) {
+		thread_mutex_lock(&pool->mutex);
+		ret = pool->task_map[pool->task_first].state == REPAIR_STATE_DONE;
+		thread_mutex_unlock(&pool->mutex);
+		return ret;
+	}
+#endif
+
+	ret = pool->task_map[pool->task_first].state == REPAIR_STATE_DONE;
 
-		/* get block specific info */
-		info = info_get(&state->infoarr, i);
+	return ret;
+}
 
-		/*
-		 * If the block is bad, it has to be processed
-		 *
-		 * This is not necessary in normal cases because if a block is bad,
-		 * it necessary needs to have a file related to it, and files with
-		 * bad blocks are fully included.
-		 *
-		 * But some files may be excluded by additional filter options,
-		 * so it's not always true, and this ensures to always check all
-		 * the bad blocks.
-		 */
-		if (info_get_bad(info))
-			return 1;
-	} else {
-		/* if a parity is not excluded, include all blocks, even unused ones */
-		for (l = 0; l < state->level; ++l) {
-			if (!state->parity[l].is_excluded_by_filter) {
-				return 1;
-			}
-		}
+/**
+ * Wait for the repair of the first pending task.
+ */
+static struct snapraid_repair_task* repair_wait(struct snapraid_repair_pool* pool)
+{
+	struct snapraid_repair_task* task = &pool->task_map[pool->task_first];
+
+	assert(pool->task_count != 0);
+
+#if HAVE_THREAD
+	if (pool->thread_max != 0) {
+		thread_mutex_lock(&pool->mutex);
+		while (task->state != REPAIR_STATE_DONE)
+			thread_cond_wait(&pool->done_cond, &pool->mutex);
+		thread_mutex_unlock(&pool->mutex);
 	}
+#endif
 
-	/* filter for the files */
-	for (j = 0; j < diskmax; ++j) {
-		struct snapraid_block* block;
+	return task;
+}
 
-		/* if no disk, nothing to check */
-		if (!handle[j].disk)
-			continue;
+/**
+ * Release the first pending task, after writing it back.
+ */
+static void repair_release(struct snapraid_repair_pool* pool)
+{
+	struct snapraid_repair_task* task = &pool->task_map[pool->task_first];
 
-		block = fs_par2block_find(handle[j].disk, i);
+#if HAVE_THREAD
+	if (pool->thread_max != 0)
+		thread_mutex_lock(&pool->mutex);
+#endif
 
-		/* try to recover all files, even the ones without hash */
-		/* because in some cases we can recover also them */
-		if (block_has_file(block)) {
-			struct snapraid_file* file = fs_par2file_get(handle[j].disk, i, 0);
-			if (!file_flag_has(file, FILE_IS_EXCLUDED)) { /* only if the file is not filtered out */
-				return 1;
-			}
-		}
-	}
+	task->state = REPAIR_STATE_EMPTY;
+	pool->task_first = (pool->task_first + 1) % pool->task_max;
+	--pool->task_count;
 
-	return 0;
+#if HAVE_THREAD
+	if (pool->thread_max != 0)
+		thread_mutex_unlock(&pool->mutex);
+#endif
 }
 
 static int state_check_process(struct snapraid_state* state, int fix, struct snapraid_parity_handle** parity, block_off_t blockstart, block_off_t blockmax)
@@ -872,8 +1662,6 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	unsigned diskmax;
 	block_off_t i;
 	unsigned j;
-	void* buffer_alloc;
-	void** buffer;
 	unsigned buffermax;
 	int ret;
 	data_off_t countsize;
@@ -882,28 +1670,31 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	unsigned error;
 	unsigned unrecoverable_error;
 	unsigned recovered_error;
-	struct failed_struct* failed;
-	unsigned* failed_map;
 	unsigned l;
 	char esc_buffer[ESC_MAX];
 	char esc_buffer_alt[ESC_MAX];
 	bit_vect_t* block_enabled;
+	struct snapraid_repair_pool pool;
+	struct snapraid_plan plan;
+	int stop;
+	int barrier;
+	void* verify_alloc;
+	struct snapraid_verify* verify;
+	void** hash_src;
+	void** hash_dst;
 
 	handle = handle_mapping(state, &diskmax);
 
+	/* blocks to verify, and hashes to compute all together */
+	verify = malloc_nofail_align(diskmax * sizeof(struct snapraid_verify), &verify_alloc);
+	hash_src = malloc_nofail(diskmax * sizeof(void*));
+	hash_dst = malloc_nofail(diskmax * sizeof(void*));
+
 	/* we need 1 * data + 2 * parity + 1 * zero */
 	buffermax = diskmax + 2 * state->level + 1;
 
-	buffer = malloc_nofail_vector_align(diskmax, buffermax, state->block_size, &buffer_alloc);
-	if (!state->opt.skip_self)
-		mtest_vector(buffermax, state->block_size, buffer);
-
-	/* fill up the zero buffer */
-	memset(buffer[buffermax - 1], 0, state->block_size);
-	raid_zero(buffer[buffermax - 1]);
-
-	failed = malloc_nofail(diskmax * sizeof(struct failed_struct));
-	failed_map = malloc_nofail(diskmax * sizeof(unsigned));
+	/* start the repair threads, each task has its buffers */
+	repair_init(&pool, state, diskmax, buffermax);
 
 	error = 0;
 	unrecoverable_error = 0;
@@ -914,11 +1705,16 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 	/* first count the number of blocks to process */
 	countmax = 0;
 	block_enabled = calloc_nofail(1, bit_vect_size(blockmax)); /* preinitialize to 0 */
-	for (i = blockstart; i < blockmax; ++i) {
-		if (!block_is_enabled(state, i, handle, diskmax))
-			continue;
-		bit_vect_set(block_enabled, i);
-		++countmax;
+	if (block_is_targeted(state)) {
+		/* only the blocks of the selected files */
+		countmax = block_select(blockstart, blockmax, handle, diskmax, block_enabled);
+	} else {
+		for (i = blockstart; i < blockmax; ++i) {
+			if (!block_is_enabled(state, i, handle, diskmax))
+				continue;
+			bit_vect_set(block_enabled, i);
+			++countmax;
+		}
 	}
 
 	if (fix)
@@ -929,21 +1725,245 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		msg_progress("Hashing...\n");
 
 	/* check all the blocks in files */
+	/* the blocks are read in order, repaired by the threads, and written back in order */
 	countsize = 0;
 	countpos = 0;
+	stop = 0;
+	barrier = 0;
 	state_progress_begin(state, blockstart, blockmax, countmax);
-	for (i = blockstart; i < blockmax; ++i) {
+	plan_init(&plan, block_enabled, blockstart, blockmax, fix ? rebuild_disk(handle, diskmax) : 0);
+	while (1) {
+		struct snapraid_repair_task* task;
+		struct failed_struct* failed;
+		void** buffer;
 		unsigned failed_count;
 		int valid_parity;
 		int used_parity;
 		snapraid_info info;
 		int rehash;
+		unsigned verify_mac;
+		unsigned hash_mac;
+
+		/* the next block to process, or blockmax at the end */
+		i = plan_next(&plan);
+
+		/* write back the pending blocks, in order */
+		/* all of them if at the end, if stopping, or if the handles they use are going to change */
+		while (repair_pending(&pool, i == blockmax || stop || barrier || block_is_switching(fix, i, handle, diskmax))) {
+			block_off_t pos;
+			void** buffer_recov;
+
+			task = repair_wait(&pool);
+
+			pos = task->pos;
+			buffer = task->buffer;
+			buffer_recov = task->buffer_recov;
+			failed = task->failed;
+			failed_count = task->failed_count;
+			valid_parity = task->valid_parity;
+			used_parity = task->used_parity;
+
+			/* write the tags of the repair all together */
+			logbuf_flush(&task->logbuf);
+
+			/* check the result of the repair */
+			if (!state->opt.auditonly) {
+				ret = task->ret;
+				if (ret != 0) {
+					/* increment the number of errors */
+					if (ret > 0)
+						error += ret;
+					++unrecoverable_error;
 
-		if (!bit_vect_test(block_enabled, i)) {
-			/* continue with the next block */
-			continue;
+					/* print a list of all the errors in files */
+					for (j = 0; j < failed_count; ++j) {
+						if (failed[j].is_bad)
+							log_tag("unrecoverable:%u:%s:%s: Unrecoverable error at position %u\n", pos, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos);
+					}
+
+					/* keep track of damaged files */
+					for (j = 0; j < failed_count; ++j) {
+						if (failed[j].is_bad)
+							file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+					}
+				} else {
+					/* now counts partial recovers */
+					/* note that this could happen only when we have an incomplete 'sync' */
+					/* and that we have recovered is the state before the 'sync' */
+					int partial_recover_error = 0;
+
+					/* print a list of all the errors in files */
+					for (j = 0; j < failed_count; ++j) {
+						if (failed[j].is_bad && failed[j].is_outofdate) {
+							++partial_recover_error;
+							log_tag("unrecoverable:%u:%s:%s: Unrecoverable unsynced error at position %u\n", pos, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos);
+						}
+					}
+					if (partial_recover_error != 0) {
+						error += partial_recover_error;
+						++unrecoverable_error;
+					}
+
+					/*
+					 * Check parities, but only if all the blocks have it computed and it's used.
+					 *
+					 * If you check/fix after a partial sync, it's OK to have parity errors
+					 * on the blocks with invalid parity and doesn't make sense to try to fix it.
+					 *
+					 * It's also OK to have data errors on unused parity, because sync doesn't
+					 * update it.
+					 */
+					if (used_parity && valid_parity) {
+						/* check the parity */
+						for (l = 0; l < state->level; ++l) {
+							if (buffer_recov[l] != 0 && memcmp(buffer_recov[l], buffer[diskmax + l], state->block_size) != 0) {
+								unsigned diff = memdiff(buffer_recov[l], buffer[diskmax + l], state->block_size);
+
+								/* mark that the read parity is wrong, setting ptr to 0 */
+								buffer_recov[l] = 0;
+
+								log_tag("parity_error:%u:%s: Data error, diff bits %u/%u\n", pos, lev_config_name(l), diff, state->block_size * 8);
+								++error;
+							}
+						}
+					}
+
+					/* now write recovered files */
+					if (fix) {
+						/* update the fixed files */
+						for (j = 0; j < failed_count; ++j) {
+							/* nothing to do if it doesn't need recovering */
+							if (!failed[j].is_bad)
+								continue;
+
+							/* do not fix if the file is excluded */
+							if (file_flag_has(failed[j].file, FILE_IS_EXCLUDED)
+								|| (state->opt.syncedonly && file_flag_has(failed[j].file, FILE_IS_UNSYNCED)))
+								continue;
+
+							ret = handle_write(failed[j].handle, failed[j].file_pos, buffer[failed[j].index], state->block_size);
+							if (ret == -1) {
+								/* LCOV_EXCL_START */
+								/* mark the file as damaged */
+								file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+
+								if (errno == EACCES) {
+									log_fatal("WARNING! Please give write permission to the file.\n");
+								} else {
+									/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
+									log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
+								}
+								log_fatal("Stopping at block %u\n", pos);
+								++unrecoverable_error;
+								goto bail;
+								/* LCOV_EXCL_STOP */
+							}
+
+							/* if we are not sure that the recovered content is uptodate */
+							if (failed[j].is_outofdate) {
+								/* mark the file as damaged */
+								file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+								continue;
+							}
+
+							/* mark the file as containing some fixes */
+							/* note that it could be also marked as damaged in other iterations */
+							file_flag_set(failed[j].file, FILE_IS_FIXED);
+
+							log_tag("fixed:%u:%s:%s: Fixed data error at position %u\n", pos, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos);
+							++recovered_error;
+						}
+
+						/*
+						 * Update parity only if all the blocks have it computed and it's used.
+						 *
+						 * If you check/fix after a partial sync, you do not want to fix parity
+						 * for blocks that are going to have it computed in the sync completion.
+						 *
+						 * For unused parity there is no need to write it, because when fixing
+						 * we already have allocated space for it on parity file creation,
+						 * and its content doesn't matter.
+						 */
+						if (used_parity && valid_parity) {
+							/* update the parity */
+							for (l = 0; l < state->level; ++l) {
+								/* if the parity on disk is wrong */
+								if (buffer_recov[l] == 0
+								        /* and we have access at the parity */
+									&& parity[l] != 0
+								        /* and the parity is not excluded */
+									&& !state->parity[l].is_excluded_by_filter
+								) {
+									ret = parity_write(parity[l], pos, buffer[diskmax + l], state->block_size);
+									if (ret == -1) {
+										/* LCOV_EXCL_START */
+										/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
+										log_fatal("WARNING! Without a working %s disk, it isn't possible to fix errors on it.\n", lev_name(l));
+										log_fatal("Stopping at block %u\n", pos);
+										++unrecoverable_error;
+										goto bail;
+										/* LCOV_EXCL_STOP */
+									}
+
+									log_tag("parity_fixed:%u:%s: Fixed data error\n", pos, lev_config_name(l));
+									++recovered_error;
+								}
+							}
+						}
+					} else {
+						/* if we are not fixing, we just set the FIXED flag */
+						/* meaning that we could fix this file if we try */
+						for (j = 0; j < failed_count; ++j) {
+							if (failed[j].is_bad) {
+								file_flag_set(failed[j].file, FILE_IS_FIXED);
+							}
+						}
+					}
+				}
+			} else {
+				/* if we are not checking, we just set the DAMAGED flag */
+				/* to report that the file is damaged, and we don't know if we can fix it */
+				for (j = 0; j < failed_count; ++j) {
+					if (failed[j].is_bad) {
+						file_flag_set(failed[j].file, FILE_IS_DAMAGED);
+					}
+				}
+			}
+
+			/* post process the files */
+			ret = file_post(state, fix, pos, handle, diskmax);
+			if (ret == -1) {
+				/* LCOV_EXCL_START */
+				log_fatal("Stopping at block %u\n", pos);
+				++unrecoverable_error;
+				goto bail;
+				/* LCOV_EXCL_STOP */
+			}
+
+			repair_release(&pool);
+
+			/* count the number of processed block */
+			++countpos;
+
+			/* progress */
+			if (!stop && state_progress(state, 0, pos, countpos, countmax, countsize)) {
+				/* LCOV_EXCL_START */
+				stop = 1;
+				/* LCOV_EXCL_STOP */
+			}
 		}
 
+		/* all the pending blocks are now written back */
+		barrier = 0;
+
+		if (i == blockmax || stop)
+			break;
+
+		/* get a free task for the block */
+		task = repair_get(&pool);
+		buffer = task->buffer;
+		failed = task->failed;
+
 		/* If we have valid parity, and it makes sense to check its content. */
 		/* If we already know that the parity is invalid, we just read the file */
 		/* but we don't report parity errors */
@@ -963,10 +1983,12 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 		/* if we have to use the old hash */
 		rehash = info_get_rehash(info);
 
-		/* for each disk, process the block */
+		verify_mac = 0;
+		hash_mac = 0;
+
+		/* for each disk, read the block */
 		for (j = 0; j < diskmax; ++j) {
 			int read_size;
-			unsigned char hash[HASH_MAX];
 			struct snapraid_disk* disk;
 			struct snapraid_block* block;
 			struct snapraid_file* file;
@@ -1070,6 +2092,19 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 						/* if fragmented, it may be reopened, so remember that the file */
 						/* was originally missing */
 						file_flag_set(file, FILE_IS_CREATED);
+
+						/* allocate the whole file, to have it not fragmented on the disk */
+						if (!state->opt.skip_fallocate) {
+							ret = handle_allocate(&handle[j], file);
+							if (ret == -1) {
+								/* LCOV_EXCL_START */
+								log_fatal("DANGER! Without a working data disk, it isn't possible to fix errors on it.\n");
+								log_fatal("Stopping at block %u\n", i);
+								++unrecoverable_error;
+								goto bail;
+								/* LCOV_EXCL_STOP */
+							}
+						}
 					}
 				} else {
 					/* open the file only for reading */
@@ -1190,54 +2225,83 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 
 			assert(block_state == BLOCK_STATE_BLK || block_state == BLOCK_STATE_REP);
 
-			/* compute the hash of the block just read */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[j], read_size);
+			/* insert the block in the failed set, to keep it ordered by disk */
+			/* the BLK blocks with the expected hash are removed later */
+			failed[failed_count].is_bad = 0;
+			failed[failed_count].is_outofdate = 0;
+			failed[failed_count].index = j;
+			failed[failed_count].block = block;
+			failed[failed_count].disk = disk;
+			failed[failed_count].file = file;
+			failed[failed_count].file_pos = file_pos;
+			failed[failed_count].handle = &handle[j];
+
+			verify[verify_mac].failed_pos = failed_count;
+
+			if ((unsigned)read_size == state->block_size) {
+				/* full blocks are hashed later, all the disks together */
+				hash_src[hash_mac] = buffer[j];
+				hash_dst[hash_mac] = verify[verify_mac].hash;
+				++hash_mac;
 			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[j], read_size);
+				/* partial blocks at the end of files are hashed now */
+				if (rehash) {
+					memhash(state->prevhash, state->prevhashseed, verify[verify_mac].hash, buffer[j], read_size);
+				} else {
+					memhash(state->hash, state->hashseed, verify[verify_mac].hash, buffer[j], read_size);
+				}
 			}
 
-			/* compare the hash */
-			if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
-				unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
+			++verify_mac;
+			++failed_count;
+		}
 
-				/* save the failed block for the check/fix */
-				failed[failed_count].is_bad = 1; /* it's bad because the hash doesn't match */
-				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
-				failed[failed_count].block = block;
-				failed[failed_count].disk = disk;
-				failed[failed_count].file = file;
-				failed[failed_count].file_pos = file_pos;
-				failed[failed_count].handle = &handle[j];
-				++failed_count;
+		/* compute the hash of all the full blocks */
+		if (rehash) {
+			memhash_vec(state->prevhash, state->prevhashseed, hash_dst, hash_src, hash_mac, state->block_size);
+		} else {
+			memhash_vec(state->hash, state->hashseed, hash_dst, hash_src, hash_mac, state->block_size);
+		}
 
-				log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u/%u\n", i, disk->name, esc_tag(file->sub, esc_buffer), file_pos, diff, BLOCK_HASH_SIZE * 8);
-				++error;
-				continue;
-			}
+		/* compare the hash of all the blocks read */
+		if (verify_mac != 0) {
+			unsigned k;
+			unsigned v;
 
-			/* always insert REP blocks, the repair functions needs all of them */
-			/* because the parity may be still referring at the old state */
-			/* and the repair must be aware of it */
-			if (block_state == BLOCK_STATE_REP) {
-				failed[failed_count].is_bad = 0; /* it's not bad */
-				failed[failed_count].is_outofdate = 0;
-				failed[failed_count].index = j;
-				failed[failed_count].block = block;
-				failed[failed_count].disk = disk;
-				failed[failed_count].file = file;
-				failed[failed_count].file_pos = file_pos;
-				failed[failed_count].handle = &handle[j];
-				++failed_count;
-				continue;
+			k = 0;
+			v = 0;
+			for (j = 0; j < failed_count; ++j) {
+				if (v < verify_mac && verify[v].failed_pos == j) {
+					unsigned char* hash = verify[v].hash;
+					struct snapraid_block* block = failed[j].block;
+
+					++v;
+
+					if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
+						unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
+
+						/* it's bad because the hash doesn't match */
+						failed[j].is_bad = 1;
+
+						log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u/%u\n", i, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos, diff, BLOCK_HASH_SIZE * 8);
+						++error;
+					} else if (block_state_get(block) != BLOCK_STATE_REP) {
+						/* always keep REP blocks, the repair functions needs all of them */
+						/* because the parity may be still referring at the old state */
+						/* and the repair must be aware of it */
+						continue;
+					}
+				}
+
+				failed[k++] = failed[j];
 			}
+
+			failed_count = k;
 		}
 
-		/* now read and check the parity if requested */
+		/* now read the parity if requested, it's checked when writing back */
 		if (!state->opt.auditonly) {
-			void* buffer_recov[LEV_MAX];
-			void* buffer_zero;
+			void** buffer_recov = task->buffer_recov;
 
 			/* buffers for parity read and not computed */
 			for (l = 0; l < state->level; ++l)
@@ -1245,9 +2309,6 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 			for (; l < LEV_MAX; ++l)
 				buffer_recov[l] = 0;
 
-			/* the zero buffer is the last one */
-			buffer_zero = buffer[buffermax - 1];
-
 			/* read the parity */
 			for (l = 0; l < state->level; ++l) {
 				if (parity[l]) {
@@ -1262,189 +2323,20 @@ static int state_check_process(struct snapraid_state* state, int fix, struct sna
 					buffer_recov[l] = 0;
 				}
 			}
-
-			/* try all the recovering strategies */
-			ret = repair(state, rehash, i, diskmax, failed, failed_map, failed_count, buffer, buffer_recov, buffer_zero);
-			if (ret != 0) {
-				/* increment the number of errors */
-				if (ret > 0)
-					error += ret;
-				++unrecoverable_error;
-
-				/* print a list of all the errors in files */
-				for (j = 0; j < failed_count; ++j) {
-					if (failed[j].is_bad)
-						log_tag("unrecoverable:%u:%s:%s: Unrecoverable error at position %u\n", i, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos);
-				}
-
-				/* keep track of damaged files */
-				for (j = 0; j < failed_count; ++j) {
-					if (failed[j].is_bad)
-						file_flag_set(failed[j].file, FILE_IS_DAMAGED);
-				}
-			} else {
-				/* now counts partial recovers */
-				/* note that this could happen only when we have an incomplete 'sync' */
-				/* and that we have recovered is the state before the 'sync' */
-				int partial_recover_error = 0;
-
-				/* print a list of all the errors in files */
-				for (j = 0; j < failed_count; ++j) {
-					if (failed[j].is_bad && failed[j].is_outofdate) {
-						++partial_recover_error;
-						log_tag("unrecoverable:%u:%s:%s: Unrecoverable unsynced error at position %u\n", i, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos);
-					}
-				}
-				if (partial_recover_error != 0) {
-					error += partial_recover_error;
-					++unrecoverable_error;
-				}
-
-				/*
-				 * Check parities, but only if all the blocks have it computed and it's used.
-				 *
-				 * If you check/fix after a partial sync, it's OK to have parity errors
-				 * on the blocks with invalid parity and doesn't make sense to try to fix it.
-				 *
-				 * It's also OK to have data errors on unused parity, because sync doesn't
-				 * update it.
-				 */
-				if (used_parity && valid_parity) {
-					/* check the parity */
-					for (l = 0; l < state->level; ++l) {
-						if (buffer_recov[l] != 0 && memcmp(buffer_recov[l], buffer[diskmax + l], state->block_size) != 0) {
-							unsigned diff = memdiff(buffer_recov[l], buffer[diskmax + l], state->block_size);
-
-							/* mark that the read parity is wrong, setting ptr to 0 */
-							buffer_recov[l] = 0;
-
-							log_tag("parity_error:%u:%s: Data error, diff bits %u/%u\n", i, lev_config_name(l), diff, state->block_size * 8);
-							++error;
-						}
-					}
-				}
-
-				/* now write recovered files */
-				if (fix) {
-					/* update the fixed files */
-					for (j = 0; j < failed_count; ++j) {
-						/* nothing to do if it doesn't need recovering */
-						if (!failed[j].is_bad)
-							continue;
-
-						/* do not fix if the file is excluded */
-						if (file_flag_has(failed[j].file, FILE_IS_EXCLUDED)
-							|| (state->opt.syncedonly && file_flag_has(failed[j].file, FILE_IS_UNSYNCED)))
-							continue;
-
-						ret = handle_write(failed[j].handle, failed[j].file_pos, buffer[failed[j].index], state->block_size);
-						if (ret == -1) {
-							/* LCOV_EXCL_START */
-							/* mark the file as damaged */
-							file_flag_set(failed[j].file, FILE_IS_DAMAGED);
-
-							if (errno == EACCES) {
-								log_fatal("WARNING! Please give write permission to the file.\n");
-							} else {
-								/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
-								log_fatal("WARNING! Without a working data disk, it isn't possible to fix errors on it.\n");
-							}
-							log_fatal("Stopping at block %u\n", i);
-							++unrecoverable_error;
-							goto bail;
-							/* LCOV_EXCL_STOP */
-						}
-
-						/* if we are not sure that the recovered content is uptodate */
-						if (failed[j].is_outofdate) {
-							/* mark the file as damaged */
-							file_flag_set(failed[j].file, FILE_IS_DAMAGED);
-							continue;
-						}
-
-						/* mark the file as containing some fixes */
-						/* note that it could be also marked as damaged in other iterations */
-						file_flag_set(failed[j].file, FILE_IS_FIXED);
-
-						log_tag("fixed:%u:%s:%s: Fixed data error at position %u\n", i, failed[j].disk->name, esc_tag(failed[j].file->sub, esc_buffer), failed[j].file_pos);
-						++recovered_error;
-					}
-
-					/*
-					 * Update parity only if all the blocks have it computed and it's used.
-					 *
-					 * If you check/fix after a partial sync, you do not want to fix parity
-					 * for blocks that are going to have it computed in the sync completion.
-					 *
-					 * For unused parity there is no need to write it, because when fixing
-					 * we already have allocated space for it on parity file creation,
-					 * and its content doesn't matter.
-					 */
-					if (used_parity && valid_parity) {
-						/* update the parity */
-						for (l = 0; l < state->level; ++l) {
-							/* if the parity on disk is wrong */
-							if (buffer_recov[l] == 0
-							        /* and we have access at the parity */
-								&& parity[l] != 0
-							        /* and the parity is not excluded */
-								&& !state->parity[l].is_excluded_by_filter
-							) {
-								ret = parity_write(parity[l], i, buffer[diskmax + l], state->block_size);
-								if (ret == -1) {
-									/* LCOV_EXCL_START */
-									/* we do not use DANGER because it could be ENOSPC which is not always correctly reported */
-									log_fatal("WARNING! Without a working %s disk, it isn't possible to fix errors on it.\n", lev_name(l));
-									log_fatal("Stopping at block %u\n", i);
-									++unrecoverable_error;
-									goto bail;
-									/* LCOV_EXCL_STOP */
-								}
-
-								log_tag("parity_fixed:%u:%s: Fixed data error\n", i, lev_config_name(l));
-								++recovered_error;
-							}
-						}
-					}
-				} else {
-					/* if we are not fixing, we just set the FIXED flag */
-					/* meaning that we could fix this file if we try */
-					for (j = 0; j < failed_count; ++j) {
-						if (failed[j].is_bad) {
-							file_flag_set(failed[j].file, FILE_IS_FIXED);
-						}
-					}
-				}
-			}
-		} else {
-			/* if we are not checking, we just set the DAMAGED flag */
-			/* to report that the file is damaged, and we don't know if we can fix it */
-			for (j = 0; j < failed_count; ++j) {
-				if (failed[j].is_bad) {
-					file_flag_set(failed[j].file, FILE_IS_DAMAGED);
-				}
-			}
 		}
 
-		/* post process the files */
-		ret = file_post(state, fix, i, handle, diskmax);
-		if (ret == -1) {
-			/* LCOV_EXCL_START */
-			log_fatal("Stopping at block %u\n", i);
-			++unrecoverable_error;
-			goto bail;
-			/* LCOV_EXCL_STOP */
-		}
+		task->pos = i;
+		task->rehash = rehash;
+		task->valid_parity = valid_parity;
+		task->used_parity = used_parity;
+		task->failed_count = failed_count;
 
-		/* count the number of processed block */
-		++countpos;
+		/* try all the recovering strategies */
+		repair_submit(&pool, task);
 
-		/* progress */
-		if (state_progress(state, 0, i, countpos, countmax, countsize)) {
-			/* LCOV_EXCL_START */
-			break;
-			/* LCOV_EXCL_STOP */
-		}
+		/* the files ending in this block are closed when writing it back */
+		/* so no other block can be read before */
+		barrier = block_is_last(fix, i, handle, diskmax);
 	}
 
 	/* for each disk, recover empty files, symlinks and empty dirs */
@@ -1874,6 +2766,9 @@ bail:
 		}
 	}
 
+	/* stop the repair threads, collecting their stats */
+	repair_done(&pool);
+
 	if (error || recovered_error || unrecoverable_error) {
 		msg_status("\n");
 		msg_status("%8u errors\n", error);
@@ -1903,6 +2798,11 @@ bail:
 		log_tag("summary:error_recovered:%u\n", recovered_error);
 	if (!state->opt.auditonly)
 		log_tag("summary:error_unrecoverable:%u\n", unrecoverable_error);
+	if (pool.cache.search != 0) {
+		/* how many times the parities that recovered the previous failures worked again */
+		msg_verbose("%8" PRIu64 " of %" PRIu64 " recovered with the cached parity combination\n", pool.cache.hit, pool.cache.search);
+		log_tag("summary:repair_cache_hit:%" PRIu64 ":%" PRIu64 "\n", pool.cache.hit, pool.cache.search);
+	}
 	if (fix) {
 		if (error + recovered_error + unrecoverable_error == 0)
 			log_tag("summary:exit:ok\n");
@@ -1925,12 +2825,11 @@ bail:
 	}
 	log_flush();
 
-	free(failed);
-	free(failed_map);
 	free(block_enabled);
 	free(handle);
-	free(buffer_alloc);
-	free(buffer);
+	free(verify_alloc);
+	free(hash_src);
+	free(hash_dst);
 
 	/* fail if some error are present after the run */
 	if (fix) {
@@ -2014,7 +2913,7 @@ int state_check(struct snapraid_state* state, int fix, block_off_t blockstart, b
 					/* LCOV_EXCL_STOP */
 				}
 
-				ret = parity_chsize(parity_ptr[l], &state->parity[l], 0, size, state->block_size, state->opt.skip_fallocate, state->opt.skip_space_holder);
+				ret = parity_chsize(parity_ptr[l], &state->parity[l], 0, size, state->block_size, state->opt.skip_fallocate, state->opt.skip_space_holder, 0);
 				if (ret == -1) {
 					/* LCOV_EXCL_START */
 					log_fatal("WARNING! Without an accessible %s file, it isn't possible to sync.\n", lev_name(l));
@@ -757,6 +757,9 @@ struct snapraid_disk* disk_alloc(const char* name, const char* dir, uint64_t dev
 	disk->device = dev;
 	disk->tick = 0;
 	disk->cached_blocks = 0;
+	memset(disk->access_latency, 0, sizeof(disk->access_latency));
+	disk->access_tick = 0;
+	disk->access_size = 0;
 	disk->progress_file = 0;
 	disk->total_blocks = 0;
 	disk->free_blocks = 0;
@@ -1434,6 +1437,109 @@ int time_compare(const void* void_a, const void* void_b)
 	return 0;
 }
 
+/****************************************************************************/
+/* time histogram */
+
+void timehist_init(struct snapraid_timehist* hist)
+{
+	tommy_hashdyn_init(&hist->set);
+	tommy_list_init(&hist->list);
+	hist->last = 0;
+	hist->count = 0;
+}
+
+void timehist_done(struct snapraid_timehist* hist)
+{
+	tommy_hashdyn_done(&hist->set);
+	tommy_list_foreach(&hist->list, free);
+}
+
+static int timecount_compare_by_time(const void* void_arg, const void* void_data)
+{
+	const time_t* arg = void_arg;
+	const struct snapraid_timecount* data = void_data;
+
+	return *arg != data->time;
+}
+
+void timehist_insert(struct snapraid_timehist* hist, time_t time)
+{
+	struct snapraid_timecount* entry;
+	tommy_hash_t hash;
+
+	++hist->count;
+
+	/* fast path for consecutive blocks with the same time */
+	if (hist->last && hist->last->time == time) {
+		++hist->last->count;
+		return;
+	}
+
+	hash = tommy_inthash_u64(time);
+
+	entry = tommy_hashdyn_search(&hist->set, timecount_compare_by_time, &time, hash);
+	if (!entry) {
+		entry = malloc_nofail(sizeof(struct snapraid_timecount));
+		entry->time = time;
+		entry->count = 0;
+		tommy_hashdyn_insert(&hist->set, &entry->nodeset, entry, hash);
+		tommy_list_insert_tail(&hist->list, &entry->nodelist, entry);
+	}
+
+	++entry->count;
+	hist->last = entry;
+}
+
+static int timecount_compare(const void* void_a, const void* void_b)
+{
+	const struct snapraid_timecount* a = void_a;
+	const struct snapraid_timecount* b = void_b;
+
+	return time_compare(&a->time, &b->time);
+}
+
+void timehist_sort(struct snapraid_timehist* hist)
+{
+	tommy_list_sort(&hist->list, timecount_compare);
+}
+
+time_t timehist_rank(struct snapraid_timehist* hist, block_off_t pos)
+{
+	tommy_node* i;
+
+	for (i = tommy_list_head(&hist->list); i != 0; i = i->next) {
+		struct snapraid_timecount* entry = i->data;
+
+		if (pos < entry->count)
+			return entry->time;
+
+		pos -= entry->count;
+	}
+
+	/* LCOV_EXCL_START */
+	log_fatal("Internal inconsistency in time histogram position\n");
+	os_abort();
+	/* LCOV_EXCL_STOP */
+}
+
+block_off_t timehist_upto(struct snapraid_timehist* hist, time_t time)
+{
+	tommy_node* i;
+	block_off_t count;
+
+	count = 0;
+	for (i = tommy_list_head(&hist->list); i != 0; i = i->next) {
+		struct snapraid_timecount* entry = i->data;
+
+		if (entry->time > time)
+			break;
+
+		count += entry->count;
+	}
+
+	return count;
+}
+
 /****************************************************************************/
 /* format */
 
@@ -35,6 +35,12 @@
  */
 #define PROGRESS_MAX 100
 
+/**
+ * Number of buckets of the histogram of the access latency.
+ * Bucket N counts the accesses taking less than 2^N ticks.
+ */
+#define LATENCY_MAX 40
+
 /**
  * Max UUID length.
  */
@@ -340,6 +346,9 @@ struct snapraid_disk {
 	uint64_t progress_tick[PROGRESS_MAX]; /**< Last ticks of progress. */
 	unsigned cached_blocks; /**< Number of IO blocks cached. */
 	struct snapraid_file* progress_file; /**< File in progress. */
+	uint64_t access_latency[LATENCY_MAX]; /**< Histogram of the latency of the accesses. */
+	uint64_t access_tick; /**< Total time of the accesses. */
+	uint64_t access_size; /**< Total size of the accesses. */
 
 	/**
 	 * First free searching block.
@@ -470,6 +479,8 @@ struct snapraid_split {
 struct snapraid_parity {
 	struct snapraid_split split_map[SPLIT_MAX]; /**< Parity splits. */
 	unsigned split_mac; /**< Number of parity splits. */
+	int stripe; /**< If the parity blocks are striped over the splits, instead of concatenated. */
+	char sum[PATH_MAX]; /**< Path of the file with the checksums of the parity blocks. Empty means not used. */
 	char smartctl[PATH_MAX]; /**< Custom command for smartctl. Empty means auto. */
 	block_off_t total_blocks; /**< Number of total blocks. */
 	block_off_t free_blocks; /**< Number of free blocks at the last sync. */
@@ -478,6 +489,9 @@ struct snapraid_parity {
 	uint64_t tick; /**< Usage time. */
 	uint64_t progress_tick[PROGRESS_MAX]; /**< Last cpu ticks of progress. */
 	unsigned cached_blocks; /**< Number of IO blocks cached. */
+	uint64_t access_latency[LATENCY_MAX]; /**< Histogram of the latency of the accesses. */
+	uint64_t access_tick; /**< Total time of the accesses. */
+	uint64_t access_size; /**< Total size of the accesses. */
 };
 
 /**
@@ -1224,6 +1238,58 @@ static inline snapraid_info info_get(tommy_arrayblkof* array, block_off_t pos)
  */
 int time_compare(const void* void_a, const void* void_b);
 
+/****************************************************************************/
+/* time histogram */
+
+/**
+ * Number of blocks with the same time.
+ */
+struct snapraid_timecount {
+	time_t time; /**< Time of the blocks. */
+	block_off_t count; /**< Number of blocks with this time. */
+	tommy_node nodeset;
+	tommy_node nodelist;
+};
+
+/**
+ * Histogram of the block times.
+ *
+ * The blocks get the time of the 'sync' or 'scrub' that processed them,
+ * so the distinct times are few, and the histogram is a lot smaller than
+ * the array of all the block times.
+ */
+struct snapraid_timehist {
+	tommy_hashdyn set; /**< Distinct times. */
+	tommy_list list; /**< Distinct times. Sorted by time after timehist_sort(). */
+	struct snapraid_timecount* last; /**< Last time inserted, as consecutive blocks often share it. */
+	block_off_t count; /**< Total number of blocks. */
+};
+
+void timehist_init(struct snapraid_timehist* hist);
+void timehist_done(struct snapraid_timehist* hist);
+
+/**
+ * Count one more block with the specified time.
+ */
+void timehist_insert(struct snapraid_timehist* hist, time_t time);
+
+/**
+ * Sort the histogram by time.
+ * It must be called after all the insertions, and before any query.
+ */
+void timehist_sort(struct snapraid_timehist* hist);
+
+/**
+ * Get the time of the block at the specified position in time order.
+ * The position must be less than the number of blocks.
+ */
+time_t timehist_rank(struct snapraid_timehist* hist, block_off_t pos);
+
+/**
+ * Get the number of blocks with time less or equal than the specified one.
+ */
+block_off_t timehist_upto(struct snapraid_timehist* hist, time_t time);
+
 /****************************************************************************/
 /* format */
 
@@ -20,6 +20,7 @@
 #include "elem.h"
 #include "support.h"
 #include "handle.h"
+#include "iomodel.h"
 
 /****************************************************************************/
 /* handle */
@@ -141,6 +142,42 @@ int handle_truncate(struct snapraid_handle* handle, struct snapraid_file* file)
 	return 0;
 }
 
+int handle_allocate(struct snapraid_handle* handle, struct snapraid_file* file)
+{
+	int ret;
+
+	if (file->size == 0)
+		return 0;
+
+#if HAVE_FALLOCATE
+	ret = fallocate(handle->f, 0, 0, file->size);
+
+	/* in some legacy system fallocate() may return the error number as positive integer */
+	if (ret > 0) {
+		/* LCOV_EXCL_START */
+		errno = ret;
+		ret = -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* if not supported, the file is just written without allocating it */
+	if (ret != 0 && (errno == EOPNOTSUPP || errno == ENOSYS))
+		ret = 0;
+#else
+	(void)handle;
+	ret = 0;
+#endif
+
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error allocating file '%s'. %s.\n", handle->path, strerror(errno));
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
 int handle_open(struct snapraid_handle* handle, struct snapraid_file* file, int mode, fptr* out, fptr* out_missing)
 {
 	int ret;
@@ -259,6 +296,8 @@ int handle_read(struct snapraid_handle* handle, block_off_t file_pos, unsigned c
 
 	read_size = file_block_size(handle->file, file_pos, block_size);
 
+	iomodel_access(IOMODEL_DISK, handle->disk->name, handle->file, offset, read_size);
+
 	count = 0;
 	do {
 		/* read the full block to support O_DIRECT */
@@ -304,6 +343,8 @@ int handle_write(struct snapraid_handle* handle, block_off_t file_pos, unsigned
 
 	write_size = file_block_size(handle->file, file_pos, block_size);
 
+	iomodel_access(IOMODEL_DISK, handle->disk->name, handle->file, offset, write_size);
+
 	write_ret = pwrite(handle->f, block_buffer, write_size, offset);
 	if (write_ret != (ssize_t)write_size) { /* conversion is safe because block_size is always small */
 		/* LCOV_EXCL_START */
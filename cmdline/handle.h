@@ -50,6 +50,13 @@ int handle_create(struct snapraid_handle* handle, struct snapraid_file* file, in
  */
 int handle_truncate(struct snapraid_handle* handle, struct snapraid_file* file);
 
+/**
+ * Allocate the space of a file just created, to write it without fragmentation.
+ * The data is not considered valid until written.
+ * If the file-system doesn't support the allocation, nothing is done.
+ */
+int handle_allocate(struct snapraid_handle* handle, struct snapraid_file* file);
+
 /**
  * Open a file.
  * The file is opened for reading.
@@ -135,6 +135,103 @@ static void io_writer_sched_empty(struct snapraid_io* io, int task_index, block_
 	}
 }
 
+/**
+ * Account the data read by a reader for the rate limit.
+ *
+ * Return the number of milliseconds to wait to stay in the limit.
+ */
+static unsigned io_rate_account(struct snapraid_io* io, struct snapraid_worker* worker, struct snapraid_task* task)
+{
+	uint64_t now;
+	uint64_t due;
+
+	/* parity readers don't report the size read */
+	if (worker->parity_handle) {
+		if (task->state == TASK_STATE_DONE)
+			io->rate_size += io->state->block_size;
+	} else if (task->read_size > 0) {
+		io->rate_size += task->read_size;
+	}
+
+	/* time when all the data read so far is allowed */
+	due = io->rate_start + io->rate_size * 1000 / io->rate_limit;
+
+	now = tick_ms();
+	if (now >= due) {
+		/* if we are behind, like after a pause for autosave, */
+		/* restart the measure to avoid a burst to recover the lost time */
+		if (now > due + 1000) {
+			io->rate_start = now;
+			io->rate_size = 0;
+		}
+		return 0;
+	}
+
+	return due - now;
+}
+
+/**
+ * Account the latency and the size of an access to a disk.
+ *
+ * Each disk has at most one worker at time, but the counters are also
+ * read by the main thread to write the telemetry.
+ */
+static void io_access(struct snapraid_worker* worker, struct snapraid_task* task, const char* name, uint64_t start)
+{
+	struct snapraid_state* state = worker->io->state;
+	uint64_t* latency;
+	uint64_t* access_tick;
+	uint64_t* access_size;
+	uint64_t size;
+	uint64_t stop;
+	uint64_t delta;
+	unsigned k;
+
+	stop = tick();
+
+	trace_span(worker->trace, name, start, stop, task->position);
+
+	if (worker->parity_handle) {
+		struct snapraid_parity* parity = &state->parity[worker->parity_handle->level];
+
+		/* parity accesses don't report the size */
+		if (task->state != TASK_STATE_DONE)
+			return;
+		size = state->block_size;
+
+		latency = parity->access_latency;
+		access_tick = &parity->access_tick;
+		access_size = &parity->access_size;
+	} else {
+		struct snapraid_disk* disk = worker->handle->disk;
+
+		/* skip the blocks without a file to read */
+		if (!disk || task->read_size <= 0)
+			return;
+		size = task->read_size;
+
+		latency = disk->access_latency;
+		access_tick = &disk->access_tick;
+		access_size = &disk->access_size;
+	}
+
+	delta = stop - start;
+
+	k = 0;
+	while (k < LATENCY_MAX - 1 && delta >= (1ULL << k))
+		++k;
+
+#if HAVE_THREAD
+	thread_fetch_add(&latency[k], 1);
+	thread_fetch_add(access_tick, delta);
+	thread_fetch_add(access_size, size);
+#else
+	latency[k] += 1;
+	*access_tick += delta;
+	*access_size += size;
+#endif
+}
+
 /*****************************************************************************/
 /* mono thread */
 
@@ -208,9 +305,20 @@ static struct snapraid_task* io_task_read_mono(struct snapraid_io* io, unsigned
 	task = &worker->task_map[0];
 
 	/* do the work */
-	if (task->state != TASK_STATE_EMPTY)
+	if (task->state != TASK_STATE_EMPTY) {
+		uint64_t start = tick();
+
 		worker->func(worker, task);
 
+		io_access(worker, task, "read", start);
+
+		if (io->rate_limit != 0) {
+			unsigned wait = io_rate_account(io, worker, task);
+			if (wait != 0)
+				sleep_ms(wait);
+		}
+	}
+
 	/* return the position */
 	*pos = i - base;
 
@@ -246,9 +354,14 @@ static void io_parity_write_mono(struct snapraid_io* io, unsigned* pos, unsigned
 	io->writer_error[i] = 0;
 
 	/* do the work */
-	if (task->state != TASK_STATE_EMPTY)
+	if (task->state != TASK_STATE_EMPTY) {
+		uint64_t start = tick();
+
 		worker->func(worker, task);
 
+		io_access(worker, task, "write", start);
+	}
+
 	/* return the position */
 	*pos = i;
 
@@ -265,6 +378,9 @@ static void io_start_mono(struct snapraid_io* io,
 	io->block_max = blockmax;
 	io->block_enabled = block_enabled;
 	io->block_next = blockstart;
+
+	io->rate_start = tick_ms();
+	io->rate_size = 0;
 }
 
 static void io_stop_mono(struct snapraid_io* io)
@@ -279,121 +395,286 @@ static void io_stop_mono(struct snapraid_io* io)
 #if HAVE_THREAD
 
 /**
- * Get the next task to work on for a reader.
+ * Take a buffer from the pool for a task of a reader.
+ */
+static void io_buffer_take(struct snapraid_io* io, struct snapraid_worker* worker, unsigned task_index)
+{
+	struct snapraid_task* task = &worker->task_map[task_index];
+	unsigned i = worker - io->reader_map;
+
+	/* the depth of the readers ensures that a buffer is always free */
+	assert(io->pool_count > 0);
+
+	task->buffer = io->pool_free[--io->pool_count];
+	io->buffer_map[task_index][worker->buffer_skew + i] = task->buffer;
+}
+
+/**
+ * Return in the pool the buffers of all the readers at the specified index.
+ */
+static void io_buffer_release(struct snapraid_io* io, unsigned task_index)
+{
+	unsigned i;
+
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		void** slot = &io->buffer_map[task_index][worker->buffer_skew + i];
+
+		if (*slot) {
+			io->pool_free[io->pool_count++] = *slot;
+			*slot = 0;
+		}
+	}
+}
+
+/**
+ * Number of blocks that a reader is allowed to read ahead of the IO.
+ */
+static unsigned io_reader_ahead(struct snapraid_io* io, struct snapraid_worker* worker)
+{
+	return (worker->limit + io->io_max - io->reader_index) % io->io_max;
+}
+
+/**
+ * Extend the tasks that the readers are allowed to process up to their depth.
  *
- * This is the synchronization point for workers with the io.
+ * The buffers of the new tasks are taken from the pool, and only after
+ * the new limit is published to the reader.
  */
-static struct snapraid_task* io_reader_step(struct snapraid_worker* worker)
+static void io_reader_extend(struct snapraid_io* io)
 {
-	struct snapraid_io* io = worker->io;
+	unsigned i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		unsigned ahead = io_reader_ahead(io, worker);
+		unsigned limit = worker->limit;
 
-	while (1) {
-		unsigned next_index;
+		if (ahead >= worker->depth)
+			continue;
 
-		/* check if the worker has to exit */
-		/* even if there is work to do */
-		if (io->done) {
-			thread_mutex_unlock(&io->io_mutex);
-			return 0;
+		while (ahead < worker->depth) {
+			limit = (limit + 1) % io->io_max;
+			io_buffer_take(io, worker, limit);
+			++ahead;
 		}
 
-		/* get the next pending task */
-		next_index = (worker->index + 1) % io->io_max;
+		thread_store(&worker->limit, limit);
+	}
+}
 
-		/* if the queue of pending tasks is not empty */
-		if (next_index != io->reader_index) {
-			struct snapraid_task* task;
+/**
+ * Depth that a reader should have, proportional to its score.
+ */
+static unsigned io_balance_want(struct snapraid_io* io, struct snapraid_worker* worker, unsigned base, unsigned extra, uint64_t total)
+{
+	unsigned depth;
+
+	depth = base + (unsigned)(extra * (uint64_t)worker->score / total);
+	if (depth > io->io_depth)
+		depth = io->io_depth;
+
+	return depth;
+}
+
+/**
+ * Adapt the read-ahead depth of the readers.
+ *
+ * The readers that made the IO wait more get a deeper queue, taking
+ * buffers from the ones that are always ready, like SSDs.
+ *
+ * A reader keeps the buffers of the tasks it's already allowed to process,
+ * so the depth of the growing readers is limited to keep the sum of the
+ * buffers in use, plus one each for the task used by the IO, in the pool.
+ */
+static void io_balance(struct snapraid_io* io)
+{
+	unsigned budget = io->pool_max - io->reader_max;
+	unsigned base;
+	unsigned extra;
+	unsigned used;
+	uint64_t total;
+	unsigned i;
 
-			/* the index that the IO may be waiting for */
-			unsigned waiting_index = io->reader_index;
+	/* the old waits count half at each balance */
+	total = 0;
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
 
-			/* the index that worker just completed */
-			unsigned done_index = worker->index;
+		worker->score = worker->score / 2 + worker->waited;
+		worker->waited = 0;
+		total += worker->score;
+	}
 
-			/* get the new working task */
-			worker->index = next_index;
-			task = &worker->task_map[worker->index];
+	/* if nobody is waited, keep the current depths */
+	if (total == 0)
+		return;
 
-			/* if the just completed task is at this index */
-			if (done_index == waiting_index) {
-				/* notify the IO that a new read is complete */
-				thread_cond_signal_and_unlock(&io->read_done, &io->io_mutex);
-			} else {
-				thread_mutex_unlock(&io->io_mutex);
-			}
+	/* half of the buffers are shared equally, the other half by score */
+	base = budget / io->reader_max / 2;
+	if (base < 1)
+		base = 1;
+	extra = budget - base * io->reader_max;
 
-			/* return the new task */
-			return task;
+	/* first shrink, accounting the buffers still in use */
+	used = 0;
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		unsigned ahead = io_reader_ahead(io, worker);
+		unsigned want = io_balance_want(io, worker, base, extra, total);
+
+		if (want <= worker->depth)
+			worker->depth = want;
+
+		used += ahead > worker->depth ? ahead : worker->depth;
+	}
+
+	/* then grow with the buffers left */
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
+		unsigned ahead = io_reader_ahead(io, worker);
+		unsigned want = io_balance_want(io, worker, base, extra, total);
+		unsigned commit = ahead > worker->depth ? ahead : worker->depth;
+
+		if (want <= worker->depth)
+			continue;
+
+		if (want > commit) {
+			unsigned grow = want - commit;
+			if (grow > budget - used)
+				grow = budget - used;
+			used += grow;
+			worker->depth = commit + grow;
+		} else {
+			/* already using more buffers than wanted */
+			worker->depth = want;
 		}
+	}
+}
+
+/**
+ * Wait until the value changes, or the io is done.
+ *
+ * This is the slow path of the synchronization, used only when a worker
+ * has nothing to do, or when the IO has to wait a worker.
+ *
+ * The parked counter is incremented before checking again the value,
+ * and the other side reads it after changing the value, so at least one
+ * of the two sees the change of the other, and no wake up is lost.
+ */
+static void io_park(struct snapraid_io* io, unsigned* parked, thread_cond_t* cond, unsigned* value, unsigned old)
+{
+	thread_mutex_lock(&io->io_mutex);
+
+	thread_fetch_add(parked, 1);
+
+	while (thread_load(value) == old && !thread_load(&io->done))
+		thread_cond_wait(cond, &io->io_mutex);
+
+	thread_fetch_sub(parked, 1);
+
+	thread_mutex_unlock(&io->io_mutex);
+}
+
+/**
+ * Wake up all the threads parked on the condition, if any.
+ */
+static void io_wake(struct snapraid_io* io, unsigned* parked, thread_cond_t* cond)
+{
+	if (thread_load(parked) == 0)
+		return;
+
+	thread_mutex_lock(&io->io_mutex);
+	thread_cond_broadcast_and_unlock(cond, &io->io_mutex);
+}
+
+/**
+ * Get the next task to work on for a reader.
+ *
+ * This is the synchronization point for workers with the io.
+ *
+ * The tasks of each reader are a single producer single consumer ring.
+ * The IO publishes in ::limit the latest task that the reader can process,
+ * and the reader publishes in ::index the task in progress, meaning that
+ * all the previous ones are completed.
+ */
+static struct snapraid_task* io_reader_step(struct snapraid_worker* worker)
+{
+	struct snapraid_io* io = worker->io;
+
+	/* the index that worker just completed */
+	unsigned done_index = worker->index;
+
+	while (1) {
+		/* check if the worker has to exit */
+		/* even if there is work to do */
+		if (thread_load(&io->done))
+			return 0;
+
+		/* if the worker is allowed to process the next task */
+		if (thread_load(&worker->limit) != done_index)
+			break;
 
 		/* otherwise wait for a read_sched event */
-		thread_cond_wait(&io->read_sched, &io->io_mutex);
+		io_park(io, &io->read_sched_parked, &io->read_sched, &worker->limit, done_index);
 	}
+
+	/* get the new working task, marking the previous one as completed */
+	thread_store(&worker->index, (done_index + 1) % io->io_max);
+
+	/* notify the IO that a new read is complete */
+	io_wake(io, &io->read_done_parked, &io->read_done);
+
+	/* return the new task */
+	return &worker->task_map[worker->index];
 }
 
 /**
  * Get the next task to work on for a writer.
  *
  * This is the synchronization point for workers with the io.
+ *
+ * Like for the readers, the IO publishes in ::writer_index the first task
+ * not yet ready, and the writer publishes in ::index the task in progress.
  */
 static struct snapraid_task* io_writer_step(struct snapraid_worker* worker, int state)
 {
 	struct snapraid_io* io = worker->io;
 	int error_index;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
+	/* the index that worker just completed */
+	unsigned done_index = worker->index;
+
+	/* the next pending task */
+	unsigned next_index = (done_index + 1) % io->io_max;
 
 	/* counts the number of errors in the global state */
 	error_index = state - IO_WRITER_ERROR_BASE;
 	if (error_index >= 0 && error_index < IO_WRITER_ERROR_MAX)
-		++io->writer_error[error_index];
+		thread_fetch_add(&io->writer_error[error_index], 1);
 
 	while (1) {
-		unsigned next_index;
-
-		/* get the next pending task */
-		next_index = (worker->index + 1) % io->io_max;
-
 		/* if the queue of pending tasks is not empty */
-		if (next_index != io->writer_index) {
-			struct snapraid_task* task;
-
-			/* the index that the IO may be waiting for */
-			unsigned waiting_index = (io->writer_index + 1) % io->io_max;
-
-			/* the index that worker just completed */
-			unsigned done_index = worker->index;
-
-			/* get the new working task */
-			worker->index = next_index;
-			task = &worker->task_map[worker->index];
-
-			/* if the just completed task is at this index */
-			if (done_index == waiting_index) {
-				/* notify the IO that a new write is complete */
-				thread_cond_signal_and_unlock(&io->write_done, &io->io_mutex);
-			} else {
-				thread_mutex_unlock(&io->io_mutex);
-			}
-
-			/* return the new task */
-			return task;
-		}
+		if (thread_load(&io->writer_index) != next_index)
+			break;
 
 		/* check if the worker has to exit */
 		/* but only if there is no work to do */
-		if (io->done) {
-			thread_mutex_unlock(&io->io_mutex);
+		if (thread_load(&io->done))
 			return 0;
-		}
 
 		/* otherwise wait for a write_sched event */
-		thread_cond_wait(&io->write_sched, &io->io_mutex);
+		io_park(io, &io->write_sched_parked, &io->write_sched, &io->writer_index, next_index);
 	}
+
+	/* get the new working task, marking the previous one as completed */
+	thread_store(&worker->index, next_index);
+
+	/* notify the IO that a new write is complete */
+	io_wake(io, &io->write_done_parked, &io->write_done);
+
+	/* return the new task */
+	return &worker->task_map[next_index];
 }
 
 /**
@@ -417,15 +698,25 @@ static block_off_t io_read_next_thread(struct snapraid_io* io, void*** buffer)
 	for (i = 0; i <= io->reader_max; ++i)
 		io->reader_list[i] = i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
+	/* the buffers of the position just processed return in the pool */
+	io_buffer_release(io, io->reader_index);
 
 	/* schedule the next read */
+	/* no reader can access it, as it's after their limit */
 	io_reader_sched(io, io->reader_index, blockcur_schedule);
 
 	/* set the index for the tasks to return to the caller */
 	io->reader_index = (io->reader_index + 1) % io->io_max;
 
+	/* periodically adapt the read-ahead depth of the readers */
+	if (++io->balance_count >= io->io_max) {
+		io->balance_count = 0;
+		io_balance(io);
+	}
+
+	/* allow the readers to process the new tasks */
+	io_reader_extend(io);
+
 	/* get the position to operate at high level from one task */
 	blockcur_caller = io->reader_map[0].task_map[io->reader_index].position;
 
@@ -433,7 +724,7 @@ static block_off_t io_read_next_thread(struct snapraid_io* io, void*** buffer)
 	*buffer = io->buffer_map[io->reader_index];
 
 	/* signal all the workers that there is a new pending task */
-	thread_cond_broadcast_and_unlock(&io->read_sched, &io->io_mutex);
+	io_wake(io, &io->read_sched_parked, &io->read_sched);
 
 	return blockcur_caller;
 }
@@ -456,14 +747,9 @@ static void io_write_next_thread(struct snapraid_io* io, block_off_t blockcur, i
 	for (i = 0; i <= io->writer_max; ++i)
 		io->writer_list[i] = i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	/* report errors */
-	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i) {
-		writer_error[i] = io->writer_error[i];
-		io->writer_error[i] = 0;
-	}
+	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i)
+		writer_error[i] = thread_exchange(&io->writer_error[i], 0);
 
 	if (skip) {
 		/* skip the next write */
@@ -477,19 +763,16 @@ static void io_write_next_thread(struct snapraid_io* io, block_off_t blockcur, i
 	assert(io->writer_index == io->reader_index);
 
 	/* set the index to be used for the next write */
-	io->writer_index = (io->writer_index + 1) % io->io_max;
+	thread_store(&io->writer_index, (io->writer_index + 1) % io->io_max);
 
 	/* signal all the workers that there is a new pending task */
-	thread_cond_broadcast_and_unlock(&io->write_sched, &io->io_mutex);
+	io_wake(io, &io->write_sched_parked, &io->write_sched);
 }
 
 static void io_refresh_thread(struct snapraid_io* io)
 {
 	unsigned i;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	/* for all readers, count the number of read blocks */
 	for (i = 0; i < io->reader_max; ++i) {
 		unsigned begin, end, cached;
@@ -498,7 +781,7 @@ static void io_refresh_thread(struct snapraid_io* io)
 		/* the first block read */
 		begin = io->reader_index + 1;
 		/* the block in reading */
-		end = worker->index;
+		end = thread_load(&worker->index);
 		if (begin > end)
 			end += io->io_max;
 		cached = end - begin;
@@ -518,13 +801,54 @@ static void io_refresh_thread(struct snapraid_io* io)
 		/* the first block written */
 		begin = io->writer_index + 1;
 		/* the block in writing */
-		end = worker->index;
+		end = thread_load(&worker->index);
 		if (begin > end)
 			end += io->io_max;
 		cached = end - begin;
 
 		io->state->parity[worker->parity_handle->level].cached_blocks = cached;
 	}
+}
+
+/**
+ * Get a worker that has finished the specified index.
+ *
+ * Return the pointer at the worker in the list, or 0 if none.
+ */
+static unsigned char* io_task_find(struct snapraid_worker* worker_map, unsigned char* list, unsigned end, unsigned base, unsigned count, unsigned busy_index)
+{
+	unsigned char* let;
+
+	let = &list[0];
+	while (1) {
+		unsigned i = *let;
+
+		/* if we are at the end */
+		if (i == end)
+			return 0;
+
+		/* if it's in range and the worker has finished this index */
+		if (base <= i && i < base + count && thread_load(&worker_map[i].index) != busy_index)
+			return let;
+
+		/* next position to check */
+		let = &list[i + 1];
+	}
+}
+
+/**
+ * Wait until a worker finishes the specified index.
+ */
+static void io_task_wait(struct snapraid_io* io, struct snapraid_worker* worker_map, unsigned char* list, unsigned end, unsigned base, unsigned count, unsigned busy_index, unsigned* parked, thread_cond_t* cond)
+{
+	thread_mutex_lock(&io->io_mutex);
+
+	thread_fetch_add(parked, 1);
+
+	while (io_task_find(worker_map, list, end, base, count, busy_index) == 0)
+		thread_cond_wait(cond, &io->io_mutex);
+
+	thread_fetch_sub(parked, 1);
 
 	thread_mutex_unlock(&io->io_mutex);
 }
@@ -539,9 +863,6 @@ static struct snapraid_task* io_task_read_thread(struct snapraid_io* io, unsigne
 	/* clear the waiting indexes */
 	*waiting_mac = 0;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	while (1) {
 		unsigned char* let;
 		unsigned busy_index;
@@ -551,56 +872,46 @@ static struct snapraid_task* io_task_read_thread(struct snapraid_io* io, unsigne
 		/* to avoid a concurrent access */
 		busy_index = io->reader_index;
 
-		/* search for a worker that has already finished */
-		let = &io->reader_list[0];
-		while (1) {
-			unsigned i = *let;
-
-			/* if we are at the end */
-			if (i == io->reader_max)
-				break;
-
-			/* if it's in range */
-			if (base <= i && i < base + count) {
-				struct snapraid_worker* worker;
-
-				/* if it's the first cycle */
-				if (waiting_cycle == 0) {
-					/* store the waiting indexes */
+		/* if it's the first cycle */
+		if (waiting_cycle == 0) {
+			/* store the waiting indexes */
+			let = &io->reader_list[0];
+			while (*let != io->reader_max) {
+				unsigned i = *let;
+				if (base <= i && i < base + count)
 					waiting_map[(*waiting_mac)++] = i - base;
-				}
-
-				worker = &io->reader_map[i];
-
-				/* if the worker has finished this index */
-				if (busy_index != worker->index) {
-					struct snapraid_task* task;
-
-					task = &worker->task_map[io->reader_index];
+				let = &io->reader_list[i + 1];
+			}
+		}
 
-					thread_mutex_unlock(&io->io_mutex);
+		/* search for a worker that has already finished */
+		let = io_task_find(io->reader_map, io->reader_list, io->reader_max, base, count, busy_index);
+		if (let) {
+			unsigned i = *let;
 
-					/* mark the worker as processed */
-					/* setting the previous one to point at the next one */
-					*let = io->reader_list[i + 1];
+			/* mark the worker as processed */
+			/* setting the previous one to point at the next one */
+			*let = io->reader_list[i + 1];
 
-					/* return the position */
-					*pos = i - base;
+			/* return the position */
+			*pos = i - base;
 
-					/* on the first cycle, no one is waiting */
-					if (waiting_cycle == 0)
-						*waiting_mac = 0;
+			/* on the first cycle, no one is waiting */
+			if (waiting_cycle == 0)
+				*waiting_mac = 0;
 
-					return task;
-				}
-			}
+			return &io->reader_map[i].task_map[busy_index];
+		}
 
-			/* next position to check */
-			let = &io->reader_list[i + 1];
+		/* if it's the first cycle, account the wait to all the pending workers */
+		if (waiting_cycle == 0) {
+			unsigned k;
+			for (k = 0; k < *waiting_mac; ++k)
+				++io->reader_map[base + waiting_map[k]].waited;
 		}
 
 		/* if no worker is ready, wait for an event */
-		thread_cond_wait(&io->read_done, &io->io_mutex);
+		io_task_wait(io, io->reader_map, io->reader_list, io->reader_max, base, count, busy_index, &io->read_done_parked, &io->read_done);
 
 		/* count the cycles */
 		++waiting_cycle;
@@ -627,9 +938,6 @@ static void io_parity_write_thread(struct snapraid_io* io, unsigned* pos, unsign
 	/* clear the waiting indexes */
 	*waiting_mac = 0;
 
-	/* the synchronization is protected by the io mutex */
-	thread_mutex_lock(&io->io_mutex);
-
 	while (1) {
 		unsigned char* let;
 		unsigned busy_index;
@@ -641,51 +949,38 @@ static void io_parity_write_thread(struct snapraid_io* io, unsigned* pos, unsign
 		/* at the index the IO is using at now */
 		busy_index = (io->writer_index + 1) % io->io_max;
 
-		/* search for a worker that has already finished */
-		let = &io->writer_list[0];
-		while (1) {
-			unsigned i = *let;
-			struct snapraid_worker* worker;
-
-			/* if we are at the end */
-			if (i == io->writer_max)
-				break;
-
-			/* if it's the first cycle */
-			if (waiting_cycle == 0) {
-				/* store the waiting indexes */
+		/* if it's the first cycle */
+		if (waiting_cycle == 0) {
+			/* store the waiting indexes */
+			let = &io->writer_list[0];
+			while (*let != io->writer_max) {
+				unsigned i = *let;
 				waiting_map[(*waiting_mac)++] = i;
+				let = &io->writer_list[i + 1];
 			}
+		}
 
-			worker = &io->writer_map[i];
-
-			/* the two indexes cannot be equal */
-			assert(io->writer_index != worker->index);
-
-			/* if the worker has finished this index */
-			if (busy_index != worker->index) {
-				thread_mutex_unlock(&io->io_mutex);
-
-				/* mark the worker as processed */
-				/* setting the previous one to point at the next one */
-				*let = io->writer_list[i + 1];
+		/* search for a worker that has already finished */
+		let = io_task_find(io->writer_map, io->writer_list, io->writer_max, 0, io->writer_max, busy_index);
+		if (let) {
+			unsigned i = *let;
 
-				/* return the position */
-				*pos = i;
+			/* mark the worker as processed */
+			/* setting the previous one to point at the next one */
+			*let = io->writer_list[i + 1];
 
-				/* on the first cycle, no one is waiting */
-				if (waiting_cycle == 0)
-					*waiting_mac = 0;
+			/* return the position */
+			*pos = i;
 
-				return;
-			}
+			/* on the first cycle, no one is waiting */
+			if (waiting_cycle == 0)
+				*waiting_mac = 0;
 
-			/* next position to check */
-			let = &io->writer_list[i + 1];
+			return;
 		}
 
 		/* if no worker is ready, wait for an event */
-		thread_cond_wait(&io->write_done, &io->io_mutex);
+		io_task_wait(io, io->writer_map, io->writer_list, io->writer_max, 0, io->writer_max, busy_index, &io->write_done_parked, &io->write_done);
 
 		/* count the cycles */
 		++waiting_cycle;
@@ -695,11 +990,29 @@ static void io_parity_write_thread(struct snapraid_io* io, unsigned* pos, unsign
 static void io_reader_worker(struct snapraid_worker* worker, struct snapraid_task* task)
 {
 	/* if we reached the end */
-	if (task->position >= worker->io->block_max) {
+	struct snapraid_io* io = worker->io;
+
+	/* if we reached the end */
+	if (task->position >= io->block_max) {
 		/* complete a dummy task */
 		task->state = TASK_STATE_EMPTY;
 	} else {
+		uint64_t start = tick();
+
 		worker->func(worker, task);
+
+		io_access(worker, task, "read", start);
+
+		if (io->rate_limit != 0) {
+			unsigned wait;
+
+			thread_mutex_lock(&io->io_mutex);
+			wait = io_rate_account(io, worker, task);
+			thread_mutex_unlock(&io->io_mutex);
+
+			if (wait != 0)
+				sleep_ms(wait);
+		}
 	}
 }
 
@@ -707,6 +1020,10 @@ static void* io_reader_thread(void* arg)
 {
 	struct snapraid_worker* worker = arg;
 
+	/* run near the controller of the disk, or in all the processors */
+	if (worker->io->state->affinity)
+		cpu_bind_node(worker->node);
+
 	/* force completion of the first task */
 	io_reader_worker(worker, &worker->task_map[0]);
 
@@ -737,6 +1054,11 @@ static void* io_writer_thread(void* arg)
 {
 	struct snapraid_worker* worker = arg;
 	int latest_state = TASK_STATE_DONE;
+	uint64_t start;
+
+	/* run near the controller of the disk, or in all the processors */
+	if (worker->io->state->affinity)
+		cpu_bind_node(worker->node);
 
 	while (1) {
 		struct snapraid_task* task;
@@ -757,7 +1079,9 @@ static void* io_writer_thread(void* arg)
 		assert(task->state == TASK_STATE_READY);
 
 		/* work on the assigned task */
+		start = tick();
 		worker->func(worker, task);
+		io_access(worker, task, "write", start);
 
 		/* save the resulting state */
 		latest_state = task->state;
@@ -784,14 +1108,34 @@ static void io_start_thread(struct snapraid_io* io,
 	io->block_enabled = block_enabled;
 	io->block_next = blockstart;
 
+	io->rate_start = tick_ms();
+	io->rate_size = 0;
+
 	io->done = 0;
 	io->reader_index = io->io_max - 1;
 	io->writer_index = 0;
+	io->read_sched_parked = 0;
+	io->read_done_parked = 0;
+	io->write_sched_parked = 0;
+	io->write_done_parked = 0;
 
 	/* clear writer errors */
 	for (i = 0; i < IO_WRITER_ERROR_MAX; ++i)
 		io->writer_error[i] = 0;
 
+	/* all the buffers of the readers are in the pool */
+	for (i = 0; i < io->io_max; ++i) {
+		unsigned k;
+		for (k = 0; k < io->reader_max; ++k) {
+			struct snapraid_worker* worker = &io->reader_map[k];
+			io->buffer_map[i][worker->buffer_skew + k] = 0;
+		}
+	}
+	for (i = 0; i < io->pool_max; ++i)
+		io->pool_free[i] = io->pool_map[i];
+	io->pool_count = io->pool_max;
+	io->balance_count = 0;
+
 	/* setup the initial read pending tasks, except the latest one, */
 	/* the latest will be initialized at the fist io_read_next() call */
 	for (i = 0; i < io->io_max - 1; ++i) {
@@ -805,11 +1149,29 @@ static void io_start_thread(struct snapraid_io* io,
 	for (i = 0; i <= io->writer_max; ++i)
 		io->writer_list[i] = i;
 
-	/* start the reader threads */
+	/* setup the readers */
 	for (i = 0; i < io->reader_max; ++i) {
 		struct snapraid_worker* worker = &io->reader_map[i];
 
+		/* the first task is forced */
 		worker->index = 0;
+		worker->limit = 0;
+		io_buffer_take(io, worker, 0);
+
+		/* start with the same depth for all, the pool has one more buffer each */
+		worker->depth = io->pool_max / io->reader_max - 1;
+		if (worker->depth > io->io_depth)
+			worker->depth = io->io_depth;
+		worker->waited = 0;
+		worker->score = 0;
+	}
+
+	/* allow the readers to read ahead */
+	io_reader_extend(io);
+
+	/* start the reader threads */
+	for (i = 0; i < io->reader_max; ++i) {
+		struct snapraid_worker* worker = &io->reader_map[i];
 
 		thread_create(&worker->thread, io_reader_thread, worker);
 	}
@@ -828,10 +1190,11 @@ static void io_stop_thread(struct snapraid_io* io)
 {
 	unsigned i;
 
-	thread_mutex_lock(&io->io_mutex);
-
 	/* mark that we are stopping */
-	io->done = 1;
+	thread_store(&io->done, 1);
+
+	/* the threads check the state with the mutex before waiting */
+	thread_mutex_lock(&io->io_mutex);
 
 	/* signal all the threads to recognize the new state */
 	thread_cond_broadcast(&io->read_sched);
@@ -863,6 +1226,180 @@ static void io_stop_thread(struct snapraid_io* io)
 /*****************************************************************************/
 /* global */
 
+/**
+ * Name of the disk of a worker.
+ */
+static const char* io_worker_name(struct snapraid_worker* worker)
+{
+	if (worker->handle)
+		return worker->handle->disk->name;
+	else
+		return lev_config_name(worker->parity_handle->level);
+}
+
+/**
+ * Allocate the events to trace for the thread of a worker.
+ */
+static struct snapraid_trace* io_trace(struct snapraid_worker* worker, const char* ope)
+{
+	char name[PATH_MAX + 32];
+
+	snprintf(name, sizeof(name), "%s %s", ope, io_worker_name(worker));
+
+	return trace_thread(name);
+}
+
+/**
+ * Set the NUMA node of the workers from the controller of their disk.
+ *
+ * The IO thread, that allocates and touches first the buffers, is bound
+ * to the node with more workers, so the memory is allocated there.
+ */
+static void io_affinity(struct snapraid_io* io, struct snapraid_worker* worker_map, unsigned worker_max)
+{
+	struct snapraid_state* state = io->state;
+	unsigned i;
+
+	for (i = 0; i < worker_max; ++i) {
+		struct snapraid_worker* worker = &worker_map[i];
+		uint64_t device;
+
+		if (worker->handle)
+			device = worker->handle->disk->device;
+		else
+			device = state->parity[worker->parity_handle->level].split_map[0].device;
+
+		worker->node = devnode(device);
+
+		log_tag("affinity:%s:%d\n", io_worker_name(worker), worker->node);
+	}
+}
+
+/**
+ * Bind the IO thread to the NUMA node used by more workers.
+ *
+ * The binding is only to allocate the buffers, and it's removed
+ * by io_affinity_main_done().
+ *
+ * Return 1 if bound.
+ */
+static int io_affinity_main(struct snapraid_io* io)
+{
+	int best_node = -1;
+	unsigned best_count = 0;
+	unsigned i, j;
+
+	for (i = 0; i < io->reader_max + io->writer_max; ++i) {
+		struct snapraid_worker* worker = i < io->reader_max ? &io->reader_map[i] : &io->writer_map[i - io->reader_max];
+		unsigned count = 0;
+
+		if (worker->node < 0)
+			continue;
+
+		for (j = 0; j < io->reader_max + io->writer_max; ++j) {
+			struct snapraid_worker* other = j < io->reader_max ? &io->reader_map[j] : &io->writer_map[j - io->reader_max];
+			if (other->node == worker->node)
+				++count;
+		}
+
+		if (count > best_count) {
+			best_node = worker->node;
+			best_count = count;
+		}
+	}
+
+	if (best_node < 0) {
+		log_tag("affinity:main:-1\n");
+		return 0;
+	}
+
+	if (cpu_bind_node(best_node) != 0) {
+		/* LCOV_EXCL_START */
+		log_tag("affinity:main:-1\n");
+		return 0;
+		/* LCOV_EXCL_STOP */
+	}
+
+	log_tag("affinity:main:%d\n", best_node);
+
+	return 1;
+}
+
+/**
+ * Remove the binding of the IO thread, after the buffers are allocated.
+ *
+ * Otherwise all the threads created later inherit it, like the ones
+ * computing the hash and the parity.
+ */
+static void io_affinity_main_done(void)
+{
+	if (cpu_bind_node(-1) != 0) {
+		/* LCOV_EXCL_START */
+		log_tag("affinity:main:bound\n");
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	log_tag("affinity:main:done\n");
+}
+
+/**
+ * Allocate a vector of buffers for the IO.
+ *
+ * All the buffers are in a single allocation using huge pages,
+ * to reduce the TLB misses when hashing and computing the parity.
+ */
+static void** io_buffer_alloc(struct snapraid_io* io, unsigned n, void** alloc)
+{
+	struct snapraid_state* state = io->state;
+	void** map;
+	unsigned i;
+
+	if (state->file_mode != ADVISE_DIRECT)
+		map = malloc_nofail_vector_huge_align(0, n, state->block_size, alloc);
+	else
+		map = malloc_nofail_vector_huge_direct(0, n, state->block_size, alloc);
+	if (!state->opt.skip_self) {
+		mtest_vector(n, state->block_size, map);
+	} else if (state->affinity) {
+		/* touch the memory to allocate it in the node of the thread */
+		for (i = 0; i < n; ++i)
+			memset(map[i], 0, state->block_size);
+	}
+
+	return map;
+}
+
+/**
+ * Number of buffers in the pool of the readers for the specified cache.
+ */
+static unsigned io_pool_max(struct snapraid_io* io, unsigned io_max)
+{
+	unsigned depth;
+
+	/* in mono thread mode there is only one block read at time */
+	if (io_max == 1)
+		return io->reader_max;
+
+	/* on average the readers can read ahead half of the ring, */
+	/* but the ones making the IO wait get more */
+	depth = (io_max - 1) / 2;
+	if (depth < IO_DEPTH_MIN)
+		depth = IO_DEPTH_MIN;
+
+	return io->reader_max * (depth + 1);
+}
+
+/**
+ * Memory used by the buffers for the specified cache.
+ */
+static uint64_t io_memory(struct snapraid_io* io, unsigned io_max)
+{
+	unsigned other_max = io->buffer_max - io->reader_max;
+
+	return (uint64_t)io->state->block_size * (io_pool_max(io, io_max) + io_max * other_max);
+}
+
 void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	unsigned io_cache, unsigned buffer_max,
 	void (*data_reader)(struct snapraid_worker*, struct snapraid_task*),
@@ -873,7 +1410,11 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 {
 	unsigned i;
 	size_t allocated_size;
-	size_t block_size = state->block_size;
+	unsigned char* reader_mask;
+	uint64_t available;
+	unsigned other_max;
+	unsigned other;
+	int is_bound;
 
 	io->state = state;
 
@@ -896,22 +1437,6 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	io->io_max = 1;
 #endif
 
-	assert(io->io_max == 1 || (io->io_max >= IO_MIN && io->io_max <= IO_MAX));
-
-	io->buffer_max = buffer_max;
-	allocated_size = 0;
-	for (i = 0; i < io->io_max; ++i) {
-		if (state->file_mode != ADVISE_DIRECT)
-			io->buffer_map[i] = malloc_nofail_vector_align(handle_max, buffer_max, block_size, &io->buffer_alloc_map[i]);
-		else
-			io->buffer_map[i] = malloc_nofail_vector_direct(handle_max, buffer_max, block_size, &io->buffer_alloc_map[i]);
-		if (!state->opt.skip_self)
-			mtest_vector(io->buffer_max, state->block_size, io->buffer_map[i]);
-		allocated_size += block_size * buffer_max;
-	}
-
-	msg_progress("Using %u MiB of memory for %u cached blocks.\n", (unsigned)(allocated_size / MEBI), io->io_max);
-
 	if (parity_writer) {
 		io->reader_max = handle_max;
 		io->writer_max = parity_handle_max;
@@ -968,6 +1493,114 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 		worker->buffer_skew = handle_max;
 	}
 
+	/* by default the threads run where the system decides */
+	for (i = 0; i < io->reader_max; ++i)
+		io->reader_map[i].node = -1;
+	for (i = 0; i < io->writer_max; ++i)
+		io->writer_map[i].node = -1;
+
+	/* in thread mode each worker records its events, */
+	/* allocated before the memory limit check to be counted */
+	for (i = 0; i < io->reader_max; ++i)
+		io->reader_map[i].trace = trace_main;
+	for (i = 0; i < io->writer_max; ++i)
+		io->writer_map[i].trace = trace_main;
+	if (trace_enabled && io->io_max > 1) {
+		for (i = 0; i < io->reader_max; ++i)
+			io->reader_map[i].trace = io_trace(&io->reader_map[i], "read");
+		for (i = 0; i < io->writer_max; ++i)
+			io->writer_map[i].trace = io_trace(&io->writer_map[i], "write");
+	}
+
+	/* run the threads near the controllers, allocating the buffers there */
+	is_bound = 0;
+	if (state->affinity) {
+		io_affinity(io, io->reader_map, io->reader_max);
+		io_affinity(io, io->writer_map, io->writer_max);
+		is_bound = io_affinity_main(io);
+	}
+
+	io->buffer_max = buffer_max;
+
+	/* reduce the cache to stay in the memory limit */
+	available = state_memory_available(state);
+	if (io->io_max > 1 && io_memory(io, io->io_max) > available) {
+		unsigned io_max = io->io_max;
+
+		while (io->io_max > IO_MIN && io_memory(io, io->io_max) > available)
+			--io->io_max;
+
+		/* if not enough, fall back to the mono thread mode */
+		if (io_memory(io, io->io_max) > available)
+			io->io_max = 1;
+
+		log_tag("memory:cache:%u:%u\n", io_max, io->io_max);
+		msg_progress("Reducing the cache from %u to %u blocks for the memory limit.\n", io_max, io->io_max);
+	}
+
+	assert(io->io_max == 1 || (io->io_max >= IO_MIN && io->io_max <= IO_MAX));
+
+	/* in mono thread mode the workers run in the main thread */
+	if (io->io_max == 1) {
+		for (i = 0; i < io->reader_max; ++i)
+			io->reader_map[i].trace = trace_main;
+		for (i = 0; i < io->writer_max; ++i)
+			io->writer_map[i].trace = trace_main;
+	}
+
+	/* by default no limits */
+	io->io_depth = io->io_max - 1;
+	io->rate_limit = 0;
+
+	allocated_size = io_memory(io, io->io_max);
+
+	/* fail early if even the minimal cache doesn't fit */
+	state_memory_check(state, "the block buffers", allocated_size);
+
+	/* the buffers of the readers are taken from a shared pool */
+	io->pool_max = io_pool_max(io, io->io_max);
+	other_max = buffer_max - io->reader_max;
+
+	/* the pool is at the start, followed by the other buffers */
+	io->pool_map = io_buffer_alloc(io, io->pool_max + io->io_max * other_max, &io->buffer_alloc);
+
+	/* the buffers are now in the node, so don't bind the threads created later */
+	if (is_bound)
+		io_affinity_main_done();
+	io->pool_free = malloc_nofail(sizeof(void*) * io->pool_max);
+	io->pool_count = 0;
+
+	/* mark the buffers of the readers */
+	reader_mask = malloc_nofail(buffer_max);
+	memset(reader_mask, 0, buffer_max);
+	for (i = 0; i < io->reader_max; ++i)
+		reader_mask[io->reader_map[i].buffer_skew + i] = 1;
+
+	/* the other buffers are fixed in each position */
+	other = io->pool_max;
+	for (i = 0; i < io->io_max; ++i) {
+		unsigned k;
+
+		/* the buffers of the readers are set later from the pool */
+		io->buffer_map[i] = malloc_nofail(sizeof(void*) * buffer_max);
+		for (k = 0; k < buffer_max; ++k) {
+			if (reader_mask[k])
+				io->buffer_map[i][k] = 0;
+			else
+				io->buffer_map[i][k] = io->pool_map[other++];
+		}
+	}
+
+	free(reader_mask);
+
+	/* in mono thread mode the buffers of the readers never change */
+	if (io->io_max == 1) {
+		for (i = 0; i < io->reader_max; ++i)
+			io->buffer_map[0][io->reader_map[i].buffer_skew + i] = io->pool_map[i];
+	}
+
+	msg_progress("Using %u MiB of memory for %u cached blocks.\n", (unsigned)(allocated_size / MEBI), io->io_max);
+
 #if HAVE_THREAD
 	if (io->io_max > 1) {
 		io_read_next = io_read_next_thread;
@@ -1000,14 +1633,26 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	}
 }
 
+void io_limit(struct snapraid_io* io, uint64_t rate_limit, unsigned io_depth)
+{
+	io->rate_limit = rate_limit;
+
+	if (io_depth != 0 && io_depth < io->io_max - 1)
+		io->io_depth = io_depth;
+	else
+		io->io_depth = io->io_max - 1;
+}
+
 void io_done(struct snapraid_io* io)
 {
 	unsigned i;
 
-	for (i = 0; i < io->io_max; ++i) {
+	for (i = 0; i < io->io_max; ++i)
 		free(io->buffer_map[i]);
-		free(io->buffer_alloc_map[i]);
-	}
+
+	free(io->pool_map);
+	free(io->pool_free);
+	free_huge(io->buffer_alloc);
 
 	free(io->reader_map);
 	free(io->reader_list);
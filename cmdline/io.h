@@ -22,6 +22,7 @@
 #include "support.h"
 #include "handle.h"
 #include "parity.h"
+#include "trace.h"
 
 /**
  * Number of read-ahead buffers.
@@ -42,6 +43,14 @@
 #define IO_MIN 3 /* required by writers, readers can work also with 2 */
 #define IO_MAX 128
 
+/**
+ * Min average read-ahead depth of the readers.
+ *
+ * The buffers of the readers are enough to read ahead on average half
+ * of the ring, but not less than this value.
+ */
+#define IO_DEPTH_MIN 2
+
 /**
  * State of the task.
  */
@@ -114,13 +123,46 @@ struct snapraid_worker {
 	 * The task in progress by the worker thread.
 	 *
 	 * It's an index inside in the ::task_map vector.
+	 * Written only by the worker thread, and read atomically by the IO.
 	 */
 	unsigned index;
 
+	/**
+	 * The latest task that the reader is allowed to process.
+	 *
+	 * It's an index inside in the ::task_map vector.
+	 * Written only by the IO, and read atomically by the worker thread.
+	 * Not used by writers.
+	 */
+	unsigned limit;
+
 	/**
 	 * Which buffer base index should be used for destination.
 	 */
 	unsigned buffer_skew;
+
+	/**
+	 * NUMA node where to run the worker thread.
+	 *
+	 * It's the node of the controller of the disk, or -1 if not bound.
+	 */
+	int node;
+
+	/**
+	 * Events traced for the thread of the worker.
+	 *
+	 * In mono thread mode it's the one of the main thread.
+	 */
+	struct snapraid_trace* trace;
+
+	/**
+	 * Max number of blocks that this reader can read ahead.
+	 *
+	 * Between 1 and ::io_depth, and adapted to the waits of the IO.
+	 */
+	unsigned depth;
+	unsigned waited; /**< Number of times the IO waited for this reader since the last balance. */
+	unsigned score; /**< Decaying sum of the waits, used to assign the depth. */
 };
 
 /**
@@ -147,13 +189,42 @@ struct snapraid_io {
 	 */
 	unsigned io_max;
 
+	/**
+	 * Max number of blocks that each reader can read ahead.
+	 *
+	 * Between 1 and ::io_max - 1. Not used in mono thread mode.
+	 * It's the upper limit of the depth of each reader.
+	 */
+	unsigned io_depth;
+
+	/**
+	 * Read rate limit in bytes per second. 0 for no limit.
+	 */
+	uint64_t rate_limit;
+	uint64_t rate_start; /**< Time in ms of the start of the rate measure. */
+	uint64_t rate_size; /**< Bytes read from the start of the rate measure. */
+
 #if HAVE_THREAD
 	/**
 	 * Mutex used to protect the synchronization
 	 * between the io and the workers.
+	 *
+	 * The tasks are exchanged without it, using atomic indexes.
+	 * It's used only to wait on the conditions, when a worker
+	 * has nothing to do, or the IO has to wait a worker.
 	 */
 	thread_mutex_t io_mutex;
 
+	/**
+	 * Number of threads waiting on each condition.
+	 *
+	 * If zero, the condition is not signaled.
+	 */
+	unsigned read_done_parked;
+	unsigned read_sched_parked;
+	unsigned write_done_parked;
+	unsigned write_sched_parked;
+
 	/**
 	 * Condition for a new read is completed.
 	 *
@@ -225,9 +296,26 @@ struct snapraid_io {
 	 * A pool of buffers used to store the data read.
 	 */
 	unsigned buffer_max; /**< Number of buffers. */
-	void* buffer_alloc_map[IO_MAX]; /**< Allocation map for buffers. */
+	void* buffer_alloc; /**< Allocation of all the buffers, including the pool. */
 	void** buffer_map[IO_MAX]; /**< Buffers for data. */
 
+	/**
+	 * Pool of buffers for the readers.
+	 *
+	 * The buffers of the readers in ::buffer_map are not fixed, but taken
+	 * from this pool when a reader starts a task, and returned when the IO
+	 * moves to the next position.
+	 *
+	 * The sum of the depth of the readers, plus one each, is never more than
+	 * ::pool_max. This ensures that a reader allowed to read ahead always
+	 * finds a free buffer.
+	 */
+	unsigned pool_max; /**< Number of buffers in the pool. */
+	unsigned pool_count; /**< Number of free buffers in the pool. */
+	void** pool_map; /**< All the buffers of the pool, followed by the other ones. */
+	void** pool_free; /**< Stack of free buffers. */
+	unsigned balance_count; /**< Positions processed since the last balance of the depths. */
+
 	/**
 	 * Workers.
 	 *
@@ -254,7 +342,7 @@ struct snapraid_io {
 	/**
 	 * Exit condition for all threads.
 	 */
-	int done;
+	unsigned done;
 
 	/**
 	 * The task currently used by the caller.
@@ -263,7 +351,8 @@ struct snapraid_io {
 	 * it goes again to 0.
 	 *
 	 * When the caller finish with the current index,
-	 * it's incremented, and a read_sched() signal is sent.
+	 * it's incremented, the ::limit of the readers is extended,
+	 * and a read_sched() signal is sent.
 	 *
 	 * In monothread mode it isn't the task index,
 	 * but the worker index.
@@ -304,6 +393,16 @@ void io_init(struct snapraid_io* io, struct snapraid_state* state,
 	void (*parity_writer)(struct snapraid_worker*, struct snapraid_task*),
 	struct snapraid_parity_handle* parity_handle_map, unsigned parity_handle_max);
 
+/**
+ * Limit the reads of the InputOutput workers.
+ *
+ * It must be called before io_start().
+ *
+ * \param rate_limit The max read rate in bytes per second for all the disks together. 0 for no limit.
+ * \param io_depth The max number of blocks read ahead for each disk. 0 for no limit.
+ */
+void io_limit(struct snapraid_io* io, uint64_t rate_limit, unsigned io_depth);
+
 /**
  * Deinitialize the InputOutput workers.
  */
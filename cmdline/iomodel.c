@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "support.h"
+#include "util.h"
+#include "elem.h"
+#include "state.h"
+#include "stream.h"
+#include "iomodel.h"
+
+/****************************************************************************/
+/* iomodel */
+
+/**
+ * Max queue depth of a disk.
+ */
+#define IOMODEL_QUEUE_MAX 32
+
+/**
+ * Parameter not specified, taken from the default.
+ */
+#define IOMODEL_UNSET ((uint64_t)-1)
+
+struct snapraid_iomodel {
+	int kind; /**< One of the IOMODEL_* kinds. */
+	char name[PATH_MAX]; /**< Name of the disk or of the parity level. */
+	uint64_t bandwidth; /**< Bytes per second. 0 for no limit. */
+	uint64_t seek; /**< Microseconds for a seek. */
+	uint64_t queue; /**< Number of accesses served at the same time. */
+
+	const void* stream; /**< Object of the last access. */
+	data_off_t end; /**< Offset after the last access. */
+	uint64_t slot_map[IOMODEL_QUEUE_MAX]; /**< Microseconds when each queue slot becomes free. */
+
+	uint64_t count; /**< Number of accesses. */
+	uint64_t seek_count; /**< Number of seeks. */
+	uint64_t size; /**< Bytes accessed. */
+	uint64_t busy; /**< Microseconds spent serving the accesses. */
+	tommy_node node;
+};
+
+int iomodel_enabled;
+
+static tommy_list iomodel_list; /**< All the disks of the model. */
+static struct snapraid_iomodel iomodel_default; /**< Parameters of the disks not listed. */
+static uint64_t iomodel_start; /**< Milliseconds at the start. */
+#if HAVE_THREAD
+static thread_mutex_t iomodel_mutex;
+#endif
+
+static struct snapraid_iomodel* iomodel_alloc(int kind, const char* name)
+{
+	struct snapraid_iomodel* model;
+
+	model = malloc_nofail(sizeof(struct snapraid_iomodel));
+	memset(model, 0, sizeof(struct snapraid_iomodel));
+	model->kind = kind;
+	pathcpy(model->name, sizeof(model->name), name);
+	model->bandwidth = IOMODEL_UNSET;
+	model->seek = IOMODEL_UNSET;
+	model->queue = IOMODEL_UNSET;
+	model->end = -1;
+
+	return model;
+}
+
+/**
+ * Read the parameters of a disk until the end of the line.
+ */
+static void iomodel_param(STREAM* f, struct snapraid_iomodel* model, const char* file, unsigned line)
+{
+	while (1) {
+		char key[64];
+		uint32_t value;
+		int ret;
+
+		sgetspace(f);
+
+		ret = sgettok(f, key, sizeof(key));
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Invalid parameter in '%s' at line %u\n", file, line);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		if (ret == 0)
+			break;
+
+		sgetspace(f);
+
+		ret = sgetu32(f, &value);
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Invalid '%s' value in '%s' at line %u\n", key, file, line);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (strcmp(key, "bandwidth") == 0) {
+			/* in MB/s */
+			model->bandwidth = value * (uint64_t)MEGA;
+		} else if (strcmp(key, "seek") == 0) {
+			/* in microseconds */
+			model->seek = value;
+		} else if (strcmp(key, "queue") == 0) {
+			if (value < 1 || value > IOMODEL_QUEUE_MAX) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'queue' value in '%s' at line %u. It must be between 1 and %u.\n", file, line, IOMODEL_QUEUE_MAX);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			model->queue = value;
+		} else {
+			/* LCOV_EXCL_START */
+			log_fatal("Invalid parameter '%s' in '%s' at line %u\n", key, file, line);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+}
+
+/**
+ * Take the parameters not specified from the default.
+ */
+static void iomodel_inherit(struct snapraid_iomodel* model)
+{
+	if (model->bandwidth == IOMODEL_UNSET)
+		model->bandwidth = iomodel_default.bandwidth;
+	if (model->seek == IOMODEL_UNSET)
+		model->seek = iomodel_default.seek;
+	if (model->queue == IOMODEL_UNSET)
+		model->queue = iomodel_default.queue;
+}
+
+void iomodel_open(const char* file)
+{
+	STREAM* f;
+	unsigned line;
+	tommy_node* i;
+
+	tommy_list_init(&iomodel_list);
+
+	/* without a default, the disks not listed have no delay */
+	memset(&iomodel_default, 0, sizeof(iomodel_default));
+	iomodel_default.bandwidth = IOMODEL_UNSET;
+	iomodel_default.seek = IOMODEL_UNSET;
+	iomodel_default.queue = IOMODEL_UNSET;
+
+	f = sopen_read(file);
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error opening the model file '%s'. %s.\n", file, strerror(errno));
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	line = 1;
+	while (1) {
+		char tag[PATH_MAX];
+		char name[PATH_MAX];
+		struct snapraid_iomodel* model;
+		int ret;
+		int c;
+
+		/* skip initial spaces */
+		sgetspace(f);
+
+		/* read the command */
+		ret = sgettok(f, tag, sizeof(tag));
+		if (ret < 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error reading the model file '%s' at line %u\n", file, line);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* skip spaces after the command */
+		sgetspace(f);
+
+		if (strcmp(tag, "disk") == 0 || strcmp(tag, "parity") == 0) {
+			ret = sgettok(f, name, sizeof(name));
+			if (ret <= 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Missing '%s' name in '%s' at line %u\n", tag, file, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			model = iomodel_alloc(strcmp(tag, "disk") == 0 ? IOMODEL_DISK : IOMODEL_PARITY, name);
+			tommy_list_insert_tail(&iomodel_list, &model->node, model);
+
+			iomodel_param(f, model, file, line);
+		} else if (strcmp(tag, "default") == 0) {
+			iomodel_param(f, &iomodel_default, file, line);
+		} else if (tag[0] == 0) {
+			/* allow empty lines */
+		} else if (tag[0] == '#') {
+			ret = sgetline(f, name, sizeof(name));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid comment in '%s' at line %u\n", file, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		} else {
+			/* LCOV_EXCL_START */
+			log_fatal("Invalid command '%s' in '%s' at line %u\n", tag, file, line);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* skip final spaces */
+		sgetspace(f);
+
+		/* next line */
+		c = sgeteol(f);
+		if (c == EOF) {
+			break;
+		}
+		if (c != '\n') {
+			/* LCOV_EXCL_START */
+			log_fatal("Extra data in '%s' at line %u\n", file, line);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+		++line;
+	}
+
+	if (serror(f)) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error reading the model file '%s' at line %u\n", file, line);
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	sclose(f);
+
+	/* the built-in default is a disk without delays */
+	if (iomodel_default.bandwidth == IOMODEL_UNSET)
+		iomodel_default.bandwidth = 0;
+	if (iomodel_default.seek == IOMODEL_UNSET)
+		iomodel_default.seek = 0;
+	if (iomodel_default.queue == IOMODEL_UNSET)
+		iomodel_default.queue = 1;
+
+	for (i = tommy_list_head(&iomodel_list); i != 0; i = i->next)
+		iomodel_inherit(i->data);
+
+#if HAVE_THREAD
+	thread_mutex_init(&iomodel_mutex);
+#endif
+
+	iomodel_start = tick_ms();
+	iomodel_enabled = 1;
+}
+
+void iomodel_close(void)
+{
+	tommy_node* i;
+
+	if (!iomodel_enabled)
+		return;
+
+	for (i = tommy_list_head(&iomodel_list); i != 0; i = i->next) {
+		struct snapraid_iomodel* model = i->data;
+
+		log_tag("iomodel:%s:%s:%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%" PRIu64 "\n",
+			model->kind == IOMODEL_DISK ? "disk" : "parity", model->name,
+			model->count, model->seek_count, model->size, model->busy / 1000);
+	}
+
+	tommy_list_foreach(&iomodel_list, free);
+	tommy_list_init(&iomodel_list);
+
+#if HAVE_THREAD
+	thread_mutex_destroy(&iomodel_mutex);
+#endif
+
+	iomodel_enabled = 0;
+}
+
+/**
+ * Find the disk in the model, adding it with the default parameters if missing.
+ */
+static struct snapraid_iomodel* iomodel_find(int kind, const char* name)
+{
+	struct snapraid_iomodel* model;
+	tommy_node* i;
+
+	for (i = tommy_list_head(&iomodel_list); i != 0; i = i->next) {
+		model = i->data;
+		if (model->kind == kind && strcmp(model->name, name) == 0)
+			return model;
+	}
+
+	model = iomodel_alloc(kind, name);
+	iomodel_inherit(model);
+	tommy_list_insert_tail(&iomodel_list, &model->node, model);
+
+	return model;
+}
+
+void iomodel_access_record(int kind, const char* name, const void* stream, data_off_t offset, unsigned size)
+{
+	struct snapraid_iomodel* model;
+	uint64_t now;
+	uint64_t start;
+	uint64_t service;
+	uint64_t due;
+	unsigned slot;
+	unsigned i;
+
+	/* microseconds from the start, clamped at 0 if the clock went back */
+	now = tick_ms();
+	if (now > iomodel_start)
+		now = (now - iomodel_start) * 1000;
+	else
+		now = 0;
+
+#if HAVE_THREAD
+	thread_mutex_lock(&iomodel_mutex);
+#endif
+
+	model = iomodel_find(kind, name);
+
+	/* seek if not continuing the previous access */
+	service = 0;
+	if (model->stream != stream || model->end != offset) {
+		service += model->seek;
+		++model->seek_count;
+	}
+	if (model->bandwidth != 0)
+		service += size * 1000000ULL / model->bandwidth;
+
+	/* the access waits for the first slot of the queue to become free */
+	slot = 0;
+	for (i = 1; i < model->queue; ++i) {
+		if (model->slot_map[i] < model->slot_map[slot])
+			slot = i;
+	}
+
+	start = model->slot_map[slot];
+	if (start < now)
+		start = now;
+	due = start + service;
+
+	model->slot_map[slot] = due;
+	model->stream = stream;
+	model->end = offset + size;
+	++model->count;
+	model->size += size;
+	model->busy += service;
+
+#if HAVE_THREAD
+	thread_mutex_unlock(&iomodel_mutex);
+#endif
+
+	/* the time less than a millisecond is kept in the slot, */
+	/* and it's waited by one of the next accesses */
+	if (due >= now + 1000)
+		sleep_ms((due - now) / 1000);
+}
+
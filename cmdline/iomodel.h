@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IOMODEL_H
+#define __IOMODEL_H
+
+/****************************************************************************/
+/* iomodel */
+
+/**
+ * Model of the disks, used only for testing.
+ *
+ * Every access to a data or parity disk is delayed as it would be on
+ * a disk with the bandwidth, seek time and queue depth specified in the
+ * model file, even if all the disks are in the same real device.
+ */
+
+#define IOMODEL_DISK 0 /**< Data disk. */
+#define IOMODEL_PARITY 1 /**< Parity disk. */
+
+/**
+ * If the model is enabled.
+ * It's the only check done when it's disabled.
+ */
+extern int iomodel_enabled;
+
+/**
+ * Load the model from the specified file, and enable it.
+ */
+void iomodel_open(const char* file);
+
+/**
+ * Log the time spent by the disks of the model, and free it.
+ * It must be called when no other thread is accessing the disks.
+ */
+void iomodel_close(void);
+
+/**
+ * Delay the calling thread for the time of the access in the model.
+ * \param kind One of the IOMODEL_* kinds.
+ * \param name Name of the disk, or of the parity level.
+ * \param stream Object accessed, like the file or the parity split. Changing it is a seek.
+ * \param offset Offset of the access in the stream. Not continuing the previous one is a seek.
+ */
+void iomodel_access_record(int kind, const char* name, const void* stream, data_off_t offset, unsigned size);
+
+#define iomodel_access(kind, name, stream, offset, size) \
+	do { \
+		if (iomodel_enabled) \
+			iomodel_access_record(kind, name, stream, offset, size); \
+	} while (0)
+
+#endif
+
@@ -1705,6 +1705,13 @@ int devuuid(uint64_t device, const char* path, char* uuid, size_t uuid_size)
 	return 0;
 }
 
+int devnode(uint64_t device)
+{
+	/* not supported */
+	(void)device;
+	return -1;
+}
+
 int filephy(const char* file, uint64_t size, uint64_t* physical)
 {
 	wchar_t conv_buf[CONV_MAX];
@@ -2058,6 +2065,24 @@ uint64_t tick(void)
 	return r;
 }
 
+double tick_freq(void)
+{
+	LARGE_INTEGER f;
+
+	/*
+	 * MSDN 'QueryPerformanceFrequency'
+	 * "The frequency of the performance counter is fixed at system boot"
+	 * "and is consistent across all processors."
+	 */
+	if (!QueryPerformanceFrequency(&f) || f.QuadPart == 0) {
+		/* LCOV_EXCL_START */
+		return 1e9;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return (double)f.QuadPart;
+}
+
 uint64_t tick_ms(void)
 {
 	/* GetTickCount64() isn't supported in Windows XP */
@@ -2067,6 +2092,30 @@ uint64_t tick_ms(void)
 	return GetTickCount();
 }
 
+void sleep_ms(unsigned ms)
+{
+	Sleep(ms);
+}
+
+unsigned cpu_count(void)
+{
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+
+	if (si.dwNumberOfProcessors < 1)
+		return 1;
+
+	return si.dwNumberOfProcessors;
+}
+
+int cpu_bind_node(int node)
+{
+	/* not supported */
+	(void)node;
+	return -1;
+}
+
 int randomize(void* void_ptr, size_t size)
 {
 	size_t i;
@@ -75,55 +75,15 @@ uint32_t c2 = 0xab0e9789;
 uint32_t c3 = 0x38b34ae5;
 uint32_t c4 = 0xa1e38b93;
 
-void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, void* digest)
+/*
+ * Tail and finalization.
+ *
+ * @blocks Data after the last complete block of 16 bytes.
+ * @size Total size of the data.
+ */
+static void MurmurHash3_x86_128_end(uint32_t h1, uint32_t h2, uint32_t h3, uint32_t h4, const uint32_t* blocks, size_t size, void* digest)
 {
-	size_t nblocks;
-	const uint32_t* blocks;
-	const uint32_t* end;
 	size_t size_remainder;
-	uint32_t h1, h2, h3, h4;
-
-	h1 = util_read32(seed + 0);
-	h2 = util_read32(seed + 4);
-	h3 = util_read32(seed + 8);
-	h4 = util_read32(seed + 12);
-
-	nblocks = size / 16;
-	blocks = data;
-	end = blocks + nblocks * 4;
-
-	/* body */
-	while (blocks < end) {
-		uint32_t k1 = blocks[0];
-		uint32_t k2 = blocks[1];
-		uint32_t k3 = blocks[2];
-		uint32_t k4 = blocks[3];
-
-#if WORDS_BIGENDIAN
-		k1 = util_swap32(k1);
-		k2 = util_swap32(k2);
-		k3 = util_swap32(k3);
-		k4 = util_swap32(k4);
-#endif
-
-		k1 *= c1; k1 = util_rotl32(k1, 15); k1 *= c2; h1 ^= k1;
-
-		h1 = util_rotl32(h1, 19); h1 += h2; h1 = h1 * 5 + 0x561ccd1b;
-
-		k2 *= c2; k2 = util_rotl32(k2, 16); k2 *= c3; h2 ^= k2;
-
-		h2 = util_rotl32(h2, 17); h2 += h3; h2 = h2 * 5 + 0x0bcaa747;
-
-		k3 *= c3; k3 = util_rotl32(k3, 17); k3 *= c4; h3 ^= k3;
-
-		h3 = util_rotl32(h3, 15); h3 += h4; h3 = h3 * 5 + 0x96cd1c35;
-
-		k4 *= c4; k4 = util_rotl32(k4, 18); k4 *= c1; h4 ^= k4;
-
-		h4 = util_rotl32(h4, 13); h4 += h1; h4 = h4 * 5 + 0x32ac3b17;
-
-		blocks += 4;
-	}
 
 	/* tail */
 	size_remainder = size & 15;
@@ -182,3 +142,194 @@ void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, voi
 	util_write32(digest + 12, h4);
 }
 
+void MurmurHash3_x86_128(const void* data, size_t size, const uint8_t* seed, void* digest)
+{
+	size_t nblocks;
+	const uint32_t* blocks;
+	const uint32_t* end;
+	uint32_t h1, h2, h3, h4;
+
+	h1 = util_read32(seed + 0);
+	h2 = util_read32(seed + 4);
+	h3 = util_read32(seed + 8);
+	h4 = util_read32(seed + 12);
+
+	nblocks = size / 16;
+	blocks = data;
+	end = blocks + nblocks * 4;
+
+	/* body */
+	while (blocks < end) {
+		uint32_t k1 = blocks[0];
+		uint32_t k2 = blocks[1];
+		uint32_t k3 = blocks[2];
+		uint32_t k4 = blocks[3];
+
+#if WORDS_BIGENDIAN
+		k1 = util_swap32(k1);
+		k2 = util_swap32(k2);
+		k3 = util_swap32(k3);
+		k4 = util_swap32(k4);
+#endif
+
+		k1 *= c1; k1 = util_rotl32(k1, 15); k1 *= c2; h1 ^= k1;
+
+		h1 = util_rotl32(h1, 19); h1 += h2; h1 = h1 * 5 + 0x561ccd1b;
+
+		k2 *= c2; k2 = util_rotl32(k2, 16); k2 *= c3; h2 ^= k2;
+
+		h2 = util_rotl32(h2, 17); h2 += h3; h2 = h2 * 5 + 0x0bcaa747;
+
+		k3 *= c3; k3 = util_rotl32(k3, 17); k3 *= c4; h3 ^= k3;
+
+		h3 = util_rotl32(h3, 15); h3 += h4; h3 = h3 * 5 + 0x96cd1c35;
+
+		k4 *= c4; k4 = util_rotl32(k4, 18); k4 *= c1; h4 ^= k4;
+
+		h4 = util_rotl32(h4, 13); h4 += h1; h4 = h4 * 5 + 0x32ac3b17;
+
+		blocks += 4;
+	}
+
+	MurmurHash3_x86_128_end(h1, h2, h3, h4, blocks, size, digest);
+}
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX2)
+/*
+ * Additive constants of the body, one for each lane.
+ */
+static const uint32_t murmur3_avx2_add[4][8] __aligned(32) = {
+	{ 0x561ccd1b, 0x561ccd1b, 0x561ccd1b, 0x561ccd1b, 0x561ccd1b, 0x561ccd1b, 0x561ccd1b, 0x561ccd1b },
+	{ 0x0bcaa747, 0x0bcaa747, 0x0bcaa747, 0x0bcaa747, 0x0bcaa747, 0x0bcaa747, 0x0bcaa747, 0x0bcaa747 },
+	{ 0x96cd1c35, 0x96cd1c35, 0x96cd1c35, 0x96cd1c35, 0x96cd1c35, 0x96cd1c35, 0x96cd1c35, 0x96cd1c35 },
+	{ 0x32ac3b17, 0x32ac3b17, 0x32ac3b17, 0x32ac3b17, 0x32ac3b17, 0x32ac3b17, 0x32ac3b17, 0x32ac3b17 },
+};
+
+/*
+ * Rotate left the dwords of a ymm register, using ymm12 as temporary.
+ */
+#define MURMUR3_AVX2_ROTL(reg, r) \
+	asm volatile ("vpslld $" #r ",%" reg ",%ymm12"); \
+	asm volatile ("vpsrld $(32-" #r "),%" reg ",%" reg); \
+	asm volatile ("vpor %ymm12,%" reg ",%" reg)
+
+/*
+ * Multiply by 5 and add the constant of the lane, using ymm12 as temporary.
+ */
+#define MURMUR3_AVX2_MUL5ADD(reg, n) \
+	asm volatile ("vpslld $2,%" reg ",%ymm12"); \
+	asm volatile ("vpaddd %ymm12,%" reg ",%" reg); \
+	asm volatile ("vpaddd %0,%%" reg ",%%" reg : : "m" (murmur3_avx2_add[n][0]))
+
+/*
+ * Computes the hash of 8 blocks of the same size in parallel.
+ *
+ * Each 32-bit lane of the ymm registers contains the state of a different block.
+ * The result is the same of calling MurmurHash3_x86_128() for each block.
+ */
+void MurmurHash3_x86_128_avx2x8(void** data, size_t size, const uint8_t* seed, void** digest)
+{
+	const uint8_t* v[8];
+	uint32_t h[4][8] __aligned(32);
+	size_t nblocks;
+	size_t i;
+	int l;
+
+	for (l = 0; l < 8; ++l)
+		v[l] = data[l];
+
+	nblocks = size / 16;
+
+	raid_avx_begin();
+
+	/* seed */
+	asm volatile ("vpbroadcastd %0,%%ymm0" : : "m" (seed[0]));
+	asm volatile ("vpbroadcastd %0,%%ymm1" : : "m" (seed[4]));
+	asm volatile ("vpbroadcastd %0,%%ymm2" : : "m" (seed[8]));
+	asm volatile ("vpbroadcastd %0,%%ymm3" : : "m" (seed[12]));
+
+	/* multiplicative constants */
+	asm volatile ("vpbroadcastd %0,%%ymm8" : : "m" (c1));
+	asm volatile ("vpbroadcastd %0,%%ymm9" : : "m" (c2));
+	asm volatile ("vpbroadcastd %0,%%ymm10" : : "m" (c3));
+	asm volatile ("vpbroadcastd %0,%%ymm11" : : "m" (c4));
+
+	/* body */
+	for (i = 0; i < nblocks * 16; i += 16) {
+		/* load the blocks, lanes 0-3 in the low part, 4-7 in the high part */
+		asm volatile ("vmovdqu %0,%%xmm4" : : "m" (v[0][i]));
+		asm volatile ("vmovdqu %0,%%xmm5" : : "m" (v[1][i]));
+		asm volatile ("vmovdqu %0,%%xmm6" : : "m" (v[2][i]));
+		asm volatile ("vmovdqu %0,%%xmm7" : : "m" (v[3][i]));
+		asm volatile ("vinserti128 $1,%0,%%ymm4,%%ymm4" : : "m" (v[4][i]));
+		asm volatile ("vinserti128 $1,%0,%%ymm5,%%ymm5" : : "m" (v[5][i]));
+		asm volatile ("vinserti128 $1,%0,%%ymm6,%%ymm6" : : "m" (v[6][i]));
+		asm volatile ("vinserti128 $1,%0,%%ymm7,%%ymm7" : : "m" (v[7][i]));
+
+		/* transpose, getting in ymm4-7 the k1-k4 values of all the lanes */
+		asm volatile ("vpunpckldq %ymm5,%ymm4,%ymm12");
+		asm volatile ("vpunpckhdq %ymm5,%ymm4,%ymm13");
+		asm volatile ("vpunpckldq %ymm7,%ymm6,%ymm14");
+		asm volatile ("vpunpckhdq %ymm7,%ymm6,%ymm15");
+		asm volatile ("vpunpcklqdq %ymm14,%ymm12,%ymm4");
+		asm volatile ("vpunpckhqdq %ymm14,%ymm12,%ymm5");
+		asm volatile ("vpunpcklqdq %ymm15,%ymm13,%ymm6");
+		asm volatile ("vpunpckhqdq %ymm15,%ymm13,%ymm7");
+
+		/* k1 *= c1; k1 = util_rotl32(k1, 15); k1 *= c2; h1 ^= k1; */
+		asm volatile ("vpmulld %ymm8,%ymm4,%ymm4");
+		MURMUR3_AVX2_ROTL("ymm4", 15);
+		asm volatile ("vpmulld %ymm9,%ymm4,%ymm4");
+		asm volatile ("vpxor %ymm4,%ymm0,%ymm0");
+
+		/* h1 = util_rotl32(h1, 19); h1 += h2; h1 = h1 * 5 + 0x561ccd1b; */
+		MURMUR3_AVX2_ROTL("ymm0", 19);
+		asm volatile ("vpaddd %ymm1,%ymm0,%ymm0");
+		MURMUR3_AVX2_MUL5ADD("ymm0", 0);
+
+		/* k2 *= c2; k2 = util_rotl32(k2, 16); k2 *= c3; h2 ^= k2; */
+		asm volatile ("vpmulld %ymm9,%ymm5,%ymm5");
+		MURMUR3_AVX2_ROTL("ymm5", 16);
+		asm volatile ("vpmulld %ymm10,%ymm5,%ymm5");
+		asm volatile ("vpxor %ymm5,%ymm1,%ymm1");
+
+		/* h2 = util_rotl32(h2, 17); h2 += h3; h2 = h2 * 5 + 0x0bcaa747; */
+		MURMUR3_AVX2_ROTL("ymm1", 17);
+		asm volatile ("vpaddd %ymm2,%ymm1,%ymm1");
+		MURMUR3_AVX2_MUL5ADD("ymm1", 1);
+
+		/* k3 *= c3; k3 = util_rotl32(k3, 17); k3 *= c4; h3 ^= k3; */
+		asm volatile ("vpmulld %ymm10,%ymm6,%ymm6");
+		MURMUR3_AVX2_ROTL("ymm6", 17);
+		asm volatile ("vpmulld %ymm11,%ymm6,%ymm6");
+		asm volatile ("vpxor %ymm6,%ymm2,%ymm2");
+
+		/* h3 = util_rotl32(h3, 15); h3 += h4; h3 = h3 * 5 + 0x96cd1c35; */
+		MURMUR3_AVX2_ROTL("ymm2", 15);
+		asm volatile ("vpaddd %ymm3,%ymm2,%ymm2");
+		MURMUR3_AVX2_MUL5ADD("ymm2", 2);
+
+		/* k4 *= c4; k4 = util_rotl32(k4, 18); k4 *= c1; h4 ^= k4; */
+		asm volatile ("vpmulld %ymm11,%ymm7,%ymm7");
+		MURMUR3_AVX2_ROTL("ymm7", 18);
+		asm volatile ("vpmulld %ymm8,%ymm7,%ymm7");
+		asm volatile ("vpxor %ymm7,%ymm3,%ymm3");
+
+		/* h4 = util_rotl32(h4, 13); h4 += h1; h4 = h4 * 5 + 0x32ac3b17; */
+		MURMUR3_AVX2_ROTL("ymm3", 13);
+		asm volatile ("vpaddd %ymm0,%ymm3,%ymm3");
+		MURMUR3_AVX2_MUL5ADD("ymm3", 3);
+	}
+
+	/* get the state of all the lanes */
+	asm volatile ("vmovdqa %%ymm0,%0" : "=m" (h[0]));
+	asm volatile ("vmovdqa %%ymm1,%0" : "=m" (h[1]));
+	asm volatile ("vmovdqa %%ymm2,%0" : "=m" (h[2]));
+	asm volatile ("vmovdqa %%ymm3,%0" : "=m" (h[3]));
+
+	raid_avx_end();
+
+	for (l = 0; l < 8; ++l)
+		MurmurHash3_x86_128_end(h[0][l], h[1][l], h[2][l], h[3][l], (const uint32_t*)(v[l] + nblocks * 16), size, digest[l]);
+}
+#endif
@@ -18,10 +18,12 @@
 #include "portable.h"
 
 #include "support.h"
+#include "util.h"
 #include "elem.h"
 #include "state.h"
 #include "parity.h"
 #include "handle.h"
+#include "iomodel.h"
 
 /**
  * Pseudo random limits for parity
@@ -29,6 +31,23 @@
 #define PARITY_LIMIT(size, split, level) \
 	size ? size + (123562341 + split * 634542351 + level * 983491341) % size : 0
 
+/**
+ * Size of each fallocate() done by the background allocation.
+ *
+ * Small enough to let the writes start soon, and big enough to
+ * let the file-system allocate large extents.
+ */
+#define PARITY_PREALLOC_CHUNK (256 * MEBI)
+
+#if HAVE_THREAD
+/**
+ * Parity handles created, indexed by level.
+ *
+ * Used to know the space still to allocate in background in each device.
+ */
+static struct snapraid_parity_handle* parity_async_map[LEV_MAX];
+#endif
+
 /****************************************************************************/
 /* parity */
 
@@ -157,11 +176,49 @@ void parity_overflow(struct snapraid_state* state, data_off_t size)
 	}
 }
 
+/**
+ * Number of blocks of a striped split, with the specified number of blocks of the parity.
+ */
+static data_off_t parity_stripe_blocks(block_off_t blockmax, unsigned s, unsigned split_mac)
+{
+	if (blockmax <= s)
+		return 0;
+
+	return (blockmax - s + split_mac - 1) / split_mac;
+}
+
+/**
+ * Number of blocks of a striped parity, limited by the smallest split.
+ */
+static block_off_t parity_stripe_size(struct snapraid_parity_handle* handle)
+{
+	data_off_t blockmax;
+	unsigned s;
+
+	blockmax = 0;
+	for (s = 0; s < handle->split_mac; ++s) {
+		struct snapraid_split_handle* split = &handle->split_map[s];
+
+		/* the split can contain all the blocks before its next one */
+		data_off_t run = split->size / handle->block_size * handle->split_mac + s;
+
+		if (s == 0 || blockmax > run)
+			blockmax = run;
+	}
+
+	return blockmax;
+}
+
 void parity_size(struct snapraid_parity_handle* handle, data_off_t* out_size)
 {
 	unsigned s;
 	data_off_t size;
 
+	if (handle->stripe) {
+		*out_size = parity_stripe_size(handle) * (data_off_t)handle->block_size;
+		return;
+	}
+
 	/* now compute the size summing all the parity splits */
 	size = 0;
 
@@ -174,6 +231,53 @@ void parity_size(struct snapraid_parity_handle* handle, data_off_t* out_size)
 	*out_size = size;
 }
 
+/**
+ * Open the checksum file of the parity, if used.
+ */
+static int parity_sum_open(struct snapraid_parity_handle* handle, const struct snapraid_parity* parity)
+{
+	handle->sum_f = -1;
+
+	if (!parity->sum[0])
+		return 0;
+
+	pathcpy(handle->sum_path, sizeof(handle->sum_path), parity->sum);
+
+	/* the checksum file is small, and it's always opened for writing */
+	/* as also "scrub" stores the checksums missing */
+	handle->sum_f = open(handle->sum_path, O_RDWR | O_CREAT | O_BINARY, 0600);
+	if (handle->sum_f == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error opening parity checksum file '%s'. %s.\n", handle->sum_path, strerror(errno));
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
+/**
+ * Remove the checksum file of the parity, if not used.
+ * The parity written now is not recorded in it, and if enabled again
+ * the old checksums would be wrong.
+ */
+static int parity_sum_remove(struct snapraid_parity_handle* handle, const struct snapraid_parity* parity)
+{
+	if (parity->sum[0])
+		return 0;
+
+	pathprint(handle->sum_path, sizeof(handle->sum_path), "%s.sum", parity->split_map[0].path);
+
+	if (remove(handle->sum_path) != 0 && errno != ENOENT) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error removing parity checksum file '%s'. %s.\n", handle->sum_path, strerror(errno));
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
 int parity_create(struct snapraid_parity_handle* handle, const struct snapraid_parity* parity, unsigned level, int mode, uint32_t block_size, data_off_t limit_size)
 {
 	unsigned s;
@@ -184,6 +288,12 @@ int parity_create(struct snapraid_parity_handle* handle, const struct snapraid_p
 
 	handle->level = level;
 	handle->split_mac = 0;
+	handle->sum_f = -1;
+	handle->block_size = block_size;
+	handle->stripe = parity->stripe;
+#if HAVE_THREAD
+	handle->prealloc_running = 0;
+#endif
 
 	for (s = 0; s < parity->split_mac; ++s) {
 		struct snapraid_split_handle* split = &handle->split_map[s];
@@ -194,6 +304,8 @@ int parity_create(struct snapraid_parity_handle* handle, const struct snapraid_p
 		pathcpy(split->path, sizeof(split->path), parity->split_map[s].path);
 		split->size = parity->split_map[s].size;
 		split->limit_size = PARITY_LIMIT(limit_size, s, level);
+		split->prealloc_pos = 0;
+		split->prealloc_end = 0;
 
 		/* opening in sequential mode in Windows */
 		flags = O_RDWR | O_CREAT | O_BINARY | advise_flags(&split->advise);
@@ -246,6 +358,22 @@ int parity_create(struct snapraid_parity_handle* handle, const struct snapraid_p
 		}
 	}
 
+	if (parity_sum_open(handle, parity) != 0) {
+		/* LCOV_EXCL_START */
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (parity_sum_remove(handle, parity) != 0) {
+		/* LCOV_EXCL_START */
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+#if HAVE_THREAD
+	parity_async_map[level] = handle;
+#endif
+
 	return 0;
 
 bail:
@@ -485,7 +613,155 @@ static int parity_handle_fill(struct snapraid_split_handle* split, data_off_t si
 	return parity_handle_shrink(split, base);
 }
 
-static int parity_handle_chsize(struct snapraid_split_handle* split, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder)
+#if HAVE_THREAD && HAVE_FALLOCATE && !defined(_WIN32)
+/**
+ * Space already promised to the background allocation in the device of the split.
+ *
+ * It includes all the other splits of all the parity levels.
+ */
+static uint64_t parity_async_pending(struct snapraid_split_handle* split)
+{
+	uint64_t pending = 0;
+	unsigned l;
+	unsigned s;
+
+	for (l = 0; l < LEV_MAX; ++l) {
+		struct snapraid_parity_handle* handle = parity_async_map[l];
+
+		if (!handle)
+			continue;
+
+		if (handle->prealloc_running)
+			thread_mutex_lock(&handle->prealloc_mutex);
+
+		for (s = 0; s < handle->split_mac; ++s) {
+			struct snapraid_split_handle* other = &handle->split_map[s];
+
+			if (other != split && other->st.st_dev == split->st.st_dev)
+				pending += other->prealloc_end - other->prealloc_pos;
+		}
+
+		if (handle->prealloc_running)
+			thread_mutex_unlock(&handle->prealloc_mutex);
+	}
+
+	return pending;
+}
+
+/**
+ * Complete the space promised to the background allocation in the device of the split.
+ *
+ * This ensures that parity_handle_fill() doesn't take the space of the other splits.
+ */
+static void parity_async_settle(struct snapraid_split_handle* split)
+{
+	unsigned l;
+	unsigned s;
+
+	for (l = 0; l < LEV_MAX; ++l) {
+		struct snapraid_parity_handle* handle = parity_async_map[l];
+
+		if (!handle)
+			continue;
+
+		for (s = 0; s < handle->split_mac; ++s) {
+			struct snapraid_split_handle* other = &handle->split_map[s];
+
+			if (other == split || other->st.st_dev != split->st.st_dev)
+				continue;
+
+			if (handle->prealloc_running) {
+				/* wait for the background thread */
+				thread_mutex_lock(&handle->prealloc_mutex);
+				while (other->prealloc_pos < other->prealloc_end)
+					thread_cond_wait(&handle->prealloc_cond, &handle->prealloc_mutex);
+				thread_mutex_unlock(&handle->prealloc_mutex);
+			} else if (other->prealloc_pos < other->prealloc_end) {
+				/* the thread is not yet started, allocate it now */
+				int ret = fallocate(other->f, 0, other->prealloc_pos, other->prealloc_end - other->prealloc_pos);
+				if (ret != 0) {
+					/* LCOV_EXCL_START */
+					/* let the writes allocate the rest like in a sparse file */
+					log_tag("split:prealloc:%s:%" PRIu64 ": failed with error %s\n", other->path, other->prealloc_end, strerror(errno));
+					/* LCOV_EXCL_STOP */
+				}
+				other->prealloc_pos = other->prealloc_end;
+			}
+		}
+	}
+}
+#endif
+
+/**
+ * Grow the parity split only setting its size, leaving the allocation of the
+ * space to the background thread.
+ *
+ * It's done only if the free space is surely enough, considering also the space
+ * already promised to the background allocation of the other splits in the same
+ * device, otherwise parity_handle_fill() is needed to find how much we can
+ * really allocate.
+ *
+ * Return 0 if done, or -1 if parity_handle_fill() has to be used.
+ */
+static int parity_handle_fill_async(struct snapraid_split_handle* split, data_off_t size, uint32_t block_size, int skip_fallocate)
+{
+#if HAVE_THREAD && HAVE_FALLOCATE && !defined(_WIN32)
+	data_off_t base;
+	uint64_t free_space;
+	uint64_t pending;
+
+	/* without fallocate() the file is sparse anyway */
+	if (skip_fallocate)
+		return -1;
+
+	/* the simulated limits are handled only by parity_handle_fill() */
+	if (split->limit_size != 0)
+		return -1;
+
+	/* truncate the present size to block size multiplier, like parity_handle_fill() */
+	base = split->st.st_size & ~(((data_off_t)block_size) - 1);
+
+	/* get the pending space before the free one, as the background */
+	/* allocation decreases both */
+	pending = parity_async_pending(split);
+
+	if (fsinfo(split->path, 0, 0, 0, &free_space) != 0) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (free_space < pending + (uint64_t)(size - base)) {
+		log_tag("split:async:%s:%" PRIu64 ": not enough space with %" PRIu64 " pending\n", split->path, size, pending);
+
+		/* let parity_handle_fill() see the real free space */
+		parity_async_settle(split);
+		return -1;
+	}
+
+	if (ftruncate(split->f, size) != 0) {
+		/* LCOV_EXCL_START */
+		log_tag("split:async:%s:%" PRIu64 ": failed with error %s\n", split->path, size, strerror(errno));
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	log_tag("split:async:%s:%" PRIu64 ":%" PRIu64 ":\n", split->path, base, size);
+
+	split->prealloc_pos = base;
+	split->prealloc_end = size;
+
+	return 0;
+#else
+	(void)split;
+	(void)size;
+	(void)block_size;
+	(void)skip_fallocate;
+	return -1;
+#endif
+}
+
+static int parity_handle_chsize(struct snapraid_split_handle* split, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder, int async)
 {
 	int ret;
 	int f_ret;
@@ -493,7 +769,11 @@ static int parity_handle_chsize(struct snapraid_split_handle* split, data_off_t
 	int f_dir;
 
 	if (split->st.st_size < size) {
-		f_ret = parity_handle_fill(split, size, block_size, skip_fallocate, skip_space_holder);
+		f_ret = -1;
+		if (async)
+			f_ret = parity_handle_fill_async(split, size, block_size, skip_fallocate);
+		if (f_ret != 0)
+			f_ret = parity_handle_fill(split, size, block_size, skip_fallocate, skip_space_holder);
 		f_errno = errno;
 		f_dir = 1;
 	} else if (split->st.st_size > size) {
@@ -538,6 +818,156 @@ static int parity_handle_chsize(struct snapraid_split_handle* split, data_off_t
 	return 0;
 }
 
+#if HAVE_THREAD
+/**
+ * Allocate in background the space of the splits grown by parity_handle_fill_async().
+ *
+ * The chunks are allocated in the same order of the writes. Concatenated
+ * splits are allocated one after the other, and striped splits are
+ * allocated together, one chunk of each split at time.
+ */
+static void* parity_prealloc_thread(void* arg)
+{
+	struct snapraid_parity_handle* handle = arg;
+	unsigned next;
+	unsigned s;
+
+	thread_mutex_lock(&handle->prealloc_mutex);
+
+	next = 0;
+	while (!handle->prealloc_stop) {
+		struct snapraid_split_handle* split = 0;
+		data_off_t pos;
+		data_off_t run;
+		unsigned i;
+		int ret;
+
+		/* find the next split to allocate */
+		for (i = 0; i < handle->split_mac; ++i) {
+			s = (next + i) % handle->split_mac;
+			if (handle->split_map[s].prealloc_pos < handle->split_map[s].prealloc_end) {
+				split = &handle->split_map[s];
+				break;
+			}
+		}
+		if (!split)
+			break;
+
+		/* with stripes, continue with the next split */
+		next = handle->stripe ? s + 1 : s;
+
+		pos = split->prealloc_pos;
+		run = split->prealloc_end - pos;
+
+		if (run > PARITY_PREALLOC_CHUNK)
+			run = PARITY_PREALLOC_CHUNK;
+
+		thread_mutex_unlock(&handle->prealloc_mutex);
+
+		/* the range is inside the file, so its size doesn't change */
+		ret = fallocate(split->f, 0, pos, run);
+		if (ret > 0) {
+			/* LCOV_EXCL_START */
+			errno = ret;
+			ret = -1;
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (ret != 0) {
+			/* LCOV_EXCL_START */
+			log_tag("split:prealloc:%s:%" PRIu64 ": failed with error %s\n", split->path, pos + run, strerror(errno));
+			/* LCOV_EXCL_STOP */
+		}
+
+		thread_mutex_lock(&handle->prealloc_mutex);
+
+		if (ret != 0) {
+			/* LCOV_EXCL_START */
+			/* stop here, and let the writes allocate the rest like in a sparse file */
+			split->prealloc_pos = split->prealloc_end;
+			/* LCOV_EXCL_STOP */
+		} else {
+			split->prealloc_pos = pos + run;
+		}
+
+		thread_cond_broadcast(&handle->prealloc_cond);
+	}
+
+	/* if stopped, don't let anyone wait for the remaining space */
+	for (s = 0; s < handle->split_mac; ++s) {
+		struct snapraid_split_handle* split = &handle->split_map[s];
+		if (split->prealloc_pos < split->prealloc_end) {
+			log_tag("split:prealloc:%s:%" PRIu64 ": stopped\n", split->path, split->prealloc_pos);
+			split->prealloc_pos = split->prealloc_end;
+		}
+	}
+
+	thread_cond_broadcast(&handle->prealloc_cond);
+
+	thread_mutex_unlock(&handle->prealloc_mutex);
+
+	return 0;
+}
+
+/**
+ * Start the background allocation, if any split needs it.
+ */
+static void parity_prealloc_start(struct snapraid_parity_handle* handle)
+{
+	unsigned s;
+
+	if (handle->prealloc_running)
+		return;
+
+	for (s = 0; s < handle->split_mac; ++s)
+		if (handle->split_map[s].prealloc_pos < handle->split_map[s].prealloc_end)
+			break;
+	if (s == handle->split_mac)
+		return;
+
+	handle->prealloc_running = 1;
+	handle->prealloc_stop = 0;
+	thread_mutex_init(&handle->prealloc_mutex);
+	thread_cond_init(&handle->prealloc_cond);
+	thread_create(&handle->prealloc_thread, parity_prealloc_thread, handle);
+}
+
+/**
+ * Stop the background allocation, leaving sparse the space not yet allocated.
+ */
+static void parity_prealloc_stop(struct snapraid_parity_handle* handle)
+{
+	void* retval;
+
+	if (!handle->prealloc_running)
+		return;
+
+	thread_mutex_lock(&handle->prealloc_mutex);
+	handle->prealloc_stop = 1;
+	thread_mutex_unlock(&handle->prealloc_mutex);
+
+	thread_join(handle->prealloc_thread, &retval);
+
+	thread_cond_destroy(&handle->prealloc_cond);
+	thread_mutex_destroy(&handle->prealloc_mutex);
+	handle->prealloc_running = 0;
+}
+
+/**
+ * Wait until the background allocation reaches the specified offset of the split.
+ */
+static void parity_prealloc_wait(struct snapraid_parity_handle* handle, struct snapraid_split_handle* split, data_off_t offset)
+{
+	thread_mutex_lock(&handle->prealloc_mutex);
+
+	/* the thread always moves prealloc_pos to prealloc_end before terminating */
+	while (split->prealloc_pos < offset && split->prealloc_pos < split->prealloc_end)
+		thread_cond_wait(&handle->prealloc_cond, &handle->prealloc_mutex);
+
+	thread_mutex_unlock(&handle->prealloc_mutex);
+}
+#endif
+
 static int parity_split_is_fixed(struct snapraid_parity_handle* handle, unsigned s)
 {
 	/* next one */
@@ -554,7 +984,13 @@ static int parity_split_is_fixed(struct snapraid_parity_handle* handle, unsigned
 	return 1;
 }
 
-int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity* parity, int* is_modified, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder)
+/**
+ * Change the size of concatenated splits.
+ *
+ * Only the latest not zero split grows, and when it cannot grow more,
+ * the next one is used.
+ */
+static int parity_concat_chsize(struct snapraid_parity_handle* handle, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder, int async)
 {
 	int ret;
 	unsigned s;
@@ -563,12 +999,6 @@ int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity*
 	/* mask of bits used by the block size */
 	block_mask = ((data_off_t)block_size) - 1;
 
-	if (size < 0) {
-		/* LCOV_EXCL_START */
-		return -1;
-		/* LCOV_EXCL_STOP */
-	}
-
 	for (s = 0; s < handle->split_mac; ++s) {
 		struct snapraid_split_handle* split = &handle->split_map[s];
 		int is_fixed = parity_split_is_fixed(handle, s);
@@ -598,7 +1028,7 @@ int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity*
 			run = size;
 		}
 
-		ret = parity_handle_chsize(split, run, block_size, skip_fallocate, skip_space_holder);
+		ret = parity_handle_chsize(split, run, block_size, skip_fallocate, skip_space_holder, async);
 		if (ret != 0) {
 			/* LCOV_EXCL_START */
 			return -1;
@@ -642,6 +1072,90 @@ int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity*
 		/* LCOV_EXCL_STOP */
 	}
 
+	return 0;
+}
+
+/**
+ * Change the size of striped splits.
+ *
+ * All the splits grow together, and if one cannot grow enough, it limits
+ * the size of all the others.
+ */
+static int parity_stripe_chsize(struct snapraid_parity_handle* handle, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder, int async)
+{
+	int ret;
+	unsigned s;
+	block_off_t blockmax;
+	block_off_t blockcur;
+
+	blockmax = size / block_size;
+
+	for (s = 0; s < handle->split_mac; ++s) {
+		struct snapraid_split_handle* split = &handle->split_map[s];
+		data_off_t run = parity_stripe_blocks(blockmax, s, handle->split_mac) * block_size;
+
+		ret = parity_handle_chsize(split, run, block_size, skip_fallocate, skip_space_holder, async);
+		if (ret != 0) {
+			/* LCOV_EXCL_START */
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (split->st.st_size > run) {
+			/* LCOV_EXCL_START */
+			log_fatal("Unexpected over resizing parity file '%s' to size %" PRIu64 " resulting in size %" PRIu64 ".\n", split->path, run, (uint64_t)split->st.st_size);
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* here it's possible to get less than the requested size */
+		split->size = split->st.st_size;
+	}
+
+	/* if we cannot allocate all the space */
+	blockcur = parity_stripe_size(handle);
+	if (blockcur < blockmax) {
+		/* LCOV_EXCL_START */
+		/* shrink all the splits to the usable size, to report it correctly */
+		for (s = 0; s < handle->split_mac; ++s) {
+			struct snapraid_split_handle* split = &handle->split_map[s];
+			data_off_t run = parity_stripe_blocks(blockcur, s, handle->split_mac) * block_size;
+
+			if (parity_handle_chsize(split, run, block_size, skip_fallocate, skip_space_holder, 0) != 0)
+				return -1;
+
+			split->size = split->st.st_size;
+		}
+
+		log_fatal("Failed to allocate all the required parity space. You miss %" PRIu64 " bytes.\n", (blockmax - blockcur) * (data_off_t)block_size);
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
+int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity* parity, int* is_modified, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder, int async)
+{
+	int ret;
+	unsigned s;
+
+	if (size < 0) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (handle->stripe)
+		ret = parity_stripe_chsize(handle, size, block_size, skip_fallocate, skip_space_holder, async);
+	else
+		ret = parity_concat_chsize(handle, size, block_size, skip_fallocate, skip_space_holder, async);
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
 	/* now copy the new size in the parity data */
 	if (is_modified)
 		*is_modified = 0;
@@ -656,6 +1170,11 @@ int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity*
 		}
 	}
 
+#if HAVE_THREAD
+	/* allocate the space of the splits grown asynchronously */
+	parity_prealloc_start(handle);
+#endif
+
 	return 0;
 }
 
@@ -666,6 +1185,12 @@ int parity_open(struct snapraid_parity_handle* handle, const struct snapraid_par
 
 	handle->level = level;
 	handle->split_mac = 0;
+	handle->sum_f = -1;
+	handle->block_size = block_size;
+	handle->stripe = parity->stripe;
+#if HAVE_THREAD
+	handle->prealloc_running = 0;
+#endif
 
 	/* mask of bits used by the block size */
 	block_mask = ((data_off_t)block_size) - 1;
@@ -679,6 +1204,8 @@ int parity_open(struct snapraid_parity_handle* handle, const struct snapraid_par
 		pathcpy(split->path, sizeof(split->path), parity->split_map[s].path);
 		split->size = parity->split_map[s].size;
 		split->limit_size = PARITY_LIMIT(limit_size, s, level);
+		split->prealloc_pos = 0;
+		split->prealloc_end = 0;
 
 		/* open for read */
 		/* O_NOATIME: do not change access time */
@@ -733,6 +1260,12 @@ int parity_open(struct snapraid_parity_handle* handle, const struct snapraid_par
 		}
 	}
 
+	if (parity_sum_open(handle, parity) != 0) {
+		/* LCOV_EXCL_START */
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
 	return 0;
 
 bail:
@@ -766,6 +1299,18 @@ int parity_sync(struct snapraid_parity_handle* handle)
 			/* LCOV_EXCL_STOP */
 		}
 	}
+
+	if (handle->sum_f != -1) {
+		int ret;
+
+		ret = fsync(handle->sum_f);
+		if (ret != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error syncing parity checksum file '%s'. %s.\n", handle->sum_path, strerror(errno));
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+	}
 #endif
 
 	return 0;
@@ -800,6 +1345,13 @@ int parity_close(struct snapraid_parity_handle* handle)
 	unsigned s;
 	int f_ret = 0;
 
+#if HAVE_THREAD
+	parity_prealloc_stop(handle);
+
+	if (parity_async_map[handle->level] == handle)
+		parity_async_map[handle->level] = 0;
+#endif
+
 	for (s = 0; s < handle->split_mac; ++s) {
 		struct snapraid_split_handle* split = &handle->split_map[s];
 		int ret;
@@ -821,15 +1373,41 @@ int parity_close(struct snapraid_parity_handle* handle)
 		split->f = -1;
 	}
 
+	if (handle->sum_f != -1) {
+		int ret;
+
+		ret = close(handle->sum_f);
+		if (ret != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Error closing parity checksum file '%s'. %s.\n", handle->sum_path, strerror(errno));
+			f_ret = -1;
+			/* LCOV_EXCL_STOP */
+		}
+
+		handle->sum_f = -1;
+	}
+
 	return f_ret;
 }
 
-struct snapraid_split_handle* parity_split_find(struct snapraid_parity_handle* handle, data_off_t* offset)
+/**
+ * Find the split containing the parity block, and its offset inside it.
+ */
+static struct snapraid_split_handle* parity_split_find(struct snapraid_parity_handle* handle, block_off_t pos, unsigned block_size, data_off_t* offset)
 {
 	unsigned s;
 
-	if (*offset < 0)
-		return 0;
+	if (handle->stripe) {
+		struct snapraid_split_handle* split = &handle->split_map[pos % handle->split_mac];
+
+		*offset = (pos / handle->split_mac) * (data_off_t)block_size;
+		if (*offset >= split->size)
+			return 0;
+
+		return split;
+	}
+
+	*offset = pos * (data_off_t)block_size;
 
 	for (s = 0; s < handle->split_mac; ++s) {
 		struct snapraid_split_handle* split = &handle->split_map[s];
@@ -850,9 +1428,7 @@ int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigne
 	struct snapraid_split_handle* split;
 	int ret;
 
-	offset = pos * (data_off_t)block_size;
-
-	split = parity_split_find(handle, &offset);
+	split = parity_split_find(handle, pos, block_size, &offset);
 	if (!split) {
 		/* LCOV_EXCL_START */
 		log_fatal("Writing parity data outside range at extra offset %" PRIu64 ".\n", offset);
@@ -864,6 +1440,15 @@ int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigne
 	if (split->valid_size < offset + block_size)
 		split->valid_size = offset + block_size;
 
+#if HAVE_THREAD
+	/* don't write in the space not yet allocated, to not fragment the file */
+	/* prealloc_end doesn't change while the thread is running */
+	if (offset < split->prealloc_end)
+		parity_prealloc_wait(handle, split, offset + block_size);
+#endif
+
+	iomodel_access(IOMODEL_PARITY, lev_config_name(handle->level), split, offset, block_size);
+
 	write_ret = pwrite(split->f, block_buffer, block_size, offset);
 	if (write_ret != (ssize_t)block_size) { /* conversion is safe because block_size is always small */
 		/* LCOV_EXCL_START */
@@ -884,6 +1469,70 @@ int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigne
 		/* LCOV_EXCL_STOP */
 	}
 
+	if (handle->sum_f != -1)
+		return parity_sum_write(handle, pos, block_buffer, block_size);
+
+	return 0;
+}
+
+/**
+ * Compute the checksum record of a parity block.
+ */
+static void parity_sum_make(unsigned char* record, const unsigned char* block_buffer, unsigned block_size)
+{
+	uint32_t crc;
+	unsigned i;
+
+	crc = crc32c(0, block_buffer, block_size);
+
+	for (i = 0; i < 4; ++i) {
+		record[i] = crc >> (i * 8);
+		record[i + 4] = ~crc >> (i * 8);
+	}
+}
+
+int parity_sum_write(struct snapraid_parity_handle* handle, block_off_t pos, const unsigned char* block_buffer, unsigned block_size)
+{
+	unsigned char record[PARITY_SUM_SIZE];
+	ssize_t write_ret;
+
+	parity_sum_make(record, block_buffer, block_size);
+
+	write_ret = pwrite(handle->sum_f, record, PARITY_SUM_SIZE, pos * (data_off_t)PARITY_SUM_SIZE);
+	if (write_ret != PARITY_SUM_SIZE) {
+		/* LCOV_EXCL_START */
+		log_fatal("Error writing file '%s'. %s.\n", handle->sum_path, strerror(errno));
+		return -1;
+		/* LCOV_EXCL_STOP */
+	}
+
+	return 0;
+}
+
+int parity_sum_check(struct snapraid_parity_handle* handle, block_off_t pos, const unsigned char* block_buffer, unsigned block_size)
+{
+	unsigned char record[PARITY_SUM_SIZE];
+	unsigned char stored[PARITY_SUM_SIZE];
+	ssize_t read_ret;
+	unsigned i;
+
+	read_ret = pread(handle->sum_f, stored, PARITY_SUM_SIZE, pos * (data_off_t)PARITY_SUM_SIZE);
+	if (read_ret != PARITY_SUM_SIZE) {
+		/* a missing record, after the end of the file, is like a hole */
+		return 1;
+	}
+
+	/* a valid record has the second half equal at the complement of the first */
+	for (i = 0; i < 4; ++i) {
+		if ((unsigned char)~stored[i] != stored[i + 4])
+			return 1;
+	}
+
+	parity_sum_make(record, block_buffer, block_size);
+
+	if (memcmp(record, stored, PARITY_SUM_SIZE) != 0)
+		return -1;
+
 	return 0;
 }
 
@@ -895,9 +1544,7 @@ int parity_read(struct snapraid_parity_handle* handle, block_off_t pos, unsigned
 	struct snapraid_split_handle* split;
 	int ret;
 
-	offset = pos * (data_off_t)block_size;
-
-	split = parity_split_find(handle, &offset);
+	split = parity_split_find(handle, pos, block_size, &offset);
 	if (!split) {
 		/* LCOV_EXCL_START */
 		out("Reading parity data outside range at extra offset %" PRIu64 ".\n", offset);
@@ -913,6 +1560,8 @@ int parity_read(struct snapraid_parity_handle* handle, block_off_t pos, unsigned
 		/* LCOV_EXCL_STOP */
 	}
 
+	iomodel_access(IOMODEL_PARITY, lev_config_name(handle->level), split, offset, block_size);
+
 	count = 0;
 	do {
 		read_ret = pread(split->f, block_buffer + count, block_size - count, offset + count);
@@ -51,14 +51,49 @@ struct snapraid_split_handle {
 	 * 0 means unlimited.
 	 */
 	data_off_t limit_size;
+
+	/**
+	 * Range of the parity split still to allocate in background.
+	 * The allocation proceeds from prealloc_pos to prealloc_end, and writes
+	 * after prealloc_pos wait for it.
+	 * Both are 0 if no background allocation was started.
+	 */
+	data_off_t prealloc_pos;
+	data_off_t prealloc_end;
 };
 
 struct snapraid_parity_handle {
 	struct snapraid_split_handle split_map[SPLIT_MAX];
 	unsigned split_mac; /**< Number of parity splits. */
 	unsigned level; /**< Level of the parity. */
+	uint32_t block_size; /**< Size of the parity block. */
+
+	/**
+	 * If the parity blocks are striped over the splits.
+	 * Block N is then in split N % split_mac at position N / split_mac.
+	 * Otherwise the splits are concatenated one after the other.
+	 */
+	int stripe;
+	char sum_path[PATH_MAX]; /**< Path of the checksum file. */
+	int sum_f; /**< Handle of the checksum file. -1 if not used. */
+
+#if HAVE_THREAD
+	int prealloc_running; /**< If the background allocation thread is running. */
+	int prealloc_stop; /**< Request to the background allocation thread to stop. */
+	thread_id_t prealloc_thread;
+	thread_mutex_t prealloc_mutex; /**< Protects the prealloc_pos of the splits. */
+	thread_cond_t prealloc_cond; /**< Signaled when a prealloc_pos advances. */
+#endif
 };
 
+/**
+ * Size of the checksum of a parity block in the checksum file.
+ *
+ * It's the CRC32C of the block followed by its complement, both little endian.
+ * A zero record, like the one read from a hole, means no checksum.
+ */
+#define PARITY_SUM_SIZE 8
+
 /**
  * Compute the size of the allocated parity data in number of blocks.
  *
@@ -103,8 +138,10 @@ int parity_create(struct snapraid_parity_handle* handle, const struct snapraid_p
 /**
  * Change the parity size.
  * \param out_size Return the size of the parity file. The out_size is set also on error to reflect a partial resize.
+ * \param async If there is enough free space, only set the size of the file, and allocate
+ * the space in background. The writes then wait for the allocation to reach them.
  */
-int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity* parity, int* is_modified, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder);
+int parity_chsize(struct snapraid_parity_handle* handle, struct snapraid_parity* parity, int* is_modified, data_off_t size, uint32_t block_size, int skip_fallocate, int skip_space_holder, int async);
 
 /**
  * Get the size of the parity.
@@ -140,8 +177,21 @@ int parity_read(struct snapraid_parity_handle* handle, block_off_t pos, unsigned
 
 /**
  * Write a block in the parity file.
+ *
+ * If the checksum file is used, the checksum of the block is also updated.
  */
 int parity_write(struct snapraid_parity_handle* handle, block_off_t pos, unsigned char* block_buffer, unsigned block_size);
 
+/**
+ * Store the checksum of a parity block in the checksum file.
+ */
+int parity_sum_write(struct snapraid_parity_handle* handle, block_off_t pos, const unsigned char* block_buffer, unsigned block_size);
+
+/**
+ * Verify a parity block with the checksum stored in the checksum file.
+ * Return 0 if the checksum matches, 1 if no checksum is stored, -1 if it doesn't match.
+ */
+int parity_sum_check(struct snapraid_parity_handle* handle, block_off_t pos, const unsigned char* block_buffer, unsigned block_size);
+
 #endif
 
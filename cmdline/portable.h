@@ -238,6 +238,14 @@
 #include <execinfo.h>
 #endif
 
+#if HAVE_SCHED_H
+#include <sched.h>
+#endif
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
 #ifdef __APPLE__
 #include <CoreFoundation/CoreFoundation.h>
 #include <DiskArbitration/DiskArbitration.h>
@@ -345,6 +353,12 @@ static inline int hardlink(const char* a, const char* b)
  */
 int devuuid(uint64_t device, const char* path, char* uuid, size_t size);
 
+/**
+ * Get the NUMA node of the controller of the device.
+ * Return -1 if unknown, or if the system has no NUMA nodes.
+ */
+int devnode(uint64_t device);
+
 /**
  * Physical offset not yet read.
  */
@@ -382,16 +396,40 @@ int fsinfo(const char* path, int* has_persistent_inode, int* has_syncronized_har
 /**
  * Get the tick counter value.
  *
- * Note that the frequency is unspecified, because the time measure
- * is meant to be used to compare the ratio between usage times.
+ * Note that the frequency depends on the platform. Use tick_freq()
+ * to convert the ticks to seconds.
  */
 uint64_t tick(void);
 
+/**
+ * Get the frequency of the tick counter, in ticks for second.
+ */
+double tick_freq(void);
+
 /**
  * Get the tick counter value in millisecond.
  */
 uint64_t tick_ms(void);
 
+/**
+ * Suspend the calling thread for the specified number of milliseconds.
+ */
+void sleep_ms(unsigned ms);
+
+/**
+ * Get the number of processors available.
+ *
+ * It's always at least 1.
+ */
+unsigned cpu_count(void);
+
+/**
+ * Bind the calling thread to the processors of the specified NUMA node.
+ * With a negative node, restore the processors allowed at the start.
+ * Return 0 on success.
+ */
+int cpu_bind_node(int node);
+
 /**
  * Initializes the system.
  */
@@ -36,6 +36,15 @@ struct snapraid_rehash {
 	struct snapraid_block* block;
 };
 
+/**
+ * Data block read, waiting for the hash comparison.
+ */
+struct snapraid_verify {
+	unsigned char hash[HASH_MAX]; /**< Hash computed from the data read. */
+	struct snapraid_task* task; /**< Task with the data read. */
+	int file_is_unsynced; /**< If the file is unsynced, and errors are expected. */
+};
+
 /**
  * Scrub plan to use.
  */
@@ -249,6 +258,11 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	struct snapraid_handle* handle;
 	void* rehandle_alloc;
 	struct snapraid_rehash* rehandle;
+	void* verify_alloc;
+	struct snapraid_verify* verify;
+	void** hash_src;
+	void** hash_dst;
+	void** rehash_dst;
 	unsigned diskmax;
 	block_off_t blockcur;
 	unsigned j;
@@ -259,6 +273,7 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	block_off_t autosavedone;
 	block_off_t autosavelimit;
 	block_off_t autosavemissing;
+	uint64_t deadline;
 	int ret;
 	unsigned error;
 	unsigned silent_error;
@@ -269,18 +284,33 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 	char esc_buffer[ESC_MAX];
 	bit_vect_t* block_enabled;
 
+	/* the time limit starts now, and includes the selection */
+	if (state->opt.time_limit != 0)
+		deadline = tick_ms() + state->opt.time_limit * 1000ULL;
+	else
+		deadline = 0;
+
 	/* maps the disks to handles */
 	handle = handle_mapping(state, &diskmax);
 
 	/* rehash buffers */
 	rehandle = malloc_nofail_align(diskmax * sizeof(struct snapraid_rehash), &rehandle_alloc);
 
+	/* blocks to verify, and hashes to compute all together */
+	verify = malloc_nofail_align(diskmax * sizeof(struct snapraid_verify), &verify_alloc);
+	hash_src = malloc_nofail(diskmax * sizeof(void*));
+	hash_dst = malloc_nofail(diskmax * sizeof(void*));
+	rehash_dst = malloc_nofail(diskmax * sizeof(void*));
+
 	/* we need 1 * data + 2 * parity */
 	buffermax = diskmax + 2 * state->level;
 
 	/* initialize the io threads */
 	io_init(&io, state, state->opt.io_cache, buffermax, scrub_data_reader, handle, diskmax, scrub_parity_reader, 0, parity_handle, state->level);
 
+	/* limit the reads to leave bandwidth to other processes */
+	io_limit(&io, state->opt.rate_limit, state->opt.io_depth);
+
 	/* possibly waiting disks */
 	waiting_mac = diskmax > RAID_PARITY_MAX ? diskmax : RAID_PARITY_MAX;
 	waiting_map = malloc_nofail(waiting_mac * sizeof(unsigned));
@@ -330,6 +360,8 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		int block_is_unsynced;
 		int rehash;
 		void** buffer;
+		unsigned verify_mac;
+		unsigned hash_mac;
 
 		/* go to the next block */
 		blockcur = io_read_next(&io, &buffer);
@@ -358,16 +390,17 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 		/* if we have to use the old hash */
 		rehash = info_get_rehash(info);
 
-		/* for each disk, process the block */
+		verify_mac = 0;
+		hash_mac = 0;
+
+		/* for each disk, read the block */
 		for (j = 0; j < diskmax; ++j) {
 			struct snapraid_task* task;
 			int read_size;
-			unsigned char hash[HASH_MAX];
 			struct snapraid_block* block;
 			int file_is_unsynced;
 			struct snapraid_disk* disk;
 			struct snapraid_file* file;
-			block_off_t file_pos;
 			unsigned diskcur;
 
 			/* if the file on this disk is synced */
@@ -387,7 +420,6 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			disk = task->disk;
 			block = task->block;
 			file = task->file;
-			file_pos = task->file_pos;
 			read_size = task->read_size;
 
 			/* by default no rehash in case of "continue" */
@@ -461,45 +493,73 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 
 			countsize += read_size;
 
-			/* now compute the hash */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[diskcur], read_size);
+			verify[verify_mac].task = task;
+			verify[verify_mac].file_is_unsynced = file_is_unsynced;
 
-				/* compute the new hash, and store it */
+			/* the new hash is stored only if the block is verified */
+			if (rehash)
 				rehandle[diskcur].block = block;
-				memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
+
+			if ((unsigned)read_size == state->block_size) {
+				/* full blocks are hashed later, all the disks together */
+				hash_src[hash_mac] = buffer[diskcur];
+				hash_dst[hash_mac] = verify[verify_mac].hash;
+				rehash_dst[hash_mac] = rehandle[diskcur].hash;
+				++hash_mac;
 			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[diskcur], read_size);
+				/* partial blocks at the end of files are hashed now */
+				if (rehash) {
+					memhash(state->prevhash, state->prevhashseed, verify[verify_mac].hash, buffer[diskcur], read_size);
+					memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
+				} else {
+					memhash(state->hash, state->hashseed, verify[verify_mac].hash, buffer[diskcur], read_size);
+				}
+
+				/* until now is hash */
+				state_usage_hash(state);
 			}
 
-			/* until now is hash */
-			state_usage_hash(state);
+			++verify_mac;
+		}
+
+		/* compute the hash of all the full blocks */
+		if (rehash) {
+			memhash_vec(state->prevhash, state->prevhashseed, hash_dst, hash_src, hash_mac, state->block_size);
+			memhash_vec(state->hash, state->hashseed, rehash_dst, hash_src, hash_mac, state->block_size);
+		} else {
+			memhash_vec(state->hash, state->hashseed, hash_dst, hash_src, hash_mac, state->block_size);
+		}
+
+		/* until now is hash */
+		state_usage_hash(state);
+
+		/* compare the hash of all the blocks read */
+		for (j = 0; j < verify_mac; ++j) {
+			struct snapraid_task* task = verify[j].task;
+			struct snapraid_block* block = task->block;
 
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
-				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
-					unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
+				if (memcmp(verify[j].hash, block->hash, BLOCK_HASH_SIZE) != 0) {
+					unsigned diff = memdiff(verify[j].hash, block->hash, BLOCK_HASH_SIZE);
 
-					log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u/%u\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), file_pos, diff, BLOCK_HASH_SIZE * 8);
+					log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u/%u\n", blockcur, task->disk->name, esc_tag(task->file->sub, esc_buffer), task->file_pos, diff, BLOCK_HASH_SIZE * 8);
 
 					/* it's a silent error only if we are dealing with synced files */
-					if (file_is_unsynced) {
+					if (verify[j].file_is_unsynced) {
 						++error;
 						error_on_this_block = 1;
 					} else {
-						log_error("Data error in file '%s' at position '%u', diff bits %u/%u\n", task->path, file_pos, diff, BLOCK_HASH_SIZE * 8);
+						log_error("Data error in file '%s' at position '%u', diff bits %u/%u\n", task->path, task->file_pos, diff, BLOCK_HASH_SIZE * 8);
 						++silent_error;
 						silent_error_on_this_block = 1;
 					}
-					continue;
 				}
 			}
 		}
 
-		/* buffers for parity read and not computed */
-		for (l = 0; l < state->level; ++l)
-			buffer_recov[l] = buffer[diskmax + state->level + l];
-		for (; l < LEV_MAX; ++l)
+		/* buffers for parity read and not computed, set when read */
+		for (l = 0; l < LEV_MAX; ++l)
 			buffer_recov[l] = 0;
 
 		/* until now is misc */
@@ -560,13 +620,16 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 				os_abort();
 				/* LCOV_EXCL_STOP */
 			}
+
+			/* the buffer of the parity is known only when read */
+			buffer_recov[levcur] = buffer[diskmax + state->level + levcur];
 		}
 
 		/* if we have read all the data required and it's correct, proceed with the parity check */
 		if (!error_on_this_block && !silent_error_on_this_block && !io_error_on_this_block) {
 
-			/* compute the parity */
-			raid_gen(diskmax, state->level, state->block_size, buffer);
+			/* compute the parity, keeping it in the cache for the comparison */
+			raid_gen_cached(diskmax, state->level, state->block_size, buffer);
 
 			/* compare the parity */
 			for (l = 0; l < state->level; ++l) {
@@ -607,6 +670,18 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 				}
 			}
 
+			/* store the checksum of the verified parity, if missing or old */
+			for (l = 0; l < state->level; ++l) {
+				if (parity_handle[l].sum_f != -1
+					&& parity_sum_check(&parity_handle[l], blockcur, buffer_recov[l], state->block_size) != 0
+					&& parity_sum_write(&parity_handle[l], blockcur, buffer_recov[l], state->block_size) != 0) {
+					/* LCOV_EXCL_START */
+					++error;
+					goto bail;
+					/* LCOV_EXCL_STOP */
+				}
+			}
+
 			/* update the time info of the block */
 			/* and clear any other flag */
 			info_set(&state->infoarr, blockcur, info_make(now, 0, 0, 0));
@@ -625,6 +700,18 @@ static int state_scrub_process(struct snapraid_state* state, struct snapraid_par
 			/* LCOV_EXCL_STOP */
 		}
 
+		/* stop if we reached the time limit */
+		/* the blocks already scrubbed are saved at the end as usual */
+		if (deadline != 0 && tick_ms() >= deadline) {
+			if (!state->opt.gui) {
+				msg_progress("\n");
+				msg_progress("Stopping for the time limit at block %u\n", blockcur);
+			}
+			log_tag("deadline:%u: Time limit reached\n", blockcur);
+			log_flush();
+			break;
+		}
+
 		/* autosave */
 		if (state->autosave != 0
 			&& autosavedone >= autosavelimit /* if we have reached the limit */
@@ -703,6 +790,10 @@ bail:
 
 	free(handle);
 	free(rehandle_alloc);
+	free(verify_alloc);
+	free(hash_src);
+	free(hash_dst);
+	free(rehash_dst);
 	free(waiting_map);
 	io_done(&io);
 	free(block_enabled);
@@ -717,6 +808,702 @@ bail:
 	return 0;
 }
 
+/****************************************************************************/
+/* audit */
+
+/**
+ * Context shared by all the disks in audit.
+ */
+struct snapraid_audit_context {
+	struct snapraid_state* state;
+	bit_vect_t* block_enabled; /**< Blocks to verify. */
+	block_off_t blockmax; /**< Number of parity blocks. */
+	uint64_t deadline; /**< Time in ms of the time limit, or 0. */
+#if HAVE_THREAD
+	thread_mutex_t mutex; /**< Protects all the following fields. */
+#endif
+	block_off_t countpos; /**< Number of blocks verified by all the disks. */
+	data_off_t countsize; /**< Size of the data read by all the disks. */
+	block_off_t blockcur; /**< Latest parity position verified. */
+	uint64_t rate_start; /**< Time in ms of the start of the rate measure. */
+	uint64_t rate_size; /**< Bytes read from the start of the rate measure. */
+	unsigned running; /**< Number of disks still in progress. */
+	int done; /**< Stop request for all the disks. */
+	int expired; /**< If the time limit was reached. */
+};
+
+/**
+ * Audit of a single data or parity disk.
+ *
+ * Without the parity computation, the disks are independent and each one is
+ * read in its own thread, in sequence, at its own speed.
+ */
+struct snapraid_audit {
+	struct snapraid_audit_context* context;
+	struct snapraid_handle* handle; /**< Handle of the data disk, or 0. */
+	struct snapraid_parity_handle* parity_handle; /**< Handle of the parity disk, or 0. */
+	bit_vect_t* block_bad; /**< Blocks found with silent or input/output errors. */
+	unsigned error; /**< Generic errors. */
+	unsigned silent_error; /**< Silent data errors. */
+	unsigned io_error; /**< Input/output errors. */
+	block_off_t missing; /**< Parity blocks without a checksum. */
+#if HAVE_THREAD
+	thread_id_t thread;
+#endif
+};
+
+static int audit_file_compare(const void* void_a, const void* void_b)
+{
+	void* const* a = void_a;
+	void* const* b = void_b;
+
+	return file_physical_compare(*a, *b);
+}
+
+/**
+ * Account a block verified, and wait to stay in the rate limit.
+ *
+ * Return != 0 if the audit has to stop, also for the time limit.
+ */
+static int audit_step(struct snapraid_audit_context* context, block_off_t blockcur, int read_size)
+{
+	struct snapraid_state* state = context->state;
+	unsigned wait;
+	int done;
+
+	wait = 0;
+
+#if HAVE_THREAD
+	thread_mutex_lock(&context->mutex);
+#endif
+
+	++context->countpos;
+	context->countsize += read_size;
+	context->blockcur = blockcur;
+
+	/* stop all the disks if we reached the time limit */
+	if (!context->done && context->deadline != 0 && tick_ms() >= context->deadline) {
+		context->done = 1;
+		context->expired = 1;
+	}
+
+	done = context->done;
+
+	if (state->opt.rate_limit != 0) {
+		uint64_t now;
+		uint64_t due;
+
+		context->rate_size += read_size;
+
+		/* time when all the data read so far is allowed */
+		due = context->rate_start + context->rate_size * 1000 / state->opt.rate_limit;
+
+		now = tick_ms();
+		if (now < due) {
+			wait = due - now;
+		} else if (now > due + 1000) {
+			/* restart the measure to avoid a burst to recover the lost time */
+			context->rate_start = now;
+			context->rate_size = 0;
+		}
+	}
+
+#if HAVE_THREAD
+	thread_mutex_unlock(&context->mutex);
+#endif
+
+	if (wait != 0)
+		sleep_ms(wait);
+
+	return done || global_interrupt;
+}
+
+/**
+ * Request the stop of the audit of all the disks.
+ */
+static void audit_stop(struct snapraid_audit_context* context)
+{
+#if HAVE_THREAD
+	thread_mutex_lock(&context->mutex);
+#endif
+	context->done = 1;
+#if HAVE_THREAD
+	thread_mutex_unlock(&context->mutex);
+#endif
+}
+
+static void* scrub_audit_disk(void* arg)
+{
+	struct snapraid_audit* audit = arg;
+	struct snapraid_audit_context* context = audit->context;
+	struct snapraid_state* state = context->state;
+	struct snapraid_handle* handle = audit->handle;
+	struct snapraid_disk* disk = handle->disk;
+	struct snapraid_file** file_map;
+	unsigned file_mac;
+	unsigned char* buffer;
+	void* buffer_alloc;
+	tommy_node* i;
+	unsigned k;
+	int ret;
+	char esc_buffer[ESC_MAX];
+
+	/* read the files in physical order to minimize the seeks */
+	file_map = malloc_nofail((tommy_list_count(&disk->filelist) + 1) * sizeof(struct snapraid_file*));
+	file_mac = 0;
+	for (i = tommy_list_head(&disk->filelist); i != 0; i = i->next)
+		file_map[file_mac++] = i->data;
+	qsort(file_map, file_mac, sizeof(struct snapraid_file*), audit_file_compare);
+
+	if (state->file_mode != ADVISE_DIRECT)
+		buffer = malloc_nofail_align(state->block_size, &buffer_alloc);
+	else
+		buffer = malloc_nofail_direct(state->block_size, &buffer_alloc);
+
+	for (k = 0; k < file_mac; ++k) {
+		struct snapraid_file* file = file_map[k];
+		int file_is_unsynced;
+		block_off_t file_pos;
+
+		file_is_unsynced = 0;
+		for (file_pos = 0; file_pos < file->blockmax; ++file_pos) {
+			unsigned char hash[HASH_MAX];
+			struct snapraid_block* block;
+			block_off_t blockcur;
+			snapraid_info info;
+			int read_size;
+
+			/* get the parity position, if the file has one */
+			blockcur = fs_file2par_find(disk, file, file_pos);
+			if (blockcur == POS_NULL || blockcur >= context->blockmax)
+				continue;
+
+			if (!bit_vect_test(context->block_enabled, blockcur))
+				continue;
+
+			block = fs_file2block_get(file, file_pos);
+
+			/* if the file is different than the current one, open it */
+			if (handle->file != file) {
+				ret = handle_close(handle);
+				if (ret == -1) {
+					/* LCOV_EXCL_START */
+					log_tag("error:%u:%s:%s: Close error. %s\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+					log_fatal("DANGER! Unexpected close error in a data disk.\n");
+					++audit->error;
+					audit_stop(context);
+					goto bail;
+					/* LCOV_EXCL_STOP */
+				}
+
+				ret = handle_open(handle, file, state->file_mode, log_error, 0);
+				if (ret == -1) {
+					if (errno == EIO) {
+						/* LCOV_EXCL_START */
+						log_tag("error:%u:%s:%s: Open EIO error. %s\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+						log_fatal("DANGER! Unexpected input/output open error in a data disk, it isn't possible to scrub.\n");
+						log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+						log_fatal("Stopping at block %u\n", blockcur);
+						++audit->io_error;
+						audit_stop(context);
+						goto bail;
+						/* LCOV_EXCL_STOP */
+					}
+
+					log_tag("error:%u:%s:%s: Open error. %s\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), strerror(errno));
+					++audit->error;
+
+					/* skip the rest of the file */
+					break;
+				}
+
+				/* check if the file is changed */
+				file_is_unsynced = handle->st.st_size != file->size
+					|| handle->st.st_mtime != file->mtime_sec
+					|| STAT_NSEC(&handle->st) != file->mtime_nsec;
+			}
+
+			read_size = handle_read(handle, file_pos, buffer, state->block_size, log_error, 0);
+			if (read_size == -1) {
+				if (errno == EIO) {
+					log_tag("error:%u:%s:%s: Read EIO error at position %u. %s\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), file_pos, strerror(errno));
+					log_error("Input/Output error in file '%s' at position '%u'\n", handle->path, file_pos);
+					bit_vect_set(audit->block_bad, blockcur);
+					++audit->io_error;
+					if (audit->io_error >= state->opt.io_error_limit) {
+						/* LCOV_EXCL_START */
+						log_fatal("DANGER! Too many input/output read error in a data disk, it isn't possible to scrub.\n");
+						log_fatal("Ensure that disk '%s' is sane and that file '%s' can be accessed.\n", disk->dir, handle->path);
+						log_fatal("Stopping at block %u\n", blockcur);
+						audit_stop(context);
+						goto bail;
+						/* LCOV_EXCL_STOP */
+					}
+				} else {
+					log_tag("error:%u:%s:%s: Read error at position %u. %s\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), file_pos, strerror(errno));
+					++audit->error;
+				}
+				read_size = 0;
+			} else if (block_has_updated_hash(block)) {
+				/* if we have to use the old hash */
+				info = info_get(&state->infoarr, blockcur);
+				if (info_get_rehash(info))
+					memhash(state->prevhash, state->prevhashseed, hash, buffer, read_size);
+				else
+					memhash(state->hash, state->hashseed, hash, buffer, read_size);
+
+				/* compare the hash */
+				if (memcmp(hash, block->hash, BLOCK_HASH_SIZE) != 0) {
+					unsigned diff = memdiff(hash, block->hash, BLOCK_HASH_SIZE);
+
+					log_tag("error:%u:%s:%s: Data error at position %u, diff bits %u/%u\n", blockcur, disk->name, esc_tag(file->sub, esc_buffer), file_pos, diff, BLOCK_HASH_SIZE * 8);
+
+					/* it's a silent error only if we are dealing with synced files */
+					if (file_is_unsynced || block_has_invalid_parity(block)) {
+						++audit->error;
+					} else {
+						log_error("Data error in file '%s' at position '%u', diff bits %u/%u\n", handle->path, file_pos, diff, BLOCK_HASH_SIZE * 8);
+						bit_vect_set(audit->block_bad, blockcur);
+						++audit->silent_error;
+					}
+				}
+			}
+
+			if (audit_step(context, blockcur, read_size))
+				goto bail;
+		}
+	}
+
+bail:
+	ret = handle_close(handle);
+	if (ret == -1) {
+		/* LCOV_EXCL_START */
+		log_fatal("DANGER! Unexpected close error in a data disk.\n");
+		++audit->error;
+		/* LCOV_EXCL_STOP */
+	}
+
+	free(buffer_alloc);
+	free(file_map);
+
+#if HAVE_THREAD
+	thread_mutex_lock(&context->mutex);
+#endif
+	--context->running;
+#if HAVE_THREAD
+	thread_mutex_unlock(&context->mutex);
+#endif
+
+	return 0;
+}
+
+static void* scrub_audit_parity(void* arg)
+{
+	struct snapraid_audit* audit = arg;
+	struct snapraid_audit_context* context = audit->context;
+	struct snapraid_state* state = context->state;
+	struct snapraid_parity_handle* parity_handle = audit->parity_handle;
+	unsigned level = parity_handle->level;
+	unsigned char* buffer;
+	void* buffer_alloc;
+	block_off_t blockcur;
+	int read_size;
+	int ret;
+
+	if (state->file_mode != ADVISE_DIRECT)
+		buffer = malloc_nofail_align(state->block_size, &buffer_alloc);
+	else
+		buffer = malloc_nofail_direct(state->block_size, &buffer_alloc);
+
+	/* read the parity sequentially */
+	for (blockcur = 0; blockcur < context->blockmax; ++blockcur) {
+		if (!bit_vect_test(context->block_enabled, blockcur))
+			continue;
+
+		read_size = parity_read(parity_handle, blockcur, buffer, state->block_size, log_error);
+		if (read_size == -1) {
+			if (errno == EIO) {
+				log_tag("parity_error:%u:%s: Read EIO error. %s\n", blockcur, lev_config_name(level), strerror(errno));
+				log_error("Input/Output error in parity '%s' at position '%u'\n", lev_config_name(level), blockcur);
+				bit_vect_set(audit->block_bad, blockcur);
+				++audit->io_error;
+				if (audit->io_error >= state->opt.io_error_limit) {
+					/* LCOV_EXCL_START */
+					log_fatal("DANGER! Too many input/output read error in the %s disk, it isn't possible to scrub.\n", lev_name(level));
+					log_fatal("Ensure that disk '%s' is sane and can be read.\n", lev_config_name(level));
+					log_fatal("Stopping at block %u\n", blockcur);
+					audit_stop(context);
+					break;
+					/* LCOV_EXCL_STOP */
+				}
+			} else {
+				log_tag("parity_error:%u:%s: Read error. %s\n", blockcur, lev_config_name(level), strerror(errno));
+				++audit->error;
+			}
+			read_size = 0;
+		} else {
+			ret = parity_sum_check(parity_handle, blockcur, buffer, state->block_size);
+			if (ret > 0) {
+				/* nothing to compare with */
+				++audit->missing;
+			} else if (ret < 0) {
+				log_tag("parity_error:%u:%s: Data error, checksum mismatch\n", blockcur, lev_config_name(level));
+				log_fatal("Data error in parity '%s' at position '%u', checksum mismatch\n", lev_config_name(level), blockcur);
+				bit_vect_set(audit->block_bad, blockcur);
+				++audit->silent_error;
+			}
+		}
+
+		if (audit_step(context, blockcur, read_size))
+			break;
+	}
+
+	free(buffer_alloc);
+
+#if HAVE_THREAD
+	thread_mutex_lock(&context->mutex);
+#endif
+	--context->running;
+#if HAVE_THREAD
+	thread_mutex_unlock(&context->mutex);
+#endif
+
+	return 0;
+}
+
+/**
+ * Run the audit of all the disks, each one in its own thread.
+ */
+static void audit_run(struct snapraid_state* state, struct snapraid_audit_context* context, struct snapraid_audit* audit, unsigned audit_max, void* (*func)(void*), block_off_t countmax, uint64_t deadline)
+{
+	unsigned j;
+
+	context->deadline = deadline;
+	context->countpos = 0;
+	context->countsize = 0;
+	context->blockcur = 0;
+	context->done = 0;
+	context->expired = 0;
+	context->running = audit_max;
+
+	state_progress_begin(state, 0, context->blockmax, countmax);
+
+	context->rate_start = tick_ms();
+	context->rate_size = 0;
+
+#if HAVE_THREAD
+	thread_mutex_init(&context->mutex);
+
+	/* start a thread for each disk */
+	for (j = 0; j < audit_max; ++j)
+		thread_create(&audit[j].thread, func, &audit[j]);
+
+	/* report the progress until all the disks complete */
+	while (1) {
+		block_off_t blockcur;
+		block_off_t countpos;
+		data_off_t countsize;
+		unsigned running;
+
+		thread_mutex_lock(&context->mutex);
+		countpos = context->countpos;
+		countsize = context->countsize;
+		blockcur = context->blockcur;
+		running = context->running;
+		thread_mutex_unlock(&context->mutex);
+
+		if (!running)
+			break;
+
+		if (state_progress(state, 0, blockcur, countpos, countmax, countsize)) {
+			/* LCOV_EXCL_START */
+			audit_stop(context);
+			break;
+			/* LCOV_EXCL_STOP */
+		}
+
+		sleep_ms(100);
+	}
+
+	/* wait for all the disks */
+	for (j = 0; j < audit_max; ++j) {
+		void* retval;
+
+		thread_join(audit[j].thread, &retval);
+	}
+
+	thread_mutex_destroy(&context->mutex);
+#else
+	/* process the disks one after the other, until stopped */
+	for (j = 0; j < audit_max && !context->done; ++j)
+		func(&audit[j]);
+#endif
+
+	/* the disks stop by themselves at the time limit */
+	if (context->expired) {
+		if (!state->opt.gui) {
+			msg_progress("\n");
+			msg_progress("Stopping for the time limit at block %u\n", context->blockcur);
+		}
+		log_tag("deadline:%u: Time limit reached\n", context->blockcur);
+		log_flush();
+	}
+
+	state_progress_end(state, context->countpos, countmax, context->countsize);
+}
+
+/**
+ * Collect the results of the audit of all the disks.
+ *
+ * The blocks with errors are marked as bad, but the scrub time
+ * is not updated, because the data and the parity are not cross checked.
+ */
+static int audit_result(struct snapraid_state* state, struct snapraid_audit_context* context, struct snapraid_audit* audit, unsigned audit_max)
+{
+	block_off_t blockcur;
+	block_off_t countbad;
+	block_off_t missing;
+	unsigned error;
+	unsigned silent_error;
+	unsigned io_error;
+	unsigned j;
+
+	error = 0;
+	silent_error = 0;
+	io_error = 0;
+	missing = 0;
+	for (j = 0; j < audit_max; ++j) {
+		error += audit[j].error;
+		silent_error += audit[j].silent_error;
+		io_error += audit[j].io_error;
+		missing += audit[j].missing;
+	}
+
+	/* mark the bad blocks */
+	countbad = 0;
+	if (silent_error || io_error) {
+		for (blockcur = 0; blockcur < context->blockmax; ++blockcur) {
+			for (j = 0; j < audit_max; ++j) {
+				if (bit_vect_test(audit[j].block_bad, blockcur)) {
+					snapraid_info info = info_get(&state->infoarr, blockcur);
+
+					/* set the error status keeping other info */
+					info_set(&state->infoarr, blockcur, info_set_bad(info));
+					++countbad;
+					break;
+				}
+			}
+		}
+	}
+
+	/* mark the state as needing write */
+	if (countbad != 0)
+		state->need_write = 1;
+
+	if (error || silent_error || io_error) {
+		msg_status("\n");
+		msg_status("%8u file errors\n", error);
+		msg_status("%8u io errors\n", io_error);
+		msg_status("%8u data errors\n", silent_error);
+	} else {
+		/* print the result only if processed something */
+		if (context->countpos != 0)
+			msg_status("Everything OK\n");
+	}
+
+	if (missing != 0) {
+		msg_status("%8u parity blocks without checksum, a normal 'scrub' stores them\n", missing);
+		log_tag("summary:parity_sum_missing:%u\n", missing);
+	}
+
+	if (error)
+		log_fatal("WARNING! Unexpected file errors!\n");
+	if (io_error)
+		log_fatal("DANGER! Unexpected input/output errors! The failing blocks are now marked as bad!\n");
+	if (silent_error)
+		log_fatal("DANGER! Unexpected data errors! The failing blocks are now marked as bad!\n");
+	if (io_error || silent_error) {
+		log_fatal("Use 'snapraid status' to list the bad blocks.\n");
+		log_fatal("Use 'snapraid -e fix' to recover them.\n");
+		log_fatal("Use 'snapraid -p bad scrub' to recheck after fixing to clear the bad state.\n");
+	}
+
+	log_tag("summary:error_file:%u\n", error);
+	log_tag("summary:error_io:%u\n", io_error);
+	log_tag("summary:error_data:%u\n", silent_error);
+	if (error + silent_error + io_error == 0)
+		log_tag("summary:exit:ok\n");
+	else
+		log_tag("summary:exit:error\n");
+	log_flush();
+
+	if (state->opt.expect_recoverable) {
+		if (error + silent_error + io_error == 0)
+			return -1;
+	} else {
+		if (error + silent_error + io_error != 0)
+			return -1;
+	}
+	return 0;
+}
+
+static void audit_init(struct snapraid_audit* audit, struct snapraid_audit_context* context)
+{
+	audit->context = context;
+	audit->handle = 0;
+	audit->parity_handle = 0;
+	audit->block_bad = calloc_nofail(1, bit_vect_size(context->blockmax)); /* preinitialize to 0 */
+	audit->error = 0;
+	audit->silent_error = 0;
+	audit->io_error = 0;
+	audit->missing = 0;
+}
+
+/**
+ * Verify only the hash of the data, reading each disk independently.
+ */
+static int state_scrub_audit(struct snapraid_state* state, block_off_t blockmax, struct snapraid_plan* plan)
+{
+	struct snapraid_audit_context context;
+	struct snapraid_audit* audit;
+	struct snapraid_handle* handle;
+	unsigned diskmax;
+	unsigned audit_max;
+	block_off_t blockcur;
+	block_off_t countmax;
+	uint64_t deadline;
+	unsigned j;
+	int ret;
+
+	/* the time limit starts now, and includes the selection */
+	if (state->opt.time_limit != 0)
+		deadline = tick_ms() + state->opt.time_limit * 1000ULL;
+	else
+		deadline = 0;
+
+	/* maps the disks to handles */
+	handle = handle_mapping(state, &diskmax);
+
+	audit = malloc_nofail(diskmax * sizeof(struct snapraid_audit));
+
+	context.state = state;
+	context.blockmax = blockmax;
+
+	msg_progress("Selecting...\n");
+
+	/* count the data blocks to verify in all the disks */
+	countmax = 0;
+	plan->countlast = 0;
+	context.block_enabled = calloc_nofail(1, bit_vect_size(blockmax)); /* preinitialize to 0 */
+	for (blockcur = 0; blockcur < blockmax; ++blockcur) {
+		if (!block_is_enabled(plan, blockcur))
+			continue;
+		bit_vect_set(context.block_enabled, blockcur);
+
+		for (j = 0; j < diskmax; ++j) {
+			struct snapraid_disk* disk = handle[j].disk;
+			if (disk && block_has_file(fs_par2block_find(disk, blockcur)))
+				++countmax;
+		}
+	}
+
+	audit_max = 0;
+	for (j = 0; j < diskmax; ++j) {
+		if (!handle[j].disk)
+			continue;
+		audit_init(&audit[audit_max], &context);
+		audit[audit_max].handle = &handle[j];
+		++audit_max;
+	}
+
+	msg_progress("Hashing...\n");
+
+	audit_run(state, &context, audit, audit_max, scrub_audit_disk, countmax, deadline);
+
+	ret = audit_result(state, &context, audit, audit_max);
+
+	for (j = 0; j < audit_max; ++j)
+		free(audit[j].block_bad);
+	free(audit);
+	free(handle);
+	free(context.block_enabled);
+
+	return ret;
+}
+
+/**
+ * Verify only the parity with the stored checksums, reading each parity independently.
+ */
+static int state_scrub_parity(struct snapraid_state* state, struct snapraid_parity_handle* parity_handle, block_off_t blockmax, struct snapraid_plan* plan)
+{
+	struct snapraid_audit_context context;
+	struct snapraid_audit audit[LEV_MAX];
+	struct snapraid_handle* handle;
+	unsigned diskmax;
+	block_off_t blockcur;
+	block_off_t countmax;
+	uint64_t deadline;
+	unsigned j;
+	unsigned l;
+	int ret;
+
+	/* the time limit starts now, and includes the selection */
+	if (state->opt.time_limit != 0)
+		deadline = tick_ms() + state->opt.time_limit * 1000ULL;
+	else
+		deadline = 0;
+
+	/* maps the disks to handles, only to check the sync state */
+	handle = handle_mapping(state, &diskmax);
+
+	context.state = state;
+	context.blockmax = blockmax;
+
+	msg_progress("Selecting...\n");
+
+	/* count the parity blocks to verify */
+	countmax = 0;
+	plan->countlast = 0;
+	context.block_enabled = calloc_nofail(1, bit_vect_size(blockmax)); /* preinitialize to 0 */
+	for (blockcur = 0; blockcur < blockmax; ++blockcur) {
+		int block_is_unsynced;
+
+		if (!block_is_enabled(plan, blockcur))
+			continue;
+
+		/* if not synced, the parity is not expected to match */
+		block_is_unsynced = 0;
+		for (j = 0; j < diskmax; ++j) {
+			struct snapraid_disk* disk = handle[j].disk;
+			if (disk && block_has_invalid_parity(fs_par2block_find(disk, blockcur)))
+				block_is_unsynced = 1;
+		}
+		if (block_is_unsynced)
+			continue;
+
+		bit_vect_set(context.block_enabled, blockcur);
+		countmax += state->level;
+	}
+
+	for (l = 0; l < state->level; ++l) {
+		audit_init(&audit[l], &context);
+		audit[l].parity_handle = &parity_handle[l];
+	}
+
+	msg_progress("Scrubbing parity...\n");
+
+	audit_run(state, &context, audit, state->level, scrub_audit_parity, countmax, deadline);
+
+	ret = audit_result(state, &context, audit, state->level);
+
+	for (l = 0; l < state->level; ++l)
+		free(audit[l].block_bad);
+	free(handle);
+	free(context.block_enabled);
+
+	return ret;
+}
+
 /**
  * Return a * b / c approximated to the upper value.
  */
@@ -741,7 +1528,8 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 	int ret;
 	struct snapraid_parity_handle parity_handle[LEV_MAX];
 	struct snapraid_plan ps;
-	time_t* timemap;
+	struct snapraid_timehist timehist;
+	tommy_node* j;
 	unsigned error;
 	time_t now;
 	unsigned l;
@@ -797,12 +1585,11 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 	}
 
 	/* identify the time limit */
-	/* we sort all the block times, and we identify the time limit for which we reach the quota */
+	/* we count the blocks for each distinct time, and we identify the time limit for which we reach the quota */
 	/* this allow to process first the oldest blocks */
-	timemap = malloc_nofail(blockmax * sizeof(time_t));
+	timehist_init(&timehist);
 
-	/* copy the info in the temp vector */
-	count = 0;
+	/* fill the histogram */
 	log_tag("block_count:%u\n", blockmax);
 	for (i = 0; i < blockmax; ++i) {
 		snapraid_info info = info_get(&state->infoarr, i);
@@ -811,8 +1598,9 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 		if (info == 0)
 			continue;
 
-		timemap[count++] = info_get_time(info);
+		timehist_insert(&timehist, info_get_time(info));
 	}
+	count = timehist.count;
 
 	if (!count) {
 		/* LCOV_EXCL_START */
@@ -822,17 +1610,13 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 	}
 
 	/* sort it */
-	qsort(timemap, count, sizeof(time_t), time_compare);
+	timehist_sort(&timehist);
 
 	/* output the info map */
-	i = 0;
 	log_tag("info_count:%u\n", count);
-	while (i < count) {
-		unsigned j = i + 1;
-		while (j < count && timemap[i] == timemap[j])
-			++j;
-		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)timemap[i], j - i);
-		i = j;
+	for (j = tommy_list_head(&timehist.list); j != 0; j = j->next) {
+		struct snapraid_timecount* entry = j->data;
+		log_tag("info_time:%" PRIu64 ":%u\n", (uint64_t)entry->time, entry->count);
 	}
 
 	/* compute the limits from count/recentlimit */
@@ -841,20 +1625,18 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 		if (countlimit > count)
 			countlimit = count;
 
-		/* decrease until we reach the specific recentlimit */
-		while (countlimit > 0 && timemap[countlimit - 1] > recentlimit)
-			--countlimit;
+		/* no more than the blocks older than recentlimit */
+		if (countlimit > timehist_upto(&timehist, recentlimit))
+			countlimit = timehist_upto(&timehist, recentlimit);
 
 		/* if there is something to scrub */
 		if (countlimit > 0) {
 			/* get the most recent time we want to scrub */
-			ps.timelimit = timemap[countlimit - 1];
+			ps.timelimit = timehist_rank(&timehist, countlimit - 1);
 
 			/* count how many entries for this exact time we have to scrub */
 			/* if the blocks have all the same time, we end with countlimit == lastlimit */
-			ps.lastlimit = 1;
-			while (countlimit > ps.lastlimit && timemap[countlimit - ps.lastlimit - 1] == ps.timelimit)
-				++ps.lastlimit;
+			ps.lastlimit = countlimit - timehist_upto(&timehist, ps.timelimit - 1);
 		} else {
 			/* if nothing to scrub, disable also other limits */
 			ps.timelimit = 0;
@@ -866,8 +1648,19 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 		log_tag("last_limit:%u\n", ps.lastlimit);
 	}
 
-	/* free the temp vector */
-	free(timemap);
+	timehist_done(&timehist);
+
+	/* in audit mode the parity is not read */
+	if (state->opt.auditonly)
+		return state_scrub_audit(state, blockmax, &ps);
+
+	/* in parity only mode the parity is verified with its checksums */
+	if (state->opt.parityonly && !state->paritysum) {
+		/* LCOV_EXCL_START */
+		log_fatal("To scrub only the parity you have to enable the 'paritysum' option in the configuration file.\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
 
 	/* open the file for reading */
 	for (l = 0; l < state->level; ++l) {
@@ -882,7 +1675,10 @@ int state_scrub(struct snapraid_state* state, int plan, int olderthan)
 
 	error = 0;
 
-	ret = state_scrub_process(state, parity_handle, 0, blockmax, &ps, now);
+	if (state->opt.parityonly)
+		ret = state_scrub_parity(state, parity_handle, blockmax, &ps);
+	else
+		ret = state_scrub_process(state, parity_handle, 0, blockmax, &ps, now);
 	if (ret == -1) {
 		++error;
 		/* continue, as we are already exiting */
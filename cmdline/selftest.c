@@ -55,6 +55,11 @@ struct hash_test_vector {
 	unsigned char digest[HASH_MAX];
 };
 
+struct hash_long_test_vector {
+	int len; /**< Length of the data generated by hash_long_fill(). */
+	unsigned char digest[HASH_MAX];
+};
+
 /**
  * Test vectors for tommy_hash32
  */
@@ -153,8 +158,40 @@ static struct hash_test_vector TEST_SPOOKY2[] = {
 	{ 0, 0, { 0 } }
 };
 
+/**
+ * Test vectors for XXH3_128
+ */
+static struct hash_test_vector TEST_XXH3[] = {
+#include "xxh3test.c"
+	{ 0, 0, { 0 } }
+};
+
+/**
+ * Test vectors for XXH3_128 with the long inputs used by real blocks
+ */
+static struct hash_long_test_vector TEST_XXH3_LONG[] = {
+#include "xxh3longtest.c"
+	{ 0, { 0 } }
+};
+
 #define HASH_TEST_MAX 512 /* tests are never longer than 512 bytes */
 
+#define HASH_LONG_TEST_MAX (256 * 1024) /* long tests are never longer than 256 KiB */
+
+/**
+ * Fill the data of the long test vectors with a linear congruential generator.
+ */
+static void hash_long_fill(unsigned char* data, int len)
+{
+	uint32_t v = 0x5d79a766;
+	int i;
+
+	for (i = 0; i < len; ++i) {
+		v = v * 1103515245 + 12345;
+		data[i] = v >> 24;
+	}
+}
+
 static void test_hash(void)
 {
 	unsigned i;
@@ -249,10 +286,90 @@ static void test_hash(void)
 		}
 	}
 
+	for (i = 0; TEST_XXH3[i].data; ++i) {
+		unsigned char digest[HASH_MAX];
+		memcpy(buffer_aligned, TEST_XXH3[i].data, TEST_XXH3[i].len);
+		memhash(HASH_XXH3, seed_aligned, digest, buffer_aligned, TEST_XXH3[i].len);
+		if (memcmp(digest, TEST_XXH3[i].digest, HASH_MAX) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed XXH3 test\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	free(buffer_alloc);
+	buffer_aligned = malloc_nofail_align(HASH_LONG_TEST_MAX, &buffer_alloc);
+
+	for (i = 0; TEST_XXH3_LONG[i].len; ++i) {
+		unsigned char digest[HASH_MAX];
+		hash_long_fill(buffer_aligned, TEST_XXH3_LONG[i].len);
+		memhash(HASH_XXH3, seed_aligned, digest, buffer_aligned, TEST_XXH3_LONG[i].len);
+		if (memcmp(digest, TEST_XXH3_LONG[i].digest, HASH_MAX) != 0) {
+			/* LCOV_EXCL_START */
+			log_fatal("Failed XXH3 long test\n");
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	free(buffer_alloc);
 	free(seed_alloc);
 }
 
+#define HASH_VEC_COUNT 11 /* more than a full SIMD batch, with a remainder */
+#define HASH_VEC_MAX 1031 /* longest block tested */
+
+/**
+ * Check that the vector hash returns the same result of the single one.
+ */
+static void test_hash_vec(void)
+{
+	static const unsigned TEST_KIND[] = { HASH_MURMUR3, HASH_SPOOKY2, HASH_METRO, HASH_XXH3 };
+	static const unsigned TEST_SIZE[] = { 0, 1, 15, 16, 17, 191, 192, 193, 512, HASH_VEC_MAX };
+	unsigned char seed[HASH_MAX];
+	unsigned char digest[HASH_VEC_COUNT][HASH_MAX];
+	unsigned char* buffer;
+	void* src[HASH_VEC_COUNT];
+	void* dst[HASH_VEC_COUNT];
+	unsigned i, j, k;
+
+	/* one more byte for each block, to test also unaligned blocks */
+	buffer = malloc_nofail(HASH_VEC_COUNT * (HASH_VEC_MAX + 1));
+
+	for (i = 0; i < HASH_VEC_COUNT * (HASH_VEC_MAX + 1); ++i)
+		buffer[i] = i * 0x9e3779b1 >> 24;
+
+	for (i = 0; i < HASH_MAX; ++i)
+		seed[i] = i * 0x61c88647 >> 24;
+
+	for (i = 0; i < HASH_VEC_COUNT; ++i) {
+		src[i] = buffer + i * (HASH_VEC_MAX + 1) + i % 2;
+		dst[i] = digest[i];
+	}
+
+	for (k = 0; k < sizeof(TEST_KIND) / sizeof(TEST_KIND[0]); ++k) {
+		for (j = 0; j < sizeof(TEST_SIZE) / sizeof(TEST_SIZE[0]); ++j) {
+			memhash_vec(TEST_KIND[k], seed, dst, src, HASH_VEC_COUNT, TEST_SIZE[j]);
+
+			for (i = 0; i < HASH_VEC_COUNT; ++i) {
+				unsigned char expected[HASH_MAX];
+
+				memhash(TEST_KIND[k], seed, expected, src[i], TEST_SIZE[j]);
+
+				if (memcmp(expected, digest[i], HASH_MAX) != 0) {
+					/* LCOV_EXCL_START */
+					log_fatal("Failed vector hash test\n");
+					exit(EXIT_FAILURE);
+					/* LCOV_EXCL_STOP */
+				}
+			}
+		}
+	}
+
+	free(buffer);
+}
+
 struct crc_test_vector {
 	const char* data;
 	int len;
@@ -580,6 +697,7 @@ void selftest(void)
 	}
 
 	test_hash();
+	test_hash_vec();
 	test_crc32c();
 	test_tommy();
 	if (raid_selftest() != 0) {
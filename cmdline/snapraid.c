@@ -24,6 +24,8 @@
 #include "search.h"
 #include "state.h"
 #include "io.h"
+#include "trace.h"
+#include "iomodel.h"
 #include "raid/raid.h"
 
 /****************************************************************************/
@@ -63,8 +65,18 @@ void usage(void)
 	printf("  " SWITCH_GETOPT_LONG("-e, --filter-error    ", "-e") "  Process only files with errors\n");
 	printf("  " SWITCH_GETOPT_LONG("-p, --plan PLAN       ", "-p") "  Define a scrub plan or percentage\n");
 	printf("  " SWITCH_GETOPT_LONG("-o, --older-than DAYS ", "-o") "  Process only the older part of the array\n");
+	printf("  " SWITCH_GETOPT_LONG("-r, --rate-limit MB   ", "-r") "  Limit the read speed in scrub to MB/s\n");
+	printf("  " SWITCH_GETOPT_LONG("-t, --time-limit MIN  ", "-t") "  Stop the scrub after the specified minutes\n");
+	printf("  " SWITCH_GETOPT_LONG("-Q, --queue-depth N   ", "-Q") "  Limit the blocks read ahead for each disk\n");
+#if HAVE_GETOPT_LONG
+	printf("      --daemon            Scrub continuously in background\n");
+	printf("      --parity-only       Scrub only the parity with its checksums\n");
+#endif
 	printf("  " SWITCH_GETOPT_LONG("-i, --import DIR      ", "-i") "  Import deleted files\n");
 	printf("  " SWITCH_GETOPT_LONG("-l, --log FILE        ", "-l") "  Log file. Default none\n");
+#if HAVE_GETOPT_LONG
+	printf("      --trace FILE        Trace the threads in the Chrome trace format\n");
+#endif
 	printf("  " SWITCH_GETOPT_LONG("-a, --audit-only      ", "-a") "  Check only file data and not parity\n");
 	printf("  " SWITCH_GETOPT_LONG("-h, --pre-hash        ", "-h") "  Pre-hash all the new data\n");
 	printf("  " SWITCH_GETOPT_LONG("-Z, --force-zero      ", "-Z") "  Force syncing of files that get zero size\n");
@@ -77,7 +89,7 @@ void usage(void)
 	printf("  " SWITCH_GETOPT_LONG("-v, --verbose         ", "-v") "  Verbose\n");
 }
 
-void memory(void)
+void memory(struct snapraid_state* state)
 {
 	log_tag("memory:used:%" PRIu64 "\n", (uint64_t)malloc_counter_get());
 
@@ -89,6 +101,9 @@ void memory(void)
 	log_tag("memory:dir:%" PRIu64 "\n", (uint64_t)(sizeof(struct snapraid_dir)));
 
 	msg_progress("Using %u MiB of memory for the file-system.\n", (unsigned)(malloc_counter_get() / MEBI));
+
+	/* fail early if the state alone doesn't fit in the memory limit */
+	state_memory_check(state, 0, 0);
 }
 
 void test(int argc, char* argv[])
@@ -309,6 +324,14 @@ void config(char* conf, size_t conf_size, const char* argv0)
 #define OPT_TEST_SKIP_SPACE_HOLDER 303
 #define OPT_TEST_FORMAT 304
 #define OPT_TEST_SKIP_MULTI_SCAN 305
+#define OPT_TEST_FORCE_XXH3 306
+#define OPT_TEST_FORCE_TIME_LIMIT 307
+#define OPT_DAEMON 308
+#define OPT_TEST_DAEMON_CYCLES 309
+#define OPT_PARITY_ONLY 310
+#define OPT_TEST_REPAIR_THREAD 311
+#define OPT_TRACE 312
+#define OPT_TEST_IO_MODEL 313
 
 #if HAVE_GETOPT_LONG
 struct option long_options[] = {
@@ -321,11 +344,17 @@ struct option long_options[] = {
 	{ "percentage", 1, 0, 'p' }, /* legacy name for --plan */
 	{ "plan", 1, 0, 'p' },
 	{ "older-than", 1, 0, 'o' },
+	{ "rate-limit", 1, 0, 'r' },
+	{ "time-limit", 1, 0, 't' },
+	{ "queue-depth", 1, 0, 'Q' },
+	{ "daemon", 0, 0, OPT_DAEMON },
+	{ "parity-only", 0, 0, OPT_PARITY_ONLY },
 	{ "start", 1, 0, 'S' },
 	{ "count", 1, 0, 'B' },
 	{ "error-limit", 1, 0, 'L' },
 	{ "import", 1, 0, 'i' },
 	{ "log", 1, 0, 'l' },
+	{ "trace", 1, 0, OPT_TRACE },
 	{ "force-zero", 0, 0, 'Z' },
 	{ "force-empty", 0, 0, 'E' },
 	{ "force-uuid", 0, 0, 'U' },
@@ -372,6 +401,9 @@ struct option long_options[] = {
 	/* Force Spooky2 hash */
 	{ "test-force-spooky2", 0, 0, OPT_TEST_FORCE_SPOOKY2 },
 
+	/* Force XXH3 hash */
+	{ "test-force-xxh3", 0, 0, OPT_TEST_FORCE_XXH3 },
+
 	/* Skip the use of lock file */
 	{ "test-skip-lock", 0, 0, OPT_TEST_SKIP_LOCK },
 
@@ -441,6 +473,12 @@ struct option long_options[] = {
 	/* Print IO stats */
 	{ "test-io-stats", 0, 0, OPT_TEST_IO_STATS },
 
+	/* Number of repair threads */
+	{ "test-repair-thread", 1, 0, OPT_TEST_REPAIR_THREAD },
+
+	/* Delay the disk accesses as specified in the model file */
+	{ "test-io-model", 1, 0, OPT_TEST_IO_MODEL },
+
 	/* Signal condition variable outside the mutex */
 	{ "test-cond-signal-outside", 0, 0, OPT_TEST_COND_SIGNAL_OUTSIDE },
 
@@ -480,11 +518,17 @@ struct option long_options[] = {
 	/* Skip thread in disk scan */
 	{ "test-skip-multi-scan", 0, 0, OPT_TEST_SKIP_MULTI_SCAN },
 
+	/* Set the time limit in seconds */
+	{ "test-force-time-limit", 1, 0, OPT_TEST_FORCE_TIME_LIMIT },
+
+	/* Stop the daemon after the specified number of cycles, without waiting */
+	{ "test-daemon-cycles", 1, 0, OPT_TEST_DAEMON_CYCLES },
+
 	{ 0, 0, 0, 0 }
 };
 #endif
 
-#define OPTIONS "c:f:d:mebp:o:S:B:L:i:l:ZEUDNFRahTC:vqHVG"
+#define OPTIONS "c:f:d:mebp:o:r:t:Q:S:B:L:i:l:ZEUDNFRahTC:vqHVG"
 
 volatile int global_interrupt = 0;
 
@@ -518,6 +562,166 @@ void signal_init(void)
 #endif
 }
 
+/****************************************************************************/
+/* daemon */
+
+/**
+ * Default time limit of each scrub cycle in daemon mode, in seconds.
+ *
+ * At the end of each cycle the content file is saved, and the lock
+ * released, to allow other commands to run.
+ */
+#define DAEMON_CYCLE 3600
+
+/**
+ * Time to wait between scrub cycles in daemon mode, in seconds.
+ */
+#define DAEMON_PAUSE 60
+
+/**
+ * Time to wait when there is nothing to scrub in daemon mode, in seconds.
+ */
+#define DAEMON_IDLE 3600
+
+/**
+ * Wait the specified number of seconds, or until interrupted.
+ */
+static void daemon_wait(unsigned seconds)
+{
+	while (seconds > 0 && !global_interrupt) {
+		sleep(1);
+		--seconds;
+	}
+}
+
+/**
+ * Get the stat of the first content file.
+ *
+ * It's used to detect if other commands changed the content file.
+ */
+static void daemon_stat(struct snapraid_state* state, struct stat* st)
+{
+	struct snapraid_content* content = tommy_list_head(&state->contentlist)->data;
+
+	if (stat(content->content, st) != 0) {
+		/* LCOV_EXCL_START */
+		memset(st, 0, sizeof(struct stat));
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+/**
+ * Scrub the array continuously, keeping the state in memory.
+ *
+ * The lock file is held only during the scrub cycles, and if another
+ * command is using it, the daemon waits for its end, and then reloads
+ * the content file if it was changed.
+ */
+static int daemon_scrub(struct snapraid_state* state, const char* conf, const char* command, struct snapraid_option* opt, tommy_list* filterlist_disk, int plan, int olderthan, int* lock)
+{
+	unsigned cycle;
+	int use_lock;
+
+#if HAVE_LOCKFILE
+	use_lock = !opt->skip_lock && state->lockfile[0];
+#else
+	use_lock = 0;
+	(void)lock;
+#endif
+
+	cycle = 0;
+	while (1) {
+		struct stat st_before;
+		struct stat st_after;
+		int need_write;
+		int ret;
+
+		ret = state_scrub(state, plan, olderthan);
+
+		/* save the blocks scrubbed in the cycle */
+		need_write = state->need_write;
+		if (state->need_write || state->opt.force_content_write)
+			state_write(state);
+
+		/* abort if required */
+		if (ret != 0) {
+			/* LCOV_EXCL_START */
+			return -1;
+			/* LCOV_EXCL_STOP */
+		}
+
+		++cycle;
+		if (global_interrupt || (opt->daemon_cycles != 0 && cycle >= opt->daemon_cycles))
+			break;
+
+		daemon_stat(state, &st_before);
+
+#if HAVE_LOCKFILE
+		/* allow other commands to run */
+		if (use_lock) {
+			if (lock_unlock(*lock) == -1) {
+				/* LCOV_EXCL_START */
+				log_fatal("Failed to close the lock file '%s'. %s.\n", state->lockfile, strerror(errno));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			*lock = -1;
+		}
+#endif
+
+		/* in test mode don't wait */
+		if (opt->daemon_cycles == 0) {
+			msg_progress("Waiting for the next scrub...\n");
+			daemon_wait(need_write ? DAEMON_PAUSE : DAEMON_IDLE);
+		}
+
+#if HAVE_LOCKFILE
+		/* pause while other commands, like 'sync', are running */
+		while (use_lock && !global_interrupt) {
+			*lock = lock_lock(state->lockfile);
+			if (*lock != -1)
+				break;
+
+			/* LCOV_EXCL_START */
+			if (errno != EWOULDBLOCK) {
+				log_fatal("Failed to create the lock file '%s'. %s.\n", state->lockfile, strerror(errno));
+				exit(EXIT_FAILURE);
+			}
+
+			msg_progress("Paused, SnapRAID is in use...\n");
+			daemon_wait(DAEMON_PAUSE);
+			/* LCOV_EXCL_STOP */
+		}
+#endif
+
+		if (global_interrupt) {
+			/* LCOV_EXCL_START */
+			break;
+			/* LCOV_EXCL_STOP */
+		}
+
+		/* reload the state if another command changed it */
+		daemon_stat(state, &st_after);
+		if (st_before.st_ino != st_after.st_ino
+			|| st_before.st_mtime != st_after.st_mtime
+			|| st_before.st_size != st_after.st_size
+		) {
+			/* LCOV_EXCL_START */
+			msg_progress("Reloading the changed content file...\n");
+
+			state_done(state);
+			state_init(state);
+			state_config(state, conf, command, opt, filterlist_disk);
+			raid_mode(state->raid_mode);
+			state_tune(state);
+			state_read(state);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	return 0;
+}
+
 #define OPERATION_DIFF 0
 #define OPERATION_SYNC 1
 #define OPERATION_CHECK 2
@@ -558,6 +762,8 @@ int main(int argc, char* argv[])
 	const char* import_timestamp;
 	const char* import_content;
 	const char* log_file;
+	const char* trace_file;
+	const char* model_file;
 	int lock;
 	const char* gen_conf;
 	const char* run;
@@ -590,6 +796,8 @@ int main(int argc, char* argv[])
 	import_timestamp = 0;
 	import_content = 0;
 	log_file = 0;
+	trace_file = 0;
+	model_file = 0;
 	lock = 0;
 	gen_conf = 0;
 	speedtest = 0;
@@ -673,6 +881,35 @@ int main(int argc, char* argv[])
 				/* LCOV_EXCL_STOP */
 			}
 			break;
+		case 'r' :
+			opt.rate_limit = strtoul(optarg, &e, 10);
+			if (!e || *e || opt.rate_limit == 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid rate limit '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			opt.rate_limit *= MEGA;
+			break;
+		case 't' :
+			opt.time_limit = strtoul(optarg, &e, 10);
+			if (!e || *e || opt.time_limit == 0 || opt.time_limit > 100000) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid time limit '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			opt.time_limit *= 60;
+			break;
+		case 'Q' :
+			opt.io_depth = strtoul(optarg, &e, 10);
+			if (!e || *e || opt.io_depth == 0 || opt.io_depth > IO_MAX) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid queue depth '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			break;
 		case 'S' :
 			blockstart = strtoul(optarg, &e, 0);
 			if (!e || *e) {
@@ -727,6 +964,9 @@ int main(int argc, char* argv[])
 			}
 			log_file = optarg;
 			break;
+		case OPT_TRACE :
+			trace_file = optarg;
+			break;
 		case 'Z' :
 			opt.force_zero = 1;
 			break;
@@ -812,6 +1052,9 @@ int main(int argc, char* argv[])
 		case OPT_TEST_FORCE_SPOOKY2 :
 			opt.force_spooky2 = 1;
 			break;
+		case OPT_TEST_FORCE_XXH3 :
+			opt.force_xxh3 = 1;
+			break;
 		case OPT_TEST_SKIP_LOCK :
 			opt.skip_lock = 1;
 			break;
@@ -885,6 +1128,30 @@ int main(int argc, char* argv[])
 		case OPT_TEST_IO_STATS :
 			opt.force_stats = 1;
 			break;
+		case OPT_TEST_REPAIR_THREAD :
+			opt.repair_thread = atoi(optarg);
+			if (opt.repair_thread < 1 || opt.repair_thread > REPAIR_THREAD_MAX) {
+				/* LCOV_EXCL_START */
+				log_fatal("The number of repair threads should be between 1 and %u.\n", REPAIR_THREAD_MAX);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+			break;
+		case OPT_TEST_IO_MODEL :
+			model_file = optarg;
+			break;
+		case OPT_TEST_FORCE_TIME_LIMIT :
+			opt.time_limit = atoi(optarg);
+			break;
+		case OPT_DAEMON :
+			opt.daemon = 1;
+			break;
+		case OPT_TEST_DAEMON_CYCLES :
+			opt.daemon_cycles = atoi(optarg);
+			break;
+		case OPT_PARITY_ONLY :
+			opt.parityonly = 1;
+			break;
 		case OPT_TEST_COND_SIGNAL_OUTSIDE :
 #if HAVE_THREAD
 			thread_cond_signal_outside = 1;
@@ -948,6 +1215,7 @@ int main(int argc, char* argv[])
 	os_init(opt.force_scan_winfind);
 	raid_init();
 	crc32c_init();
+	memhash_init();
 
 	if (speedtest != 0) {
 		speed(period);
@@ -1015,6 +1283,7 @@ int main(int argc, char* argv[])
 	/* check options compatibility */
 	switch (operation) {
 	case OPERATION_CHECK :
+	case OPERATION_SCRUB :
 		break;
 	default :
 		if (opt.auditonly) {
@@ -1056,6 +1325,57 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	switch (operation) {
+	case OPERATION_SCRUB :
+		break;
+	default :
+		if (opt.rate_limit) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use -r, --rate-limit with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (opt.time_limit) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use -t, --time-limit with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (opt.io_depth) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use -Q, --queue-depth with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (opt.daemon) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use --daemon with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+
+		if (opt.parityonly) {
+			/* LCOV_EXCL_START */
+			log_fatal("You cannot use --parity-only with the '%s' command\n", command);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	if (opt.auditonly && opt.parityonly) {
+		/* LCOV_EXCL_START */
+		log_fatal("You cannot use -a, --audit-only and --parity-only together\n");
+		exit(EXIT_FAILURE);
+		/* LCOV_EXCL_STOP */
+	}
+
+	/* in daemon mode, each scrub cycle is limited in time */
+	if (opt.daemon && !opt.time_limit)
+		opt.time_limit = DAEMON_CYCLE;
+
 	switch (operation) {
 	case OPERATION_SYNC :
 		break;
@@ -1250,6 +1570,14 @@ int main(int argc, char* argv[])
 	/* open the log file */
 	log_open(log_file);
 
+	/* enable the tracing of the threads */
+	if (trace_file)
+		trace_open(trace_file);
+
+	/* load the model of the disks */
+	if (model_file)
+		iomodel_open(model_file);
+
 	/* print generic info into the log */
 	t = time(0);
 #if HAVE_LOCALTIME_R
@@ -1300,6 +1628,15 @@ int main(int argc, char* argv[])
 	(void)lock;
 #endif
 
+	/* select the fastest raid functions for the commands using them */
+	if (operation == OPERATION_SYNC
+		|| operation == OPERATION_SCRUB
+		|| operation == OPERATION_CHECK
+		|| operation == OPERATION_FIX
+	) {
+		state_tune(&state);
+	}
+
 	if (operation == OPERATION_DIFF) {
 		state_read(&state);
 
@@ -1345,7 +1682,7 @@ int main(int argc, char* argv[])
 		/* refresh the size info before the content write */
 		state_refresh(&state);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1394,7 +1731,7 @@ int main(int argc, char* argv[])
 		state_skip(&state);
 		state_filter(&state, &filterlist_file, &filterlist_disk, filter_missing, filter_error);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1414,16 +1751,20 @@ int main(int argc, char* argv[])
 	} else if (operation == OPERATION_SCRUB) {
 		state_read(&state);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
 
-		ret = state_scrub(&state, plan, olderthan);
+		if (opt.daemon) {
+			ret = daemon_scrub(&state, conf, command, &opt, &filterlist_disk, plan, olderthan, &lock);
+		} else {
+			ret = state_scrub(&state, plan, olderthan);
 
-		/* save the new state if required */
-		if (state.need_write || state.opt.force_content_write)
-			state_write(&state);
+			/* save the new state if required */
+			if (state.need_write || state.opt.force_content_write)
+				state_write(&state);
+		}
 
 		/* abort if required */
 		if (ret != 0) {
@@ -1439,11 +1780,11 @@ int main(int argc, char* argv[])
 
 		state_write(&state);
 
-		memory();
+		memory(&state);
 	} else if (operation == OPERATION_READ) {
 		state_read(&state);
 
-		memory();
+		memory(&state);
 	} else if (operation == OPERATION_TOUCH) {
 		state_read(&state);
 
@@ -1454,7 +1795,7 @@ int main(int argc, char* argv[])
 
 		state_write(&state);
 
-		memory();
+		memory(&state);
 	} else if (operation == OPERATION_SPINUP) {
 		state_device(&state, DEVICE_UP, &filterlist_disk);
 	} else if (operation == OPERATION_SPINDOWN) {
@@ -1466,7 +1807,7 @@ int main(int argc, char* argv[])
 	} else if (operation == OPERATION_STATUS) {
 		state_read(&state);
 
-		memory();
+		memory(&state);
 
 		state_status(&state);
 	} else if (operation == OPERATION_DUP) {
@@ -1501,7 +1842,7 @@ int main(int argc, char* argv[])
 		state_skip(&state);
 		state_filter(&state, &filterlist_file, &filterlist_disk, filter_missing, filter_error);
 
-		memory();
+		memory(&state);
 
 		/* intercept signals while operating */
 		signal_init();
@@ -1520,11 +1861,18 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	/* log the time spent by the disks of the model */
+	iomodel_close();
+
+	/* save the events traced */
+	trace_close();
+
 	/* close log file */
 	log_close(log_file);
 
 #if HAVE_LOCKFILE
-	if (!opt.skip_lock && state.lockfile[0]) {
+	/* the lock could be released if the daemon was interrupted while paused */
+	if (!opt.skip_lock && state.lockfile[0] && lock != -1) {
 		if (lock_unlock(lock) == -1) {
 			/* LCOV_EXCL_START */
 			log_fatal("Failed to close the lock file '%s'. %s.\n", state.lockfile, strerror(errno));
@@ -23,6 +23,7 @@
 
 void speed(int period);
 void selftest(void);
+void tune(unsigned diskmax, unsigned level, size_t block_size, int period);
 
 #endif
 
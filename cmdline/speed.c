@@ -83,6 +83,8 @@ void speed(int period)
 	int64_t dt;
 	int i, j;
 	unsigned char digest[HASH_MAX];
+	unsigned char digest_map[TEST_COUNT][HASH_MAX];
+	void* digest_vec[TEST_COUNT];
 	unsigned char seed[HASH_MAX];
 	int id[RAID_PARITY_MAX];
 	int ip[RAID_PARITY_MAX];
@@ -110,6 +112,10 @@ void speed(int period)
 	for (i = 0; i < HASH_MAX; ++i)
 		seed[i] = i;
 
+	/* hash output */
+	for (i = 0; i < nd; ++i)
+		digest_vec[i] = digest_map[i];
+
 	/* basic disks and parity mapping */
 	for (i = 0; i < RAID_PARITY_MAX; ++i) {
 		id[i] = i;
@@ -217,20 +223,11 @@ void speed(int period)
 	printf("%8s", "murmur3");
 	printf("%8s", "spooky2");
 	printf("%8s", "metro");
+	printf("%8s", "xxh3");
 	printf("\n");
 
 	printf("%8s", "hash");
-#ifdef CONFIG_X86
-	if (sizeof(void *) == 4 && !raid_cpu_has_slowmult())
-		printf("%8s", "murmur3");
-	else
-		printf("%8s", "spooky2");
-#else
-	if (sizeof(void *) == 4)
-		printf("%8s", "murmur3");
-	else
-		printf("%8s", "spooky2");
-#endif
+	printf("%8s", hash_config_name(hash_best()));
 	fflush(stdout);
 
 	SPEED_START {
@@ -254,6 +251,47 @@ void speed(int period)
 			memhash(HASH_METRO, seed, digest, v[j], size);
 	} SPEED_STOP
 
+	printf("%8" PRIu64, ds / dt);
+	fflush(stdout);
+
+	SPEED_START {
+		for (j = 0; j < nd; ++j)
+			memhash(HASH_XXH3, seed, digest, v[j], size);
+	} SPEED_STOP
+
+	printf("%8" PRIu64, ds / dt);
+	printf("\n");
+
+	/* all the disks together, like in 'sync' and 'scrub' */
+	printf("%8s", "vector");
+	printf("%8s", "");
+	fflush(stdout);
+
+	SPEED_START {
+		memhash_vec(HASH_MURMUR3, seed, digest_vec, v, nd, size);
+	} SPEED_STOP
+
+	printf("%8" PRIu64, ds / dt);
+	fflush(stdout);
+
+	SPEED_START {
+		memhash_vec(HASH_SPOOKY2, seed, digest_vec, v, nd, size);
+	} SPEED_STOP
+
+	printf("%8" PRIu64, ds / dt);
+	fflush(stdout);
+
+	SPEED_START {
+		memhash_vec(HASH_METRO, seed, digest_vec, v, nd, size);
+	} SPEED_STOP
+
+	printf("%8" PRIu64, ds / dt);
+	fflush(stdout);
+
+	SPEED_START {
+		memhash_vec(HASH_XXH3, seed, digest_vec, v, nd, size);
+	} SPEED_STOP
+
 	printf("%8" PRIu64, ds / dt);
 	printf("\n");
 	printf("\n");
@@ -715,6 +753,120 @@ void speed(int period)
 	printf("\n");
 	printf("\n");
 
+	/* compare table */
+	printf("RAID functions used for computing and comparing the parity with 'scrub':\n");
+	printf("%8s", "");
+	printf("%8s", "best");
+#ifdef CONFIG_X86
+	printf("%8s", "sse2");
+	printf("%8s", "sse2c");
+	printf("%8s", "avx2");
+	printf("%8s", "avx2c");
+#endif
+	printf("\n");
+
+	/* reference parity to compare */
+	raid_gen(nd, 2, size, v);
+	memcpy(v[nd + 2], v[nd], size);
+	memcpy(v[nd + 3], v[nd + 1], size);
+
+	/* GEN1 */
+	printf("%8s", "gen1");
+	printf("%8s", raid_gen_name(raid_genc_ptr[0]));
+	fflush(stdout);
+
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSE2
+	if (raid_cpu_has_sse2()) {
+		SPEED_START {
+			raid_gen1_sse2(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+
+		SPEED_START {
+			raid_gen1_sse2c(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_AVX2
+	if (raid_cpu_has_avx2()) {
+		SPEED_START {
+			raid_gen1_avx2(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+
+		SPEED_START {
+			raid_gen1_avx2c(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+#endif
+	printf("\n");
+
+	/* GEN2 */
+	printf("%8s", "gen2");
+	printf("%8s", raid_gen_name(raid_genc_ptr[1]));
+	fflush(stdout);
+
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSE2
+	if (raid_cpu_has_sse2()) {
+		SPEED_START {
+			raid_gen2_sse2(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+			side_effect += memcmp(v[nd + 1], v[nd + 3], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+
+		SPEED_START {
+			raid_gen2_sse2c(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+			side_effect += memcmp(v[nd + 1], v[nd + 3], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+
+#ifdef CONFIG_AVX2
+	if (raid_cpu_has_avx2()) {
+		SPEED_START {
+			raid_gen2_avx2(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+			side_effect += memcmp(v[nd + 1], v[nd + 3], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+
+		SPEED_START {
+			raid_gen2_avx2c(nd, size, v);
+			side_effect += memcmp(v[nd], v[nd + 2], size);
+			side_effect += memcmp(v[nd + 1], v[nd + 3], size);
+		} SPEED_STOP
+
+		printf("%8" PRIu64, ds / dt);
+		fflush(stdout);
+	}
+#endif
+#endif
+	printf("\n");
+	printf("\n");
+
 	/* recover table */
 	printf("RAID functions used for recovering with 'fix':\n");
 	printf("%8s", "");
@@ -949,6 +1101,19 @@ void speed(int period)
 	printf("\n");
 	printf("\n");
 
+	/* autotune */
+	printf("RAID functions selected by 'autotune' for %u disks of %u KiB:\n", nd, size / KIBI);
+	tune(nd, RAID_PARITY_MAX, size, period / 10 + 1);
+	printf("%8s", "gen");
+	for (i = 0; i < RAID_PARITY_MAX; ++i)
+		printf("%8s", raid_gen_name(raid_gen_ptr[i]));
+	printf("\n");
+	printf("%8s", "rec");
+	for (i = 0; i < RAID_PARITY_MAX; ++i)
+		printf("%8s", raid_rec_name(raid_rec_ptr[i]));
+	printf("\n");
+	printf("\n");
+
 	printf("If the 'best' expectations are wrong, please report it in the SnapRAID forum\n\n");
 
 	free(v_alloc);
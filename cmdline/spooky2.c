@@ -108,15 +108,50 @@
 //
 #define sc_const 0xdeadbeefdeadbeefLL
 
-void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t* digest)
+/*
+ * Tail and finalization.
+ *
+ * @h State after processing all the complete blocks.
+ * @end Data after the last complete block.
+ * @size_remainder Size of the data after the last complete block.
+ */
+static void SpookyHash128_end(const uint64_t* h, const void* end, size_t size_remainder, uint8_t* digest)
 {
 	uint64_t h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11;
 	uint64_t buf[sc_numVars];
+#if WORDS_BIGENDIAN
+	unsigned i;
+#endif
+
+	h0 = h[0]; h1 = h[1]; h2 = h[2]; h3 = h[3];
+	h4 = h[4]; h5 = h[5]; h6 = h[6]; h7 = h[7];
+	h8 = h[8]; h9 = h[9]; h10 = h[10]; h11 = h[11];
+
+	/* tail */
+	memcpy(buf, end, size_remainder);
+	memset(((uint8_t*)buf) + size_remainder, 0, sc_blockSize - size_remainder);
+	((uint8_t*)buf)[sc_blockSize - 1] = size_remainder;
+
+	/* finalization */
+#if WORDS_BIGENDIAN
+	for (i = 0; i < sc_numVars; ++i)
+		buf[i] = util_swap64(buf[i]);
+#endif
+	End(buf, h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11);
+
+	util_write64(digest + 0, h0);
+	util_write64(digest + 8, h1);
+}
+
+void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t* digest)
+{
+	uint64_t h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11;
+	uint64_t h[sc_numVars];
 	size_t nblocks;
 	const uint64_t* blocks;
 	const uint64_t* end;
-	size_t size_remainder;
 #if WORDS_BIGENDIAN
+	uint64_t buf[sc_numVars];
 	unsigned i;
 #endif
 
@@ -143,20 +178,128 @@ void SpookyHash128(const void* data, size_t size, const uint8_t* seed, uint8_t*
 		blocks += sc_numVars;
 	}
 
-	/* tail */
-	size_remainder = (size - ((const uint8_t*)end - (const uint8_t*)data));
-	memcpy(buf, end, size_remainder);
-	memset(((uint8_t*)buf) + size_remainder, 0, sc_blockSize - size_remainder);
-	((uint8_t*)buf)[sc_blockSize - 1] = size_remainder;
+	h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3;
+	h[4] = h4; h[5] = h5; h[6] = h6; h[7] = h7;
+	h[8] = h8; h[9] = h9; h[10] = h10; h[11] = h11;
 
-	/* finalization */
-#if WORDS_BIGENDIAN
-	for (i = 0; i < sc_numVars; ++i)
-		buf[i] = util_swap64(buf[i]);
-#endif
-	End(buf, h0, h1, h2, h3, h4, h5, h6, h7, h8, h9, h10, h11);
-
-	util_write64(digest + 0, h0);
-	util_write64(digest + 8, h1);
+	SpookyHash128_end(h, end, size - nblocks * sc_blockSize, digest);
 }
 
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX2)
+/*
+ * Pointer increment of each lane for every block.
+ */
+static const uint64_t spooky2_avx2_step[4] __aligned(32) = {
+	sc_blockSize, sc_blockSize, sc_blockSize, sc_blockSize
+};
+
+/*
+ * One step of Mix() for the word k, with state in ymm0-11.
+ *
+ * The word of the four lanes is gathered using the pointers in ymm12,
+ * ymm13 is used as gather mask, ymm14 and ymm15 as temporaries.
+ */
+#define SPOOKY2_AVX2_MIX(k, r, a, b, c, d) \
+	asm volatile ("vpcmpeqq %ymm13,%ymm13,%ymm13"); \
+	asm volatile ("vpgatherqq %%ymm13," #k "*8(,%%ymm12,1),%%ymm14" : : : "memory"); \
+	asm volatile ("vpaddq %ymm14,%ymm" #k ",%ymm" #k); \
+	asm volatile ("vpxor %ymm" #b ",%ymm" #a ",%ymm" #a); \
+	asm volatile ("vpxor %ymm" #k ",%ymm" #c ",%ymm" #c); \
+	SPOOKY2_AVX2_ROTL(k, r); \
+	asm volatile ("vpaddq %ymm" #d ",%ymm" #c ",%ymm" #c)
+
+/*
+ * Rotate left the qwords of a ymm register, using ymm15 as temporary.
+ */
+#define SPOOKY2_AVX2_ROTL(k, r) \
+	asm volatile ("vpsllq $" #r ",%ymm" #k ",%ymm15"); \
+	asm volatile ("vpsrlq $(64-" #r "),%ymm" #k ",%ymm" #k); \
+	asm volatile ("vpor %ymm15,%ymm" #k ",%ymm" #k)
+
+/*
+ * Computes the hash of 4 blocks of the same size in parallel.
+ *
+ * Each 64-bit lane of the ymm registers contains the state of a different block.
+ * The twelve words of the state use all the registers ymm0-11, and the data is
+ * loaded directly transposed with gathers, as there aren't enough free registers
+ * for a shuffle based transpose.
+ * The result is the same of calling SpookyHash128() for each block.
+ */
+void SpookyHash128_avx2x4(void** data, size_t size, const uint8_t* seed, void** digest)
+{
+	const uint8_t* v[4] __aligned(32);
+	uint64_t h[sc_numVars][4] __aligned(32);
+	uint64_t c = sc_const;
+	size_t nblocks;
+	size_t i;
+	int l;
+
+	for (l = 0; l < 4; ++l)
+		v[l] = data[l];
+
+	nblocks = size / sc_blockSize;
+
+	raid_avx_begin();
+
+	/* seed */
+	asm volatile ("vpbroadcastq %0,%%ymm9" : : "m" (seed[0]));
+	asm volatile ("vpbroadcastq %0,%%ymm10" : : "m" (seed[8]));
+	asm volatile ("vpbroadcastq %0,%%ymm11" : : "m" (c));
+	asm volatile ("vmovdqa %ymm9,%ymm0");
+	asm volatile ("vmovdqa %ymm9,%ymm3");
+	asm volatile ("vmovdqa %ymm9,%ymm6");
+	asm volatile ("vmovdqa %ymm10,%ymm1");
+	asm volatile ("vmovdqa %ymm10,%ymm4");
+	asm volatile ("vmovdqa %ymm10,%ymm7");
+	asm volatile ("vmovdqa %ymm11,%ymm2");
+	asm volatile ("vmovdqa %ymm11,%ymm5");
+	asm volatile ("vmovdqa %ymm11,%ymm8");
+
+	/* pointers of the lanes */
+	asm volatile ("vmovdqa %0,%%ymm12" : : "m" (v[0]));
+
+	/* body */
+	for (i = 0; i < nblocks; ++i) {
+		SPOOKY2_AVX2_MIX(0, 11, 2, 10, 11, 1);
+		SPOOKY2_AVX2_MIX(1, 32, 3, 11, 0, 2);
+		SPOOKY2_AVX2_MIX(2, 43, 4, 0, 1, 3);
+		SPOOKY2_AVX2_MIX(3, 31, 5, 1, 2, 4);
+		SPOOKY2_AVX2_MIX(4, 17, 6, 2, 3, 5);
+		SPOOKY2_AVX2_MIX(5, 28, 7, 3, 4, 6);
+		SPOOKY2_AVX2_MIX(6, 39, 8, 4, 5, 7);
+		SPOOKY2_AVX2_MIX(7, 57, 9, 5, 6, 8);
+		SPOOKY2_AVX2_MIX(8, 55, 10, 6, 7, 9);
+		SPOOKY2_AVX2_MIX(9, 54, 11, 7, 8, 10);
+		SPOOKY2_AVX2_MIX(10, 22, 0, 8, 9, 11);
+		SPOOKY2_AVX2_MIX(11, 46, 1, 9, 10, 0);
+
+		asm volatile ("vpaddq %0,%%ymm12,%%ymm12" : : "m" (spooky2_avx2_step[0]));
+	}
+
+	/* get the state of all the lanes */
+	asm volatile ("vmovdqa %%ymm0,%0" : "=m" (h[0]));
+	asm volatile ("vmovdqa %%ymm1,%0" : "=m" (h[1]));
+	asm volatile ("vmovdqa %%ymm2,%0" : "=m" (h[2]));
+	asm volatile ("vmovdqa %%ymm3,%0" : "=m" (h[3]));
+	asm volatile ("vmovdqa %%ymm4,%0" : "=m" (h[4]));
+	asm volatile ("vmovdqa %%ymm5,%0" : "=m" (h[5]));
+	asm volatile ("vmovdqa %%ymm6,%0" : "=m" (h[6]));
+	asm volatile ("vmovdqa %%ymm7,%0" : "=m" (h[7]));
+	asm volatile ("vmovdqa %%ymm8,%0" : "=m" (h[8]));
+	asm volatile ("vmovdqa %%ymm9,%0" : "=m" (h[9]));
+	asm volatile ("vmovdqa %%ymm10,%0" : "=m" (h[10]));
+	asm volatile ("vmovdqa %%ymm11,%0" : "=m" (h[11]));
+
+	raid_avx_end();
+
+	for (l = 0; l < 4; ++l) {
+		uint64_t s[sc_numVars];
+		unsigned j;
+
+		for (j = 0; j < sc_numVars; ++j)
+			s[j] = h[j][l];
+
+		SpookyHash128_end(s, v[l] + nblocks * sc_blockSize, size - nblocks * sc_blockSize, digest[l]);
+	}
+}
+#endif
@@ -24,6 +24,7 @@
 #include "support.h"
 #include "parity.h"
 #include "stream.h"
+#include "trace.h"
 #include "handle.h"
 #include "io.h"
 #include "raid/raid.h"
@@ -139,6 +140,7 @@ void state_init(struct snapraid_state* state)
 	memset(&state->opt, 0, sizeof(state->opt));
 	state->filter_hidden = 0;
 	state->autosave = 0;
+	state->memory_limit = 0;
 	state->need_write = 0;
 	state->checked_read = 0;
 	state->block_size = 256 * KIBI; /* default 256 KiB */
@@ -146,6 +148,8 @@ void state_init(struct snapraid_state* state)
 	state->file_mode = ADVISE_DEFAULT;
 	for (l = 0; l < LEV_MAX; ++l) {
 		state->parity[l].split_mac = 0;
+		state->parity[l].stripe = 0;
+		state->parity[l].sum[0] = 0;
 		for (s = 0; s < SPLIT_MAX; ++s) {
 			state->parity[l].split_map[s].path[0] = 0;
 			state->parity[l].split_map[s].uuid[0] = 0;
@@ -158,6 +162,9 @@ void state_init(struct snapraid_state* state)
 		state->parity[l].skip_access = 0;
 		state->parity[l].tick = 0;
 		state->parity[l].cached_blocks = 0;
+		memset(state->parity[l].access_latency, 0, sizeof(state->parity[l].access_latency));
+		state->parity[l].access_tick = 0;
+		state->parity[l].access_size = 0;
 		state->parity[l].is_excluded_by_filter = 0;
 	}
 	state->tick_io = 0;
@@ -166,10 +173,16 @@ void state_init(struct snapraid_state* state)
 	state->tick_raid = 0;
 	state->tick_hash = 0;
 	state->tick_last = tick();
+	state->telemetry[0] = 0;
+	state->telemetry_time = 0;
 	state->share[0] = 0;
 	state->pool[0] = 0;
 	state->pool_device = 0;
 	state->lockfile[0] = 0;
+	state->tunefile[0] = 0;
+	state->autotune = 0;
+	state->paritysum = 0;
+	state->affinity = 0;
 	state->level = 1; /* default is the lowest protection */
 	state->clear_past_hash = 0;
 	state->no_conf = 0;
@@ -226,6 +239,15 @@ static void state_config_check(struct snapraid_state* state, const char* path, t
 		}
 	}
 
+	for (l = state->level; l < LEV_MAX; ++l) {
+		if (state->parity[l].stripe) {
+			/* LCOV_EXCL_START */
+			log_fatal("Missing '%s' specification for 'stripe' in '%s'\n", lev_config_name(l), path);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	if (tommy_list_empty(&state->contentlist)) {
 		/* LCOV_EXCL_START */
 		log_fatal("Missing 'content' specification in '%s'\n", path);
@@ -877,6 +899,8 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 			if (state->lockfile[0] == 0 && dev != 0) {
 				pathcpy(state->lockfile, sizeof(state->lockfile), buffer);
 				pathcat(state->lockfile, sizeof(state->lockfile), ".lock");
+				pathcpy(state->tunefile, sizeof(state->tunefile), buffer);
+				pathcat(state->tunefile, sizeof(state->tunefile), ".tune");
 			}
 
 			content = content_alloc(buffer, dev);
@@ -1065,6 +1089,60 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 			}
 		} else if (strcmp(tag, "nohidden") == 0) {
 			state->filter_hidden = 1;
+		} else if (strcmp(tag, "autotune") == 0) {
+			state->autotune = 1;
+		} else if (strcmp(tag, "paritysum") == 0) {
+			state->paritysum = 1;
+		} else if (strcmp(tag, "affinity") == 0) {
+			state->affinity = 1;
+		} else if (strcmp(tag, "telemetry") == 0) {
+			if (*state->telemetry) {
+				/* LCOV_EXCL_START */
+				log_fatal("Multiple 'telemetry' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			ret = sgetlasttok(f, buffer, sizeof(buffer));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'telemetry' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (!*buffer) {
+				/* LCOV_EXCL_START */
+				log_fatal("Empty 'telemetry' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			pathimport(state->telemetry, sizeof(state->telemetry), buffer);
+		} else if (strcmp(tag, "stripe") == 0) {
+			ret = sgetlasttok(f, buffer, sizeof(buffer));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'stripe' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (lev_config_scan(buffer, &level, 0) != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'stripe' parity '%s' in '%s' at line %u\n", buffer, path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (state->parity[level].stripe) {
+				/* LCOV_EXCL_START */
+				log_fatal("Multiple 'stripe' specification for '%s' in '%s' at line %u\n", buffer, path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			state->parity[level].stripe = 1;
 		} else if (strcmp(tag, "exclude") == 0) {
 			struct snapraid_filter* filter;
 
@@ -1148,6 +1226,35 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 
 			/* convert to GB */
 			state->autosave *= GIGA;
+		} else if (strcmp(tag, "memorylimit") == 0) {
+			char* e;
+
+			ret = sgetlasttok(f, buffer, sizeof(buffer));
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'memorylimit' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (!*buffer) {
+				/* LCOV_EXCL_START */
+				log_fatal("Empty 'memorylimit' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			state->memory_limit = strtoul(buffer, &e, 0);
+
+			if (!e || *e || state->memory_limit == 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Invalid 'memorylimit' specification in '%s' at line %u\n", path, line);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* convert to MiB */
+			state->memory_limit *= MEBI;
 		} else if (tag[0] == 0) {
 			/* allow empty lines */
 		} else if (tag[0] == '#') {
@@ -1193,28 +1300,28 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 
 	state_config_check(state, path, filterlist_disk);
 
+	/* the parity checksums are stored after the first split of each parity */
+	if (state->paritysum) {
+		for (l = 0; l < state->level; ++l)
+			pathprint(state->parity[l].sum, sizeof(state->parity[l].sum), "%s.sum", state->parity[l].split_map[0].path);
+	}
+
 	/* select the default hash */
 	if (state->opt.force_murmur3) {
 		state->besthash = HASH_MURMUR3;
 	} else if (state->opt.force_spooky2) {
 		state->besthash = HASH_SPOOKY2;
+	} else if (state->opt.force_xxh3) {
+		state->besthash = HASH_XXH3;
 	} else {
-#ifdef CONFIG_X86
-		if (sizeof(void*) == 4 && !raid_cpu_has_slowmult())
-			state->besthash = HASH_MURMUR3;
-		else
-			state->besthash = HASH_SPOOKY2;
-#else
-		if (sizeof(void*) == 4)
-			state->besthash = HASH_MURMUR3;
-		else
-			state->besthash = HASH_SPOOKY2;
-#endif
+		state->besthash = hash_best();
 	}
 
 	/* by default use the best hash */
 	state->hash = state->besthash;
 
+	log_tag("hash:best:%s\n", hash_config_name(state->besthash));
+
 	/* by default use a random hash seed */
 	if (randomize(state->hashseed, HASH_MAX) != 0) {
 		/* LCOV_EXCL_START */
@@ -1235,15 +1342,28 @@ void state_config(struct snapraid_state* state, const char* path, const char* co
 	}
 
 	log_tag("mode:%s\n", lev_raid_name(state->raid_mode, state->level));
-	for (l = 0; l < state->level; ++l)
+	for (l = 0; l < state->level; ++l) {
 		for (s = 0; s < state->parity[l].split_mac; ++s)
 			log_tag("%s:%u:%s\n", lev_config_name(l), s, state->parity[l].split_map[s].path);
+		if (state->parity[l].stripe)
+			log_tag("stripe:%s\n", lev_config_name(l));
+	}
 	if (state->pool[0] != 0)
 		log_tag("pool:%s\n", state->pool);
 	if (state->share[0] != 0)
 		log_tag("share:%s\n", state->share);
 	if (state->autosave != 0)
 		log_tag("autosave:%" PRIu64 "\n", state->autosave);
+	if (state->memory_limit != 0)
+		log_tag("memorylimit:%" PRIu64 "\n", state->memory_limit);
+	if (state->autotune)
+		log_tag("autotune:\n");
+	if (state->paritysum)
+		log_tag("paritysum:\n");
+	if (state->affinity)
+		log_tag("affinity:\n");
+	if (state->telemetry[0])
+		log_tag("telemetry:%s\n", state->telemetry);
 	for (i = tommy_list_head(&state->filterlist); i != 0; i = i->next) {
 		char out[PATH_MAX];
 		struct snapraid_filter* filter = i->data;
@@ -1581,6 +1701,18 @@ void state_refresh(struct snapraid_state* state)
 				/* LCOV_EXCL_STOP */
 			}
 
+			/* with striping, the smallest split limits all the others */
+			if (state->parity[l].stripe) {
+				block_off_t total_blocks = total_space / state->block_size * state->parity[l].split_mac;
+				block_off_t free_blocks = free_space / state->block_size * state->parity[l].split_mac;
+
+				if (s == 0 || state->parity[l].total_blocks > total_blocks)
+					state->parity[l].total_blocks = total_blocks;
+				if (s == 0 || state->parity[l].free_blocks > free_blocks)
+					state->parity[l].free_blocks = free_blocks;
+				continue;
+			}
+
 			/* add the new free blocks */
 			state->parity[l].total_blocks += total_space / state->block_size;
 			state->parity[l].free_blocks += free_space / state->block_size;
@@ -1762,6 +1894,14 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 	int ret;
 	tommy_array disk_mapping;
 	uint32_t mapping_max;
+	int stripe_map[LEV_MAX];
+	unsigned split_mac_map[LEV_MAX];
+	unsigned l;
+
+	for (l = 0; l < LEV_MAX; ++l) {
+		stripe_map[l] = 0;
+		split_mac_map[l] = 0;
+	}
 
 	blockmax = 0;
 	count_file = 0;
@@ -1790,6 +1930,8 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 	 *  - SNAPCNT3/SnapRAID 11.0 Adds entry 'y' for hash size.
 	 *  - SNAPCNT3/SnapRAID 11.0 Adds entry 'Q' for multi parity file.
 	 *    The previous 'P' entry is now deprecated, but supported for importing.
+	 *  - SNAPCNT3/SnapRAID 13.0 Adds entry 'T' for striped parity files.
+	 *    It's present only for striped parities, to keep the compatibility.
 	 */
 	if (memcmp(buffer, "SNAPCNT1\n\3\0\0", 12) != 0
 		&& memcmp(buffer, "SNAPCNT2\n\3\0\0", 12) != 0
@@ -2406,6 +2548,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 			case 'm' :
 				state->hash = HASH_METRO;
 				break;
+			case 'x' :
+				state->hash = HASH_XXH3;
+				break;
 			default :
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2436,6 +2581,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 			case 'm' :
 				state->prevhash = HASH_METRO;
 				break;
+			case 'x' :
+				state->prevhash = HASH_XXH3;
+				break;
 			default :
 				/* LCOV_EXCL_START */
 				decoding_error(path, f);
@@ -2738,6 +2886,9 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 				state->parity[v_level].free_blocks = v_free_blocks;
 			}
 
+			/* the number of files is checked later for striped parities */
+			split_mac_map[v_level] = v_split_mac;
+
 			for (s = 0; s < v_split_mac; ++s) {
 				char v_path[PATH_MAX];
 				char v_uuid[UUID_MAX];
@@ -2800,6 +2951,31 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 					}
 				}
 			}
+		} else if (c == 'T') {
+			/* from SnapRAID 13.0 the 'T' command marks the parity as striped */
+			uint32_t v_level;
+
+			ret = sgetb32(f, &v_level);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				os_abort();
+				/* LCOV_EXCL_STOP */
+			}
+
+			if (v_level >= LEV_MAX) {
+				/* LCOV_EXCL_START */
+				decoding_error(path, f);
+				log_fatal("Invalid parity level '%u' in the configuration file!\n", v_level);
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* auto configure if configuration is missing */
+			if (state->no_conf)
+				state->parity[v_level].stripe = 1;
+
+			stripe_map[v_level] = 1;
 		} else if (c == 'N') {
 			uint32_t crc_stored;
 			uint32_t crc_computed;
@@ -2838,6 +3014,51 @@ static void state_read_content(struct snapraid_state* state, const char* path, S
 
 	tommy_array_done(&disk_mapping);
 
+	/* the layout of the parity files can be changed only if they are still empty */
+	for (l = 0; l < state->level; ++l) {
+		unsigned s;
+
+		if (stripe_map[l] == state->parity[l].stripe)
+			continue;
+
+		for (s = 0; s < state->parity[l].split_mac; ++s) {
+			if (state->parity[l].split_map[s].size != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Mismatching 'stripe' specification for '%s' in the content file!\n", lev_config_name(l));
+				if (stripe_map[l])
+					log_fatal("Please restore the 'stripe %s' option in the configuration file\n", lev_config_name(l));
+				else
+					log_fatal("Please remove the 'stripe %s' option from the configuration file\n", lev_config_name(l));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
+	/* the number of files of a striped parity defines the position of the blocks, */
+	/* so it can be changed only if they are still empty */
+	for (l = 0; l < state->level; ++l) {
+		unsigned s;
+
+		if (!stripe_map[l] || !state->parity[l].stripe)
+			continue;
+
+		if (split_mac_map[l] == state->parity[l].split_mac)
+			continue;
+
+		for (s = 0; s < state->parity[l].split_mac; ++s) {
+			if (state->parity[l].split_map[s].size != 0) {
+				/* LCOV_EXCL_START */
+				log_fatal("Mismatching number of files for the striped '%s' in the content file!\n", lev_config_name(l));
+				log_fatal("The content file has %u files, but the configuration file has %u.\n", split_mac_map[l], state->parity[l].split_mac);
+				log_fatal("The files of a striped parity cannot be changed after the first sync.\n");
+				log_fatal("Please restore the previous '%s' files in the configuration file\n", lev_config_name(l));
+				exit(EXIT_FAILURE);
+				/* LCOV_EXCL_STOP */
+			}
+		}
+	}
+
 	if (serror(f)) {
 		/* LCOV_EXCL_START */
 		log_fatal("Error reading the content file '%s' at offset %" PRIi64 "\n", path, stell(f));
@@ -2960,6 +3181,8 @@ static void* state_write_thread(void* arg)
 		sputc('k', f);
 	} else if (state->hash == HASH_METRO) {
 		sputc('m', f);
+	} else if (state->hash == HASH_XXH3) {
+		sputc('x', f);
 	} else {
 		/* LCOV_EXCL_START */
 		log_fatal("Unexpected hash when writing the content file '%s'.\n", serrorfile(f));
@@ -2985,6 +3208,8 @@ static void* state_write_thread(void* arg)
 				sputc('k', f);
 			} else if (state->prevhash == HASH_METRO) {
 				sputc('m', f);
+			} else if (state->prevhash == HASH_XXH3) {
+				sputc('x', f);
 			} else {
 				/* LCOV_EXCL_START */
 				log_fatal("Unexpected prevhash when writing the content file '%s'.\n", serrorfile(f));
@@ -3045,6 +3270,10 @@ static void* state_write_thread(void* arg)
 				sputbs(state->parity[l].split_map[s].uuid, f);
 				sputb64(state->parity[l].split_map[s].size, f);
 			}
+			if (state->parity[l].stripe) {
+				sputc('T', f);
+				sputb32(l, f);
+			}
 		} else {
 			sputc('P', f);
 			sputb32(l, f);
@@ -4231,6 +4460,8 @@ int state_progress_begin(struct snapraid_state* state, block_off_t blockstart, b
 
 void state_progress_end(struct snapraid_state* state, block_off_t countpos, block_off_t countmax, data_off_t countsize)
 {
+	state_telemetry(state, countpos, countmax, countsize, 1);
+
 	if (state->opt.gui) {
 		log_tag("run:end\n");
 		log_flush();
@@ -4496,6 +4727,10 @@ int state_progress(struct snapraid_state* state, struct snapraid_io* io, block_o
 		state->progress_size[state->progress_ptr] = countsize;
 		state_progress_latest(state);
 
+		state_telemetry(state, countpos, countmax, countsize, 0);
+
+		trace_counter(trace_main, "progress", tick(), countpos);
+
 		elapsed = now - state->progress_whole_start - state->progress_wasted;
 
 		/* completion percentage */
@@ -4636,6 +4871,8 @@ void state_usage_misc(struct snapraid_state* state)
 	/* increment the time spent in computations */
 	state->tick_misc += delta;
 
+	trace_span(trace_main, "misc", state->tick_last, now, 0);
+
 	state->tick_last = now;
 }
 
@@ -4647,6 +4884,8 @@ void state_usage_sched(struct snapraid_state* state)
 	/* increment the time spent in computations */
 	state->tick_sched += delta;
 
+	trace_span(trace_main, "sched", state->tick_last, now, 0);
+
 	state->tick_last = now;
 }
 
@@ -4658,6 +4897,8 @@ void state_usage_raid(struct snapraid_state* state)
 	/* increment the time spent in computations */
 	state->tick_raid += delta;
 
+	trace_span(trace_main, "raid", state->tick_last, now, 0);
+
 	state->tick_last = now;
 }
 
@@ -4669,6 +4910,8 @@ void state_usage_hash(struct snapraid_state* state)
 	/* increment the time spent in computations */
 	state->tick_hash += delta;
 
+	trace_span(trace_main, "hash", state->tick_last, now, 0);
+
 	state->tick_last = now;
 }
 
@@ -4696,6 +4939,8 @@ void state_usage_disk(struct snapraid_state* state, struct snapraid_handle* hand
 	}
 	state->tick_io += delta;
 
+	trace_span(trace_main, "wait data", state->tick_last, now, 0);
+
 	state->tick_last = now;
 }
 
@@ -4710,6 +4955,8 @@ void state_usage_parity(struct snapraid_state* state, unsigned* waiting_map, uns
 		state->parity[waiting_map[i]].tick += delta;
 	state->tick_io += delta;
 
+	trace_span(trace_main, "wait parity", state->tick_last, now, 0);
+
 	state->tick_last = now;
 }
 
@@ -4742,6 +4989,51 @@ void state_fscheck(struct snapraid_state* state, const char* ope)
 	}
 }
 
+/**
+ * Memory required to write the content files.
+ */
+static uint64_t state_memory_stream(struct snapraid_state* state)
+{
+	return (uint64_t)STREAM_SIZE * tommy_list_count(&state->contentlist);
+}
+
+uint64_t state_memory_available(struct snapraid_state* state)
+{
+	uint64_t used;
+
+	if (state->memory_limit == 0)
+		return UINT64_MAX;
+
+	used = malloc_counter_get() + state_memory_stream(state);
+	if (used >= state->memory_limit)
+		return 0;
+
+	return state->memory_limit - used;
+}
+
+void state_memory_check(struct snapraid_state* state, const char* buffer_desc, uint64_t buffer_size)
+{
+	uint64_t used;
+	uint64_t stream;
+
+	if (state->memory_limit == 0)
+		return;
+
+	used = malloc_counter_get();
+	stream = state_memory_stream(state);
+
+	if (used + stream + buffer_size <= state->memory_limit)
+		return;
+
+	log_fatal("The memory required exceeds the 'memorylimit' of %" PRIu64 " MiB:\n", state->memory_limit / MEBI);
+	log_fatal("%8.1f MiB already allocated, mainly for the files\n", (double)used / MEBI);
+	log_fatal("%8.1f MiB for writing the content files\n", (double)stream / MEBI);
+	if (buffer_size != 0)
+		log_fatal("%8.1f MiB for %s\n", (double)buffer_size / MEBI, buffer_desc);
+	log_fatal("Increase the 'memorylimit' option, or use a bigger 'blocksize' to reduce the state.\n");
+	exit(EXIT_FAILURE);
+}
+
 void generate_configuration(const char* path)
 {
 	struct snapraid_state state;
@@ -41,6 +41,11 @@ const char* lev_name(unsigned level);
  */
 const char* lev_config_name(unsigned level);
 
+/**
+ * Return the raid mode name: par1, par2, par3, parz, par4, par5, par6.
+ */
+const char* lev_raid_name(unsigned mode, unsigned n);
+
 /****************************************************************************/
 /* state */
 
@@ -66,6 +71,11 @@ extern volatile int global_interrupt;
 #define SORT_ALPHA 3 /**< Sort by alphabetic order. */
 #define SORT_DIR 4 /**< Sort by directory order. */
 
+/**
+ * Max number of threads used to repair in check and fix.
+ */
+#define REPAIR_THREAD_MAX 16
+
 /**
  * Options set only at startup.
  * For all these options a value of 0 means nothing set, and to use the default.
@@ -73,6 +83,7 @@ extern volatile int global_interrupt;
 struct snapraid_option {
 	int gui; /**< Gui output. */
 	int auditonly; /**< In check, checks only the hash and not the parity. */
+	int parityonly; /**< In scrub, checks only the parity with its checksums. */
 	int badfileonly; /**< In fix, fixes only files marked as bad. */
 	int badblockonly; /**< In fix, fixes only the blocks marked as bad. */
 	int syncedonly; /**< In fix, fixes only files that are synced. */
@@ -101,6 +112,7 @@ struct snapraid_option {
 	int kill_after_sync; /**< Kill the process after sync without saving the final state. */
 	int force_murmur3; /**< Force Murmur3 choice. */
 	int force_spooky2; /**< Force Spooky2 choice. */
+	int force_xxh3; /**< Force XXH3 choice. */
 	int force_order; /**< Force sorting order. One of the SORT_* defines. */
 	unsigned force_scrub_at; /**< Force scrub for the specified number of blocks. */
 	int force_scrub_even; /**< Force scrub of all the even blocks. */
@@ -120,12 +132,19 @@ struct snapraid_option {
 	int force_stats; /**< Force stats print during process. */
 	uint64_t parity_limit_size; /**< Test limit for parity files. */
 	int skip_multi_scan; /**< Don't use threads in scan. */
+	uint64_t rate_limit; /**< Max read rate in bytes per second. 0 for no limit. */
+	unsigned time_limit; /**< Max time of the process in seconds. 0 for no limit. */
+	unsigned io_depth; /**< Max number of blocks read ahead for each disk. 0 for no limit. */
+	int daemon; /**< Scrub continuously in daemon mode. */
+	unsigned daemon_cycles; /**< Number of scrub cycles in daemon mode. 0 for no limit. */
+	unsigned repair_thread; /**< Number of threads used to repair in check and fix. 0 for default. */
 };
 
 struct snapraid_state {
 	struct snapraid_option opt; /**< Setup options. */
 	int filter_hidden; /**< Filter out hidden files. */
 	uint64_t autosave; /**< Autosave after the specified amount of data. 0 to disable. */
+	uint64_t memory_limit; /**< Max memory to use in bytes. 0 for no limit. */
 	int need_write; /**< If the state is changed. */
 	int checked_read; /**< If the state was read and checked. */
 	uint32_t block_size; /**< Block size in bytes. */
@@ -138,6 +157,10 @@ struct snapraid_state {
 	unsigned char hashseed[HASH_MAX]; /**< Hash seed. Just after a uint64 to provide a minimal alignment. */
 	unsigned char prevhashseed[HASH_MAX]; /**< Previous hash seed. In case of rehash. */
 	char lockfile[PATH_MAX]; /**< Path of the lock file to use. */
+	char tunefile[PATH_MAX]; /**< Path of the tune file to use. */
+	int autotune; /**< Select the RAID functions measuring their speed. */
+	int paritysum; /**< Store the checksum of each parity block. */
+	int affinity; /**< Run the disk threads in the NUMA node of their controller. */
 	unsigned level; /**< Number of parity levels. 1 for PAR1, 2 for PAR2. */
 	unsigned hash; /**< Hash kind used. */
 	unsigned prevhash; /**< Previous hash kind used.  In case of rehash. */
@@ -171,6 +194,9 @@ struct snapraid_state {
 	 */
 	uint64_t tick_last;
 
+	char telemetry[PATH_MAX]; /**< Path of the telemetry file. Empty if not used. */
+	time_t telemetry_time; /**< Time of the latest telemetry written. */
+
 	int clear_past_hash; /**< Clear all the hash from CHG and DELETED blocks when reading the state from an incomplete sync. */
 
 	time_t progress_whole_start; /**< Initial start of the whole process. */
@@ -258,6 +284,17 @@ void state_dry(struct snapraid_state* state, block_off_t blockstart, block_off_t
  */
 void state_rehash(struct snapraid_state* state);
 
+/**
+ * Select the fastest RAID functions for the array.
+ */
+void state_tune(struct snapraid_state* state);
+
+/**
+ * Write the telemetry file with the time used by each stage and disk.
+ * It's written only if the telemetry period is elapsed, or if forced.
+ */
+void state_telemetry(struct snapraid_state* state, block_off_t countpos, block_off_t countmax, data_off_t countsize, int force);
+
 /**
  * Scrub levels.
  */
@@ -375,6 +412,21 @@ void state_usage_print(struct snapraid_state* state);
  */
 void state_fscheck(struct snapraid_state* state, const char* ope);
 
+/**
+ * Memory still available with the 'memorylimit' option.
+ * The memory already allocated and the one required to write the content
+ * files are not available.
+ * Return UINT64_MAX if there is no limit.
+ */
+uint64_t state_memory_available(struct snapraid_state* state);
+
+/**
+ * Check that the memory allocated, plus the specified buffers still to
+ * allocate, is in the 'memorylimit' option.
+ * On error it aborts, reporting where the memory is used.
+ */
+void state_memory_check(struct snapraid_state* state, const char* buffer_desc, uint64_t buffer_size);
+
 /****************************************************************************/
 /* misc */
 
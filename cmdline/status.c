@@ -48,7 +48,8 @@ int state_status(struct snapraid_state* state)
 {
 	block_off_t blockmax;
 	block_off_t i;
-	time_t* timemap;
+	struct snapraid_timehist timehist;
+	tommy_node* node_time;
 	time_t now;
 	block_off_t bad;
 	block_off_t bad_first;
@@ -59,7 +60,6 @@ int state_status(struct snapraid_state* state)
 	unsigned dayoldest, daymedian, daynewest;
 	unsigned bar_scrubbed[GRAPH_COLUMN];
 	unsigned bar_new[GRAPH_COLUMN];
-	unsigned barpos;
 	unsigned barmax;
 	time_t oldest, newest, median;
 	unsigned x, y;
@@ -278,12 +278,11 @@ int state_status(struct snapraid_state* state)
 	log_tag("summary:best_hash:%s\n", hash_config_name(state->besthash));
 	log_flush();
 
-	/* copy the info a temp vector, and count bad/rehash/unsynced blocks */
-	timemap = malloc_nofail(blockmax * sizeof(time_t));
+	/* count the blocks for each time, and count bad/rehash/unsynced blocks */
+	timehist_init(&timehist);
 	bad = 0;
 	bad_first = 0;
 	bad_last = 0;
-	count = 0;
 	rehash = 0;
 	unsynced_blocks = 0;
 	unscrubbed_blocks = 0;
@@ -335,7 +334,7 @@ int state_status(struct snapraid_state* state)
 				scrub_time |= TIME_NEW;
 			}
 
-			timemap[count++] = scrub_time;
+			timehist_insert(&timehist, scrub_time);
 		}
 
 		if (state->opt.gui) {
@@ -352,39 +351,36 @@ int state_status(struct snapraid_state* state)
 	log_tag("summary:has_bad:%u:%u:%u\n", bad, bad_first, bad_last);
 	log_flush();
 
+	count = timehist.count;
 	if (!count) {
 		log_fatal("The array is empty.\n");
-		free(timemap);
+		timehist_done(&timehist);
 		return 0;
 	}
 
 	/* sort the info to get the time info */
-	qsort(timemap, count, sizeof(time_t), time_compare);
+	timehist_sort(&timehist);
 
 	/* output the info map */
-	i = 0;
 	log_tag("info_count:%u\n", count);
-	while (i < count) {
-		unsigned j = i + 1;
-		while (j < count && timemap[i] == timemap[j])
-			++j;
-		if ((timemap[i] & TIME_NEW) == 0) {
-			log_tag("info_time:%" PRIu64 ":%u:scrubbed\n", (uint64_t)timemap[i], j - i);
+	for (node_time = tommy_list_head(&timehist.list); node_time != 0; node_time = node_time->next) {
+		struct snapraid_timecount* entry = node_time->data;
+		if ((entry->time & TIME_NEW) == 0) {
+			log_tag("info_time:%" PRIu64 ":%u:scrubbed\n", (uint64_t)entry->time, entry->count);
 		} else {
-			log_tag("info_time:%" PRIu64 ":%u:new\n", (uint64_t)(timemap[i] & ~TIME_NEW), j - i);
+			log_tag("info_time:%" PRIu64 ":%u:new\n", (uint64_t)(entry->time & ~TIME_NEW), entry->count);
 		}
-		i = j;
 	}
 
-	oldest = timemap[0];
-	median = timemap[count / 2];
-	newest = timemap[count - 1];
+	oldest = timehist_rank(&timehist, 0);
+	median = timehist_rank(&timehist, count / 2);
+	newest = timehist_rank(&timehist, count - 1);
 	dayoldest = day_ago(oldest, now);
 	daymedian = day_ago(median, now);
 	daynewest = day_ago(newest, now);
 
 	/* compute graph limits */
-	barpos = 0;
+	node_time = tommy_list_head(&timehist.list);
 	barmax = 0;
 	for (i = 0; i < GRAPH_COLUMN; ++i) {
 		time_t limit;
@@ -394,12 +390,13 @@ int state_status(struct snapraid_state* state)
 
 		step_scrubbed = 0;
 		step_new = 0;
-		while (barpos < count && timemap[barpos] <= limit) {
-			if ((timemap[barpos] & TIME_NEW) != 0)
-				++step_new;
+		while (node_time != 0 && ((struct snapraid_timecount*)node_time->data)->time <= limit) {
+			struct snapraid_timecount* entry = node_time->data;
+			if ((entry->time & TIME_NEW) != 0)
+				step_new += entry->count;
 			else
-				++step_scrubbed;
-			++barpos;
+				step_scrubbed += entry->count;
+			node_time = node_time->next;
 		}
 
 		if (step_new + step_scrubbed > barmax)
@@ -524,7 +521,7 @@ int state_status(struct snapraid_state* state)
 	}
 
 	/* free the temp vector */
-	free(timemap);
+	timehist_done(&timehist);
 
 	return 0;
 }
@@ -183,6 +183,72 @@ void log_flush(void)
 	unlock_msg();
 }
 
+void logbuf_init(struct snapraid_logbuf* logbuf)
+{
+	logbuf->data = 0;
+	logbuf->len = 0;
+	logbuf->size = 0;
+}
+
+void logbuf_done(struct snapraid_logbuf* logbuf)
+{
+	free(logbuf->data);
+}
+
+void logbuf_tag(struct snapraid_logbuf* logbuf, const char* format, ...)
+{
+	va_list ap;
+	int ret;
+
+	/* without a log file, the messages are lost anyway */
+	if (!stdlog)
+		return;
+
+	while (1) {
+		char* data;
+
+		if (logbuf->size - logbuf->len > 1) {
+			va_start(ap, format);
+			ret = vsnprintf(logbuf->data + logbuf->len, logbuf->size - logbuf->len, format, ap);
+			va_end(ap);
+			if (ret < 0) {
+				/* LCOV_EXCL_START */
+				return;
+				/* LCOV_EXCL_STOP */
+			}
+
+			/* if it fits, we are done */
+			if ((size_t)ret < logbuf->size - logbuf->len) {
+				logbuf->len += ret;
+				return;
+			}
+		}
+
+		/* grow the buffer, and retry */
+		data = malloc_nofail(2 * logbuf->size + 256);
+		if (logbuf->len != 0)
+			memcpy(data, logbuf->data, logbuf->len);
+		free(logbuf->data);
+		logbuf->data = data;
+		logbuf->size = 2 * logbuf->size + 256;
+	}
+}
+
+void logbuf_flush(struct snapraid_logbuf* logbuf)
+{
+	if (logbuf->len == 0)
+		return;
+
+	lock_msg();
+
+	if (stdlog)
+		fwrite(logbuf->data, logbuf->len, 1, stdlog);
+
+	unlock_msg();
+
+	logbuf->len = 0;
+}
+
 void msg_status(const char* format, ...)
 {
 	va_list ap;
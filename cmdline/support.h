@@ -111,6 +111,33 @@ void log_flush(void);
  */
 typedef void fptr(const char* format, ...) __attribute__((format(attribute_printf, 1, 2)));
 
+/**
+ * Buffer of tag messages.
+ *
+ * Used by threads to collect their tag messages, and to write
+ * them in the log file all together, and in the expected order.
+ */
+struct snapraid_logbuf {
+	char* data; /**< Collected messages. */
+	size_t len; /**< Used size. */
+	size_t size; /**< Allocated size. */
+};
+
+void logbuf_init(struct snapraid_logbuf* logbuf);
+void logbuf_done(struct snapraid_logbuf* logbuf);
+
+/**
+ * Tag messages collected in the buffer.
+ *
+ * Like log_tag(), the messages are lost if there is no log file.
+ */
+void logbuf_tag(struct snapraid_logbuf* logbuf, const char* format, ...) __attribute__((format(attribute_printf, 2, 3)));
+
+/**
+ * Write the collected messages in the log file, and empty the buffer.
+ */
+void logbuf_flush(struct snapraid_logbuf* logbuf);
+
 /****************************************************************************/
 /* message */
 
@@ -439,6 +466,19 @@ void thread_cond_signal_and_unlock(thread_cond_t* cond, thread_mutex_t* mutex);
 void thread_cond_broadcast_and_unlock(thread_cond_t* cond, thread_mutex_t* mutex);
 void thread_create(thread_id_t* thread, void* (* func)(void *), void *arg);
 void thread_join(thread_id_t thread, void** retval);
+
+/**
+ * Atomic access to variables shared between threads without a mutex.
+ *
+ * All the operations are sequentially consistent, so the writes done
+ * before a store are visible to the thread that loads the stored value.
+ */
+#define thread_load(ptr) __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define thread_store(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST)
+#define thread_exchange(ptr, value) __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST)
+#define thread_fetch_add(ptr, value) __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST)
+#define thread_fetch_sub(ptr, value) __atomic_fetch_sub(ptr, value, __ATOMIC_SEQ_CST)
+#define thread_compare_exchange(ptr, expected, value) __atomic_compare_exchange_n(ptr, expected, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
 #endif
 
 #endif
@@ -437,6 +437,15 @@ struct snapraid_rehash {
 	struct snapraid_block* block;
 };
 
+/**
+ * Data block read, waiting for the hash comparison.
+ */
+struct snapraid_verify {
+	unsigned char hash[HASH_MAX]; /**< Hash computed from the data read. */
+	struct snapraid_task* task; /**< Task with the data read. */
+	unsigned index; /**< Index of the disk. */
+};
+
 /**
  * Check if we have to process the specified block index ::i.
  */
@@ -667,6 +676,11 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	struct snapraid_handle* handle;
 	void* rehandle_alloc;
 	struct snapraid_rehash* rehandle;
+	void* verify_alloc;
+	struct snapraid_verify* verify;
+	void** hash_src;
+	void** hash_dst;
+	void** rehash_dst;
 	unsigned diskmax;
 	block_off_t blockcur;
 	unsigned j;
@@ -707,6 +721,12 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 	/* rehash buffers */
 	rehandle = malloc_nofail_align(diskmax * sizeof(struct snapraid_rehash), &rehandle_alloc);
 
+	/* blocks to verify, and hashes to compute all together */
+	verify = malloc_nofail_align(diskmax * sizeof(struct snapraid_verify), &verify_alloc);
+	hash_src = malloc_nofail(diskmax * sizeof(void*));
+	hash_dst = malloc_nofail(diskmax * sizeof(void*));
+	rehash_dst = malloc_nofail(diskmax * sizeof(void*));
+
 	/* we need 1 * data + 1 * parity */
 	buffermax = diskmax + state->level;
 
@@ -780,6 +800,8 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 		int rehash;
 		void** buffer;
 		int writer_error[IO_WRITER_ERROR_MAX];
+		unsigned verify_mac;
+		unsigned hash_mac;
 
 		/* go to the next block */
 		blockcur = io_read_next(&io, &buffer);
@@ -826,15 +848,17 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 			parity_needs_to_be_updated = 1;
 
 		/* for each disk, process the block */
+		verify_mac = 0;
+		hash_mac = 0;
+
+		/* for each disk, read the block */
 		for (j = 0; j < diskmax; ++j) {
 			struct snapraid_task* task;
 			int read_size;
-			unsigned char hash[HASH_MAX];
 			struct snapraid_block* block;
 			unsigned block_state;
 			struct snapraid_disk* disk;
 			struct snapraid_file* file;
-			block_off_t file_pos;
 			unsigned diskcur;
 
 			/* until now is misc */
@@ -849,7 +873,6 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 			disk = task->disk;
 			block = task->block;
 			file = task->file;
-			file_pos = task->file_pos;
 			read_size = task->read_size;
 
 			/* by default no rehash in case of "continue" */
@@ -934,19 +957,56 @@ static int state_sync_process(struct snapraid_state* state, struct snapraid_pari
 
 			countsize += read_size;
 
-			/* now compute the hash */
-			if (rehash) {
-				memhash(state->prevhash, state->prevhashseed, hash, buffer[diskcur], read_size);
+			verify[verify_mac].task = task;
+			verify[verify_mac].index = diskcur;
 
-				/* compute the new hash, and store it */
+			/* store the new hash */
+			if (rehash)
 				rehandle[diskcur].block = block;
-				memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
+
+			if ((unsigned)read_size == state->block_size) {
+				/* full blocks are hashed later, all the disks together */
+				hash_src[hash_mac] = buffer[diskcur];
+				hash_dst[hash_mac] = verify[verify_mac].hash;
+				rehash_dst[hash_mac] = rehandle[diskcur].hash;
+				++hash_mac;
 			} else {
-				memhash(state->hash, state->hashseed, hash, buffer[diskcur], read_size);
+				/* partial blocks at the end of files are hashed now */
+				if (rehash) {
+					memhash(state->prevhash, state->prevhashseed, verify[verify_mac].hash, buffer[diskcur], read_size);
+					memhash(state->hash, state->hashseed, rehandle[diskcur].hash, buffer[diskcur], read_size);
+				} else {
+					memhash(state->hash, state->hashseed, verify[verify_mac].hash, buffer[diskcur], read_size);
+				}
+
+				/* until now is hash */
+				state_usage_hash(state);
 			}
 
-			/* until now is hash */
-			state_usage_hash(state);
+			++verify_mac;
+		}
+
+		/* compute the hash of all the full blocks */
+		if (rehash) {
+			memhash_vec(state->prevhash, state->prevhashseed, hash_dst, hash_src, hash_mac, state->block_size);
+			memhash_vec(state->hash, state->hashseed, rehash_dst, hash_src, hash_mac, state->block_size);
+		} else {
+			memhash_vec(state->hash, state->hashseed, hash_dst, hash_src, hash_mac, state->block_size);
+		}
+
+		/* until now is hash */
+		state_usage_hash(state);
+
+		/* compare the hash of all the blocks read */
+		for (j = 0; j < verify_mac; ++j) {
+			struct snapraid_task* task = verify[j].task;
+			unsigned char* hash = verify[j].hash;
+			unsigned diskcur = verify[j].index;
+			struct snapraid_block* block = task->block;
+			struct snapraid_disk* disk = task->disk;
+			struct snapraid_file* file = task->file;
+			block_off_t file_pos = task->file_pos;
+			int read_size = task->read_size;
 
 			if (block_has_updated_hash(block)) {
 				/* compare the hash */
@@ -1415,6 +1475,10 @@ bail:
 	free(copy_alloc);
 	free(copy);
 	free(rehandle_alloc);
+	free(verify_alloc);
+	free(hash_src);
+	free(hash_dst);
+	free(rehash_dst);
 	free(failed);
 	free(failed_map);
 	free(waiting_map);
@@ -1537,7 +1601,8 @@ int state_sync(struct snapraid_state* state, block_off_t blockstart, block_off_t
 			/* change the size of the parity file, truncating or extending it */
 			/* from this point all the DELETED blocks after the end of the parity are invalid */
 			/* and they are automatically removed when we save the new content file */
-			ret = parity_chsize(&parity_handle[l], &state->parity[l], &is_modified, size, state->block_size, state->opt.skip_fallocate, state->opt.skip_space_holder);
+			/* if possible, the new space is allocated in background while the sync writes */
+			ret = parity_chsize(&parity_handle[l], &state->parity[l], &is_modified, size, state->block_size, state->opt.skip_fallocate, state->opt.skip_space_holder, 1);
 			if (ret == -1) {
 				/* LCOV_EXCL_START */
 				data_off_t out_size;
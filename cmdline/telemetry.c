@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "support.h"
+#include "util.h"
+#include "elem.h"
+#include "state.h"
+
+/****************************************************************************/
+/* telemetry */
+
+/**
+ * Seconds between two writes of the telemetry file.
+ */
+#define TELEMETRY_PERIOD 10
+
+/**
+ * Smallest latency reported, in seconds.
+ * The buckets below it are merged in the first one reported.
+ */
+#define TELEMETRY_LATENCY_MIN 1e-6
+
+/**
+ * Load a counter that the disk threads may be incrementing.
+ */
+#if HAVE_THREAD
+#define telemetry_load(ptr) thread_load(ptr)
+#else
+#define telemetry_load(ptr) (*(ptr))
+#endif
+
+/**
+ * Counters of a data or parity disk.
+ */
+struct telemetry_disk {
+	const char* name;
+	const char* kind;
+	uint64_t tick; /**< Time the process waited for the disk. */
+	uint64_t access_tick; /**< Total time of the accesses. */
+	uint64_t access_size; /**< Total size of the accesses. */
+	uint64_t access_count; /**< Number of accesses. */
+	uint64_t latency[LATENCY_MAX];
+};
+
+static void telemetry_disk_set(struct telemetry_disk* td, const char* name, const char* kind, uint64_t tick, uint64_t* access_latency, uint64_t* access_tick, uint64_t* access_size)
+{
+	unsigned k;
+
+	td->name = name;
+	td->kind = kind;
+	td->tick = tick;
+	td->access_tick = telemetry_load(access_tick);
+	td->access_size = telemetry_load(access_size);
+	td->access_count = 0;
+	for (k = 0; k < LATENCY_MAX; ++k) {
+		td->latency[k] = telemetry_load(&access_latency[k]);
+		td->access_count += td->latency[k];
+	}
+}
+
+/**
+ * Upper bound in seconds of a latency bucket.
+ */
+static double telemetry_bound(unsigned k, double freq)
+{
+	return (double)(1ULL << k) / freq;
+}
+
+/**
+ * Write a quoted string, escaped for both JSON and Prometheus.
+ */
+static void telemetry_string(FILE* f, const char* s)
+{
+	fputc('"', f);
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', f);
+			fputc(*s, f);
+		} else if (*s == '\n') {
+			fputs("\\n", f);
+		} else {
+			fputc(*s, f);
+		}
+	}
+	fputc('"', f);
+}
+
+/**
+ * Append a JSON line.
+ */
+static void telemetry_json(struct snapraid_state* state, FILE* f, time_t now, double freq, block_off_t countpos, block_off_t countmax, data_off_t countsize, struct telemetry_disk* map, unsigned mac)
+{
+	unsigned i;
+	unsigned k;
+
+	fprintf(f, "{\"time\":%" PRIu64 ",\"command\":", (uint64_t)now);
+	telemetry_string(f, state->command);
+	fprintf(f, ",\"elapsed\":%" PRIu64, (uint64_t)(now - state->progress_whole_start - state->progress_wasted));
+	fprintf(f, ",\"pos\":%u,\"max\":%u,\"size\":%" PRIu64, countpos, countmax, (uint64_t)countsize);
+
+	fprintf(f, ",\"stage\":{\"raid\":%.9g,\"hash\":%.9g,\"sched\":%.9g,\"misc\":%.9g,\"io\":%.9g}",
+		state->tick_raid / freq, state->tick_hash / freq, state->tick_sched / freq, state->tick_misc / freq, state->tick_io / freq);
+
+	fprintf(f, ",\"disk\":[");
+	for (i = 0; i < mac; ++i) {
+		struct telemetry_disk* td = &map[i];
+		int first;
+
+		if (i != 0)
+			fputc(',', f);
+		fprintf(f, "{\"name\":");
+		telemetry_string(f, td->name);
+		fprintf(f, ",\"kind\":\"%s\",\"wait\":%.9g", td->kind, td->tick / freq);
+		fprintf(f, ",\"size\":%" PRIu64 ",\"access\":%" PRIu64 ",\"access_time\":%.9g", td->access_size, td->access_count, td->access_tick / freq);
+
+		/* only the not empty buckets, with the last one unbounded */
+		fprintf(f, ",\"latency\":[");
+		first = 1;
+		for (k = 0; k < LATENCY_MAX; ++k) {
+			if (td->latency[k] == 0)
+				continue;
+			if (!first)
+				fputc(',', f);
+			first = 0;
+			if (k + 1 < LATENCY_MAX)
+				fprintf(f, "[%.9g,%" PRIu64 "]", telemetry_bound(k, freq), td->latency[k]);
+			else
+				fprintf(f, "[null,%" PRIu64 "]", td->latency[k]);
+		}
+		fprintf(f, "]}");
+	}
+	fprintf(f, "]}\n");
+}
+
+/**
+ * Write the labels of a disk.
+ */
+static void telemetry_prom_disk(FILE* f, const char* metric, struct snapraid_state* state, struct telemetry_disk* td)
+{
+	fprintf(f, "%s{command=", metric);
+	telemetry_string(f, state->command);
+	fprintf(f, ",disk=");
+	telemetry_string(f, td->name);
+	fprintf(f, ",kind=\"%s\"", td->kind);
+}
+
+/**
+ * Write a Prometheus text file.
+ */
+static void telemetry_prom(struct snapraid_state* state, FILE* f, time_t now, double freq, block_off_t countpos, block_off_t countmax, data_off_t countsize, struct telemetry_disk* map, unsigned mac)
+{
+	const char* stage_name[] = { "raid", "hash", "sched", "misc", "io" };
+	uint64_t stage_tick[5];
+	unsigned i;
+	unsigned k;
+
+	stage_tick[0] = state->tick_raid;
+	stage_tick[1] = state->tick_hash;
+	stage_tick[2] = state->tick_sched;
+	stage_tick[3] = state->tick_misc;
+	stage_tick[4] = state->tick_io;
+
+	fprintf(f, "# HELP snapraid_telemetry_time_seconds Time of the latest update.\n");
+	fprintf(f, "# TYPE snapraid_telemetry_time_seconds gauge\n");
+	fprintf(f, "snapraid_telemetry_time_seconds %" PRIu64 "\n", (uint64_t)now);
+
+	fprintf(f, "# HELP snapraid_elapsed_seconds Time elapsed running the command.\n");
+	fprintf(f, "# TYPE snapraid_elapsed_seconds gauge\n");
+	fprintf(f, "snapraid_elapsed_seconds{command=");
+	telemetry_string(f, state->command);
+	fprintf(f, "} %" PRIu64 "\n", (uint64_t)(now - state->progress_whole_start - state->progress_wasted));
+
+	fprintf(f, "# HELP snapraid_progress_blocks Blocks processed by the command.\n");
+	fprintf(f, "# TYPE snapraid_progress_blocks gauge\n");
+	fprintf(f, "snapraid_progress_blocks{command=");
+	telemetry_string(f, state->command);
+	fprintf(f, "} %u\n", countpos);
+
+	fprintf(f, "# HELP snapraid_progress_blocks_max Blocks to process by the command.\n");
+	fprintf(f, "# TYPE snapraid_progress_blocks_max gauge\n");
+	fprintf(f, "snapraid_progress_blocks_max{command=");
+	telemetry_string(f, state->command);
+	fprintf(f, "} %u\n", countmax);
+
+	fprintf(f, "# HELP snapraid_progress_bytes_total Data processed by the command.\n");
+	fprintf(f, "# TYPE snapraid_progress_bytes_total counter\n");
+	fprintf(f, "snapraid_progress_bytes_total{command=");
+	telemetry_string(f, state->command);
+	fprintf(f, "} %" PRIu64 "\n", (uint64_t)countsize);
+
+	fprintf(f, "# HELP snapraid_stage_seconds_total Time used by each stage of the command.\n");
+	fprintf(f, "# TYPE snapraid_stage_seconds_total counter\n");
+	for (i = 0; i < 5; ++i) {
+		fprintf(f, "snapraid_stage_seconds_total{command=");
+		telemetry_string(f, state->command);
+		fprintf(f, ",stage=\"%s\"} %.9g\n", stage_name[i], stage_tick[i] / freq);
+	}
+
+	fprintf(f, "# HELP snapraid_disk_wait_seconds_total Time waited for each disk.\n");
+	fprintf(f, "# TYPE snapraid_disk_wait_seconds_total counter\n");
+	for (i = 0; i < mac; ++i) {
+		telemetry_prom_disk(f, "snapraid_disk_wait_seconds_total", state, &map[i]);
+		fprintf(f, "} %.9g\n", map[i].tick / freq);
+	}
+
+	fprintf(f, "# HELP snapraid_disk_bytes_total Data read or written in each disk.\n");
+	fprintf(f, "# TYPE snapraid_disk_bytes_total counter\n");
+	for (i = 0; i < mac; ++i) {
+		telemetry_prom_disk(f, "snapraid_disk_bytes_total", state, &map[i]);
+		fprintf(f, "} %" PRIu64 "\n", map[i].access_size);
+	}
+
+	fprintf(f, "# HELP snapraid_disk_latency_seconds Latency of the block accesses of each disk.\n");
+	fprintf(f, "# TYPE snapraid_disk_latency_seconds histogram\n");
+	for (i = 0; i < mac; ++i) {
+		struct telemetry_disk* td = &map[i];
+		uint64_t count = 0;
+
+		/* the last bucket is unbounded, and reported only as +Inf */
+		for (k = 0; k + 1 < LATENCY_MAX; ++k) {
+			double bound = telemetry_bound(k, freq);
+
+			count += td->latency[k];
+			if (bound < TELEMETRY_LATENCY_MIN)
+				continue;
+
+			telemetry_prom_disk(f, "snapraid_disk_latency_seconds_bucket", state, td);
+			fprintf(f, ",le=\"%.9g\"} %" PRIu64 "\n", bound, count);
+		}
+
+		telemetry_prom_disk(f, "snapraid_disk_latency_seconds_bucket", state, td);
+		fprintf(f, ",le=\"+Inf\"} %" PRIu64 "\n", td->access_count);
+		telemetry_prom_disk(f, "snapraid_disk_latency_seconds_sum", state, td);
+		fprintf(f, "} %.9g\n", td->access_tick / freq);
+		telemetry_prom_disk(f, "snapraid_disk_latency_seconds_count", state, td);
+		fprintf(f, "} %" PRIu64 "\n", td->access_count);
+	}
+}
+
+/**
+ * If the telemetry file uses the Prometheus format.
+ */
+static int telemetry_is_prom(const char* path)
+{
+	size_t len = strlen(path);
+
+	return len >= 5 && strcmp(path + len - 5, ".prom") == 0;
+}
+
+void state_telemetry(struct snapraid_state* state, block_off_t countpos, block_off_t countmax, data_off_t countsize, int force)
+{
+	char path[PATH_MAX];
+	struct telemetry_disk* map;
+	unsigned mac;
+	tommy_node* i;
+	unsigned l;
+	time_t now;
+	double freq;
+	FILE* f;
+	int is_prom;
+	int ret;
+
+	if (!state->telemetry[0])
+		return;
+
+	now = time(0);
+	if (!force && now < state->telemetry_time + TELEMETRY_PERIOD)
+		return;
+	state->telemetry_time = now;
+
+	freq = tick_freq();
+
+	map = malloc_nofail((tommy_list_count(&state->disklist) + state->level) * sizeof(struct telemetry_disk));
+	mac = 0;
+	for (i = state->disklist; i != 0; i = i->next) {
+		struct snapraid_disk* disk = i->data;
+		telemetry_disk_set(&map[mac++], disk->name, "data", disk->tick, disk->access_latency, &disk->access_tick, &disk->access_size);
+	}
+	for (l = 0; l < state->level; ++l) {
+		struct snapraid_parity* parity = &state->parity[l];
+		telemetry_disk_set(&map[mac++], lev_config_name(l), "parity", parity->tick, parity->access_latency, &parity->access_tick, &parity->access_size);
+	}
+
+	is_prom = telemetry_is_prom(state->telemetry);
+
+	/* the Prometheus file is replaced at once, to never be read partially */
+	if (is_prom) {
+		pathprint(path, sizeof(path), "%s.tmp", state->telemetry);
+		f = fopen(path, "w");
+	} else {
+		pathcpy(path, sizeof(path), state->telemetry);
+		f = fopen(path, "a");
+	}
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to open the telemetry file '%s'. %s.\n", path, strerror(errno));
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (is_prom)
+		telemetry_prom(state, f, now, freq, countpos, countmax, countsize, map, mac);
+	else
+		telemetry_json(state, f, now, freq, countpos, countmax, countsize, map, mac);
+
+	ret = ferror(f);
+	if (fclose(f) != 0)
+		ret = -1;
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to write the telemetry file '%s'. %s.\n", path, strerror(errno));
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	if (is_prom && rename(path, state->telemetry) != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to rename the telemetry file '%s'. %s.\n", path, strerror(errno));
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	free(map);
+	return;
+
+bail:
+	/* LCOV_EXCL_START */
+	/* don't retry at every progress */
+	log_fatal("Telemetry disabled.\n");
+	state->telemetry[0] = 0;
+	free(map);
+	/* LCOV_EXCL_STOP */
+}
+
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "support.h"
+#include "trace.h"
+
+/****************************************************************************/
+/* trace */
+
+/**
+ * Number of events kept for each thread.
+ * Must be a power of 2.
+ */
+#define TRACE_MAX (64 * 1024)
+
+#define TRACE_SPAN 0 /**< Event with a duration. */
+#define TRACE_COUNTER 1 /**< Value of a counter. */
+
+struct snapraid_trace_event {
+	const char* name;
+	uint64_t start;
+	uint64_t stop; /**< Stop tick, or value for a counter. */
+	uint64_t arg;
+	int kind; /**< One of the TRACE_* kinds. */
+};
+
+struct snapraid_trace {
+	char name[PATH_MAX + 32]; /**< Name of the thread, with the disk name. */
+	unsigned id; /**< Identifier of the thread, starting from 1. */
+	uint64_t count; /**< Number of events recorded, also the ones overwritten. */
+	struct snapraid_trace_event event_map[TRACE_MAX];
+	tommy_node node;
+};
+
+int trace_enabled;
+struct snapraid_trace* trace_main;
+
+static char trace_file[PATH_MAX];
+static uint64_t trace_tick; /**< Ticks at the start. */
+static tommy_list trace_list; /**< All the threads traced. */
+
+struct snapraid_trace* trace_thread(const char* name)
+{
+	struct snapraid_trace* trace;
+	char buffer[PATH_MAX + 32];
+	tommy_node* i;
+	char* s;
+
+	if (!trace_enabled)
+		return 0;
+
+	pathcpy(buffer, sizeof(buffer), name);
+
+	/* avoid the chars to escape in the JSON strings */
+	for (s = buffer; *s; ++s)
+		if (*s == '"' || *s == '\\' || (unsigned char)*s < 32)
+			*s = '_';
+
+	/* reuse the events of a thread with the same name, */
+	/* like the ones of the disks when the IO is started again */
+	for (i = tommy_list_head(&trace_list); i != 0; i = i->next) {
+		trace = i->data;
+		if (strcmp(trace->name, buffer) == 0)
+			return trace;
+	}
+
+	trace = malloc_nofail(sizeof(struct snapraid_trace));
+	pathcpy(trace->name, sizeof(trace->name), buffer);
+	trace->id = tommy_list_count(&trace_list) + 1;
+	trace->count = 0;
+
+	tommy_list_insert_tail(&trace_list, &trace->node, trace);
+
+	return trace;
+}
+
+void trace_open(const char* file)
+{
+	pathcpy(trace_file, sizeof(trace_file), file);
+	trace_tick = tick();
+	tommy_list_init(&trace_list);
+	trace_enabled = 1;
+
+	trace_main = trace_thread("main");
+}
+
+void trace_span_record(struct snapraid_trace* trace, const char* name, uint64_t start, uint64_t stop, uint64_t arg)
+{
+	struct snapraid_trace_event* event = &trace->event_map[trace->count & (TRACE_MAX - 1)];
+
+	event->name = name;
+	event->start = start;
+	event->stop = stop;
+	event->arg = arg;
+	event->kind = TRACE_SPAN;
+
+	++trace->count;
+}
+
+void trace_counter_record(struct snapraid_trace* trace, const char* name, uint64_t now, uint64_t value)
+{
+	struct snapraid_trace_event* event = &trace->event_map[trace->count & (TRACE_MAX - 1)];
+
+	event->name = name;
+	event->start = now;
+	event->stop = value;
+	event->arg = 0;
+	event->kind = TRACE_COUNTER;
+
+	++trace->count;
+}
+
+/**
+ * Convert a tick to microseconds from the start.
+ */
+static double trace_us(uint64_t t, double freq)
+{
+	/* events recorded before the start are clamped */
+	if (t < trace_tick)
+		return 0;
+
+	return (t - trace_tick) * 1e6 / freq;
+}
+
+void trace_close(void)
+{
+	double freq;
+	FILE* f;
+	tommy_node* i;
+	int first;
+	int ret;
+
+	if (!trace_enabled)
+		return;
+
+	freq = tick_freq();
+
+	f = fopen(trace_file, "w");
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to create the trace file '%s'. %s.\n", trace_file, strerror(errno));
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	first = 1;
+	for (i = tommy_list_head(&trace_list); i != 0; i = i->next) {
+		struct snapraid_trace* trace = i->data;
+		uint64_t j;
+		uint64_t begin;
+
+		if (!first)
+			fprintf(f, ",\n");
+		first = 0;
+
+		fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", trace->id, trace->name);
+
+		/* only the latest events are still present */
+		begin = 0;
+		if (trace->count > TRACE_MAX)
+			begin = trace->count - TRACE_MAX;
+
+		for (j = begin; j < trace->count; ++j) {
+			struct snapraid_trace_event* event = &trace->event_map[j & (TRACE_MAX - 1)];
+
+			if (event->kind == TRACE_COUNTER) {
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"value\":%" PRIu64 "}}",
+					event->name, trace->id, trace_us(event->start, freq), event->stop);
+			} else {
+				double ts = trace_us(event->start, freq);
+				double dur = trace_us(event->stop, freq) - ts;
+
+				fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"pos\":%" PRIu64 "}}",
+					event->name, trace->id, ts, dur, event->arg);
+			}
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+
+	ret = ferror(f);
+	if (fclose(f) != 0)
+		ret = -1;
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to write the trace file '%s'. %s.\n", trace_file, strerror(errno));
+		goto bail;
+		/* LCOV_EXCL_STOP */
+	}
+
+bail:
+	tommy_list_foreach(&trace_list, free);
+	tommy_list_init(&trace_list);
+	trace_main = 0;
+	trace_enabled = 0;
+}
+
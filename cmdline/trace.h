@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+/****************************************************************************/
+/* trace */
+
+/**
+ * Events recorded by a single thread.
+ *
+ * Only the owner thread writes in it, so no lock is needed.
+ * When full, the oldest events are overwritten.
+ */
+struct snapraid_trace;
+
+/**
+ * If the tracing is enabled.
+ * It's the only check done when it's disabled.
+ */
+extern int trace_enabled;
+
+/**
+ * Events of the main thread.
+ */
+extern struct snapraid_trace* trace_main;
+
+/**
+ * Enable the tracing, saving the events in the specified file at the end.
+ */
+void trace_open(const char* file);
+
+/**
+ * Write the events in the Chrome trace format, and free them.
+ * It must be called when no other thread is recording.
+ */
+void trace_close(void);
+
+/**
+ * Allocate the events for a new thread, or reuse the ones of a thread
+ * with the same name.
+ * Return 0 if the tracing is disabled.
+ */
+struct snapraid_trace* trace_thread(const char* name);
+
+/**
+ * Record an event with the start and stop ticks.
+ * The name must be a static string.
+ */
+void trace_span_record(struct snapraid_trace* trace, const char* name, uint64_t start, uint64_t stop, uint64_t arg);
+
+/**
+ * Record the value of a counter.
+ * The name must be a static string.
+ */
+void trace_counter_record(struct snapraid_trace* trace, const char* name, uint64_t now, uint64_t value);
+
+#define trace_span(trace, name, start, stop, arg) \
+	do { \
+		if (trace_enabled) \
+			trace_span_record(trace, name, start, stop, arg); \
+	} while (0)
+
+#define trace_counter(trace, name, now, value) \
+	do { \
+		if (trace_enabled) \
+			trace_counter_record(trace, name, now, value); \
+	} while (0)
+
+#endif
+
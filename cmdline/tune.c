@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2011 Andrea Mazzoleni
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "portable.h"
+
+#include "snapraid.h"
+#include "support.h"
+#include "util.h"
+#include "stream.h"
+#include "elem.h"
+#include "state.h"
+#include "raid/raid.h"
+#include "raid/cpu.h"
+#include "raid/internal.h"
+#include "raid/memory.h"
+
+/****************************************************************************/
+/* tune */
+
+/**
+ * Time spent measuring each candidate function, in milliseconds.
+ */
+#define TUNE_PERIOD 20
+
+typedef void gen_f(int nd, size_t size, void **vv);
+typedef void rec_f(int nr, int *id, int *ip, int nd, size_t size, void **vv);
+
+/**
+ * Measure the time of a single call of a generation function.
+ */
+static uint64_t tune_gen(gen_f* f, int nd, size_t size, void** v, int period)
+{
+	uint64_t start;
+	uint64_t start_ms;
+	uint64_t stop;
+	uint64_t count;
+
+	/* warm up the cache and the branch predictor */
+	f(nd, size, v);
+
+	/* the period is measured in milliseconds, as tick() has a unit */
+	/* depending on the platform, and it's only good to compare times */
+	count = 0;
+	start_ms = tick_ms();
+	start = tick();
+	do {
+		f(nd, size, v);
+		++count;
+		stop = tick();
+	} while (tick_ms() - start_ms < (uint64_t)period);
+
+	return (stop - start) / count;
+}
+
+/**
+ * Measure the time of a single call of a recovering function.
+ */
+static uint64_t tune_rec(rec_f* f, int nr, int np, int nd, size_t size, void** v, int period)
+{
+	int id[RAID_PARITY_MAX];
+	int ip[RAID_PARITY_MAX];
+	uint64_t start;
+	uint64_t start_ms;
+	uint64_t stop;
+	uint64_t count;
+	int i;
+
+	/* recover the first data blocks using the last parities */
+	/* as the first parity alone is always recovered with a plain xor */
+	for (i = 0; i < nr; ++i) {
+		id[i] = i;
+		ip[i] = np - nr + i;
+	}
+
+	f(nr, id, ip, nd, size, v);
+
+	count = 0;
+	start_ms = tick_ms();
+	start = tick();
+	do {
+		f(nr, id, ip, nd, size, v);
+		++count;
+		stop = tick();
+	} while (tick_ms() - start_ms < (uint64_t)period);
+
+	return (stop - start) / count;
+}
+
+void tune(unsigned diskmax, unsigned level, size_t block_size, int period)
+{
+	gen_f* gen_list[RAID_FUNC_MAX];
+	rec_f* rec_list[RAID_FUNC_MAX];
+	void* v_alloc;
+	void** v;
+	int nd;
+	int nv;
+	int n;
+	int i;
+	unsigned l;
+
+	/* the recovering requires at least one data block for each parity */
+	nd = diskmax;
+	if (nd < (int)level)
+		nd = level;
+
+	/* data, parity and zero buffer */
+	nv = nd + level + 1;
+
+	v = malloc_nofail_vector_align(nd, nv, block_size, &v_alloc);
+
+	/* use random data, to not favorite any implementation */
+	raid_mrand_vector(0, nd, block_size, v);
+
+	/* zero buffer used by the recovering functions */
+	memset(v[nd + level], 0, block_size);
+	raid_zero(v[nd + level]);
+
+	for (l = 1; l <= level; ++l) {
+		gen_f* best;
+		uint64_t best_time;
+
+		n = raid_gen_list(l, gen_list);
+
+		best = 0;
+		best_time = 0;
+		for (i = 0; i < n; ++i) {
+			uint64_t t = tune_gen(gen_list[i], nd, block_size, v, period);
+			/* on tie prefer the most recent instruction set */
+			if (!best || t <= best_time) {
+				best = gen_list[i];
+				best_time = t;
+			}
+		}
+
+		raid_gen_set(l, best);
+	}
+
+	/* compute the parity used by the recovering functions */
+	raid_gen(nd, level, block_size, v);
+
+	for (l = 1; l <= level; ++l) {
+		rec_f* best;
+		uint64_t best_time;
+
+		n = raid_rec_list(l, rec_list);
+
+		best = 0;
+		best_time = 0;
+		for (i = 0; i < n; ++i) {
+			uint64_t t = tune_rec(rec_list[i], l, level, nd, block_size, v, period);
+			/* on tie prefer the most recent instruction set */
+			if (!best || t <= best_time) {
+				best = rec_list[i];
+				best_time = t;
+			}
+		}
+
+		raid_rec_set(l, best);
+	}
+
+	/* the zero buffer is going to be freed */
+	raid_zero(0);
+
+	free(v_alloc);
+	free(v);
+}
+
+/**
+ * Description of the array and of the CPU.
+ *
+ * If it changes, the tune file is not valid anymore.
+ */
+static void tune_header(struct snapraid_state* state, unsigned diskmax, char* header, size_t size)
+{
+#ifdef CONFIG_X86
+	char vendor[CPU_VENDOR_MAX];
+	unsigned family;
+	unsigned model;
+
+	raid_cpu_info(vendor, &family, &model);
+#else
+	const char* vendor = "generic";
+	unsigned family = 0;
+	unsigned model = 0;
+#endif
+
+	snprintf(header, size, "snapraid-tune %s/%u/%u %s %u %u", vendor, family, model, lev_raid_name(state->raid_mode, state->level), diskmax, state->block_size);
+}
+
+/**
+ * Search a generation function by name.
+ */
+static gen_f* tune_gen_find(unsigned np, const char* name)
+{
+	gen_f* list[RAID_FUNC_MAX];
+	int n;
+	int i;
+
+	n = raid_gen_list(np, list);
+	for (i = 0; i < n; ++i)
+		if (strcmp(raid_gen_name(list[i]), name) == 0)
+			return list[i];
+
+	return 0;
+}
+
+/**
+ * Search a recovering function by name.
+ */
+static rec_f* tune_rec_find(unsigned nr, const char* name)
+{
+	rec_f* list[RAID_FUNC_MAX];
+	int n;
+	int i;
+
+	n = raid_rec_list(nr, list);
+	for (i = 0; i < n; ++i)
+		if (strcmp(raid_rec_name(list[i]), name) == 0)
+			return list[i];
+
+	return 0;
+}
+
+/**
+ * Load the tune file.
+ *
+ * Return 0 if the file is valid for the current array, and the functions are set.
+ */
+static int tune_load(struct snapraid_state* state, const char* header)
+{
+	gen_f* gen_map[RAID_PARITY_MAX];
+	rec_f* rec_map[RAID_PARITY_MAX];
+	char buffer[PATH_MAX];
+	STREAM* f;
+	unsigned l;
+	int c;
+
+	for (l = 0; l < RAID_PARITY_MAX; ++l) {
+		gen_map[l] = 0;
+		rec_map[l] = 0;
+	}
+
+	f = sopen_read(state->tunefile);
+	if (!f)
+		return -1;
+
+	/* the header must match exactly the current array */
+	if (sgetline(f, buffer, sizeof(buffer)) < 0 || strcmp(buffer, header) != 0)
+		goto bail;
+	if (sgeteol(f) != '\n')
+		goto bail;
+
+	while (1) {
+		char tag[32];
+
+		c = sgetc(f);
+		if (c == EOF)
+			break;
+		sungetc(c, f);
+
+		if (sgettok(f, tag, sizeof(tag)) < 0)
+			goto bail;
+
+		sgetspace(f);
+
+		if (sgetlasttok(f, buffer, sizeof(buffer)) < 0)
+			goto bail;
+
+		if (sscanf(tag, "gen%u", &l) == 1 && l >= 1 && l <= state->level) {
+			gen_map[l - 1] = tune_gen_find(l, buffer);
+		} else if (sscanf(tag, "rec%u", &l) == 1 && l >= 1 && l <= state->level) {
+			rec_map[l - 1] = tune_rec_find(l, buffer);
+		} else {
+			goto bail;
+		}
+
+		c = sgeteol(f);
+		if (c == EOF)
+			break;
+		if (c != '\n')
+			goto bail;
+	}
+
+	if (serror(f))
+		goto bail;
+
+	/* all the levels must be specified with a known function */
+	for (l = 0; l < state->level; ++l)
+		if (!gen_map[l] || !rec_map[l])
+			goto bail;
+
+	sclose(f);
+
+	for (l = 0; l < state->level; ++l) {
+		raid_gen_set(l + 1, gen_map[l]);
+		raid_rec_set(l + 1, rec_map[l]);
+	}
+
+	return 0;
+
+bail:
+	sclose(f);
+	return -1;
+}
+
+/**
+ * Save the tune file.
+ */
+static void tune_save(struct snapraid_state* state, const char* header)
+{
+	char buffer[PATH_MAX + 64];
+	STREAM* f;
+	unsigned l;
+	int ret;
+
+	f = sopen_write(state->tunefile);
+	if (!f) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to create the tune file '%s'. %s.\n", state->tunefile, strerror(errno));
+		return;
+		/* LCOV_EXCL_STOP */
+	}
+
+	snprintf(buffer, sizeof(buffer), "%s\n", header);
+	ret = swrite(buffer, strlen(buffer), f);
+
+	for (l = 1; l <= state->level && ret == 0; ++l) {
+		snprintf(buffer, sizeof(buffer), "gen%u %s\nrec%u %s\n", l, raid_gen_name(raid_gen_ptr[l - 1]), l, raid_rec_name(raid_rec_ptr[l - 1]));
+		ret = swrite(buffer, strlen(buffer), f);
+	}
+
+	if (ret == 0)
+		ret = sclose(f);
+	else
+		sclose(f);
+
+	if (ret != 0) {
+		/* LCOV_EXCL_START */
+		log_fatal("WARNING! Failed to write the tune file '%s'. %s.\n", state->tunefile, strerror(errno));
+		remove(state->tunefile);
+		/* LCOV_EXCL_STOP */
+	}
+}
+
+void state_tune(struct snapraid_state* state)
+{
+	char header[128];
+	unsigned diskmax;
+	unsigned l;
+
+	if (!state->autotune || state->level == 0)
+		return;
+
+	diskmax = tommy_list_count(&state->disklist);
+
+	tune_header(state, diskmax, header, sizeof(header));
+
+	if (!state->tunefile[0] || tune_load(state, header) != 0) {
+		msg_progress("Tuning the RAID functions...\n");
+
+		tune(diskmax, state->level, state->block_size, TUNE_PERIOD);
+
+		if (state->tunefile[0])
+			tune_save(state, header);
+	}
+
+	for (l = 1; l <= state->level; ++l) {
+		log_tag("tune:gen%u:%s\n", l, raid_gen_name(raid_gen_ptr[l - 1]));
+		log_tag("tune:rec%u:%s\n", l, raid_rec_name(raid_rec_ptr[l - 1]));
+	}
+	log_flush();
+}
+
@@ -596,6 +596,68 @@ int devuuid(uint64_t device, const char* path, char* uuid, size_t uuid_size)
 	return -1;
 }
 
+/**
+ * Read a small text file from /sys.
+ * Return 0 on success.
+ */
+#if HAVE_LINUX_DEVICE
+static int sysread(const char* path, char* buf, size_t size)
+{
+	int f;
+	int len;
+
+	f = open(path, O_RDONLY);
+	if (f == -1)
+		return -1;
+
+	len = read(f, buf, size);
+	close(f);
+
+	if (len < 0 || (size_t)len == size)
+		return -1;
+
+	buf[len] = 0;
+
+	return 0;
+}
+#endif
+
+int devnode(uint64_t device)
+{
+#if HAVE_LINUX_DEVICE
+	char path[PATH_MAX];
+	char real[PATH_MAX];
+	char buf[64];
+
+	/* a partition has not a "device" link, and we use the one of the parent */
+	pathprint(path, sizeof(path), "/sys/dev/block/%u:%u/device", major(device), minor(device));
+	if (access(path, F_OK) != 0)
+		pathprint(path, sizeof(path), "/sys/dev/block/%u:%u/../device", major(device), minor(device));
+
+	if (realpath(path, real) == 0)
+		return -1;
+
+	/* go up in the tree until the controller, like a PCI device, reporting the node */
+	while (1) {
+		char* slash;
+
+		pathprint(path, sizeof(path), "%s/numa_node", real);
+		if (sysread(path, buf, sizeof(buf)) == 0) {
+			/* it's -1 if the system has no NUMA nodes */
+			return atoi(buf);
+		}
+
+		slash = strrchr(real, '/');
+		if (slash == 0 || slash == real)
+			return -1;
+		*slash = 0;
+	}
+#else
+	(void)device;
+	return -1;
+#endif
+}
+
 int filephy(const char* path, uint64_t size, uint64_t* physical)
 {
 #if HAVE_LINUX_FIEMAP_H
@@ -844,14 +906,168 @@ uint64_t tick(void)
 #endif
 }
 
+double tick_freq(void)
+{
+#if HAVE_MACH_ABSOLUTE_TIME
+	/* for Mac OS X */
+	mach_timebase_info_data_t tb;
+
+	mach_timebase_info(&tb);
+
+	/* the timebase converts the ticks to nanoseconds */
+	return 1e9 * tb.denom / tb.numer;
+#elif HAVE_CLOCK_GETTIME && (defined(CLOCK_MONOTONIC) || defined(CLOCK_MONOTONIC_RAW))
+	/* for Linux, nanoseconds */
+	return 1e9;
+#else
+	/* other platforms, microseconds */
+	return 1e6;
+#endif
+}
+
+#if !HAVE_MACH_ABSOLUTE_TIME && !(HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC))
+static uint64_t tick_ms_last; /**< Latest value returned by tick_ms(). */
+#endif
+
 uint64_t tick_ms(void)
 {
+#if HAVE_MACH_ABSOLUTE_TIME
+	/* for Mac OS X */
+	mach_timebase_info_data_t tb;
+	uint64_t t;
+	uint64_t ns;
+
+	mach_timebase_info(&tb);
+
+	t = mach_absolute_time();
+
+	/* scale before dividing, without overflowing */
+	ns = t / tb.denom * tb.numer + t % tb.denom * tb.numer / tb.denom;
+
+	return ns / 1000000;
+#elif HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+	/* for Linux */
+	struct timespec tv;
+
+	/* monotonic, not affected by changes of the system time */
+	if (clock_gettime(CLOCK_MONOTONIC, &tv) != 0) {
+		return 0;
+	}
+
+	return tv.tv_sec * 1000ULL + tv.tv_nsec / 1000000;
+#else
+	/* other platforms */
 	struct timeval tv;
+	uint64_t now;
+	uint64_t last;
 
 	if (gettimeofday(&tv, 0) != 0)
 		return 0;
 
-	return tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+	now = tv.tv_sec * 1000ULL + tv.tv_usec / 1000;
+
+	/* the system time may step back, never go back in time */
+	/* it's called by many threads, so the latest value is updated atomically */
+#if HAVE_THREAD
+	last = thread_load(&tick_ms_last);
+	while (now > last && !thread_compare_exchange(&tick_ms_last, &last, now))
+		; /* on failure last is updated with the current value */
+#else
+	last = tick_ms_last;
+	if (now > last)
+		tick_ms_last = now;
+#endif
+	if (now < last)
+		now = last;
+
+	return now;
+#endif
+}
+
+void sleep_ms(unsigned ms)
+{
+	struct timespec req;
+
+	req.tv_sec = ms / 1000;
+	req.tv_nsec = (ms % 1000) * 1000000L;
+
+	/* restart if interrupted by a signal */
+	while (nanosleep(&req, &req) != 0 && errno == EINTR)
+		;
+}
+
+unsigned cpu_count(void)
+{
+	long ret;
+
+	ret = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ret < 1)
+		return 1;
+
+	return ret;
+}
+
+#if HAVE_LINUX_DEVICE && HAVE_SCHED_SETAFFINITY
+static cpu_set_t cpu_start_set; /**< Processors of the process at the start. */
+static int cpu_start_valid; /**< If cpu_start_set is valid. */
+#endif
+
+int cpu_bind_node(int node)
+{
+#if HAVE_LINUX_DEVICE && HAVE_SCHED_SETAFFINITY
+	char path[PATH_MAX];
+	char buf[4096];
+	cpu_set_t set;
+	char* s;
+	int count;
+
+	/* restore the processors of the start */
+	if (node < 0) {
+		if (!cpu_start_valid)
+			return -1;
+		if (sched_setaffinity(0, sizeof(cpu_start_set), &cpu_start_set) != 0)
+			return -1;
+		return 0;
+	}
+
+	pathprint(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+	if (sysread(path, buf, sizeof(buf)) != 0)
+		return -1;
+
+	/* parse the list in the format "0-7,16-23" */
+	CPU_ZERO(&set);
+	count = 0;
+	s = buf;
+	while (isdigit(*s)) {
+		unsigned long begin;
+		unsigned long end;
+
+		begin = strtoul(s, &s, 10);
+		end = begin;
+		if (*s == '-')
+			end = strtoul(s + 1, &s, 10);
+
+		for (; begin <= end && begin < CPU_SETSIZE; ++begin) {
+			CPU_SET(begin, &set);
+			++count;
+		}
+
+		if (*s == ',')
+			++s;
+	}
+
+	if (count == 0)
+		return -1;
+
+	/* with pid 0 it applies only at the calling thread */
+	if (sched_setaffinity(0, sizeof(set), &set) != 0)
+		return -1;
+
+	return 0;
+#else
+	(void)node;
+	return -1;
+#endif
 }
 
 int randomize(void* ptr, size_t size)
@@ -1512,6 +1728,11 @@ void os_init(int opt)
 	}
 #endif
 
+#if HAVE_LINUX_DEVICE && HAVE_SCHED_SETAFFINITY
+	/* save the processors allowed, to restore them after cpu_bind_node() */
+	cpu_start_valid = sched_getaffinity(0, sizeof(cpu_start_set), &cpu_start_set) == 0;
+#endif
+
 	(void)opt;
 }
 
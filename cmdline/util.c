@@ -20,6 +20,7 @@
 #include "support.h"
 #include "util.h"
 #include "raid/cpu.h"
+#include "raid/internal.h"
 #include "raid/memory.h"
 
 /****************************************************************************/
@@ -89,6 +90,134 @@ void** malloc_nofail_vector_direct(int nd, int n, size_t size, void** freeptr)
 	return ptr;
 }
 
+/**
+ * Size of the huge pages.
+ */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/**
+ * Memory allocated with huge pages.
+ */
+struct huge_alloc {
+	void* ptr; /**< Memory to free. */
+	size_t size; /**< Size of the mapping. 0 if allocated with malloc(). */
+};
+
+static void** malloc_nofail_vector_huge(int nd, int n, size_t size, size_t align_size, size_t displacement_size, void** freeptr)
+{
+	struct huge_alloc* huge;
+	const char* kind;
+	unsigned char* va;
+	size_t total;
+	void** v;
+	int i;
+
+	huge = malloc_nofail(sizeof(struct huge_alloc));
+	huge->ptr = 0;
+	huge->size = 0;
+
+	total = n * (size + displacement_size);
+	va = 0;
+	kind = "normal";
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+	if (total >= HUGE_PAGE_SIZE) {
+		size_t len = (total + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		void* ptr;
+
+#ifdef MAP_HUGETLB
+		/* first try with the reserved huge pages, always aligned */
+		ptr = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (ptr != MAP_FAILED) {
+			huge->ptr = ptr;
+			huge->size = len;
+			va = ptr;
+			kind = "hugetlb";
+		}
+#endif
+
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+		/* otherwise request the transparent huge pages */
+		if (!va) {
+			/* map one page more to align at the huge page size */
+			ptr = mmap(0, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (ptr != MAP_FAILED) {
+				uintptr_t offset = ((uintptr_t)ptr) % HUGE_PAGE_SIZE;
+
+				huge->ptr = ptr;
+				huge->size = len + HUGE_PAGE_SIZE;
+				va = ptr;
+				if (offset != 0)
+					va += HUGE_PAGE_SIZE - offset;
+
+				/* it's only an hint, ignore if refused */
+				if (madvise(va, len, MADV_HUGEPAGE) == 0)
+					kind = "thp";
+			}
+		}
+#endif
+	}
+#endif
+
+	/* otherwise use the normal allocation */
+	if (!va) {
+		va = raid_malloc_align(total, align_size, &huge->ptr);
+		if (!va) {
+			/* LCOV_EXCL_START */
+			malloc_fail(total);
+			exit(EXIT_FAILURE);
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	log_tag("memory:%s:%" PRIu64 "\n", kind, (uint64_t)total);
+
+	v = malloc_nofail(n * sizeof(void*));
+	for (i = 0; i < n; ++i) {
+		v[i] = va;
+		va += size + displacement_size;
+	}
+
+	/* reverse order of the data blocks like raid_malloc_vector() */
+	for (i = 0; i < nd / 2; ++i) {
+		void* ptr = v[i];
+
+		v[i] = v[nd - 1 - i];
+		v[nd - 1 - i] = ptr;
+	}
+
+	*freeptr = huge;
+
+	return v;
+}
+
+void** malloc_nofail_vector_huge_align(int nd, int n, size_t size, void** freeptr)
+{
+	return malloc_nofail_vector_huge(nd, n, size, RAID_MALLOC_ALIGN, RAID_MALLOC_DISPLACEMENT, freeptr);
+}
+
+void** malloc_nofail_vector_huge_direct(int nd, int n, size_t size, void** freeptr)
+{
+	return malloc_nofail_vector_huge(nd, n, size, direct_size(), 0, freeptr);
+}
+
+void free_huge(void* freeptr)
+{
+	struct huge_alloc* huge = freeptr;
+
+	if (!huge)
+		return;
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+	if (huge->size != 0)
+		munmap(huge->ptr, huge->size);
+	else
+#endif
+	free(huge->ptr);
+
+	free(huge);
+}
+
 void* malloc_nofail_test(size_t size)
 {
 	void* ptr;
@@ -572,6 +701,7 @@ static inline void util_write64(void* ptr, uint64_t v)
 #include "murmur3.c"
 #include "spooky2.c"
 #include "metro.c"
+#include "xxh3.c"
 
 void memhash(unsigned kind, const unsigned char* seed, void* digest, const void* src, size_t size)
 {
@@ -585,6 +715,9 @@ void memhash(unsigned kind, const unsigned char* seed, void* digest, const void*
 	case HASH_METRO :
 		MetroHash128(src, size, seed, digest);
 		break;
+	case HASH_XXH3 :
+		XXH3_128(src, size, seed, digest);
+		break;
 	default :
 		/* LCOV_EXCL_START */
 		log_fatal("Internal inconsistency in hash function %u\n", kind);
@@ -594,6 +727,52 @@ void memhash(unsigned kind, const unsigned char* seed, void* digest, const void*
 	}
 }
 
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX2)
+/**
+ * If the AVX2 vector hashes are used.
+ */
+static int hash_avx2;
+#endif
+
+/**
+ * If XXH3 has a SIMD implementation for the CPU.
+ */
+static int hash_xxh3_simd;
+
+void memhash_init(void)
+{
+	XXH3_init();
+
+#if defined(CONFIG_X86) && defined(CONFIG_SSE2)
+	hash_xxh3_simd = raid_cpu_has_sse2();
+#endif
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX2)
+	hash_avx2 = raid_cpu_has_avx2();
+#endif
+}
+
+void memhash_vec(unsigned kind, const unsigned char* seed, void** digest, void** src, unsigned count, size_t size)
+{
+	unsigned i;
+
+	i = 0;
+
+#if defined(CONFIG_X86_64) && defined(CONFIG_AVX2)
+	if (kind == HASH_MURMUR3 && hash_avx2) {
+		for (; i + 8 <= count; i += 8)
+			MurmurHash3_x86_128_avx2x8(src + i, size, seed, digest + i);
+	}
+	if (kind == HASH_SPOOKY2 && hash_avx2) {
+		for (; i + 4 <= count; i += 4)
+			SpookyHash128_avx2x4(src + i, size, seed, digest + i);
+	}
+#endif
+
+	for (; i < count; ++i)
+		memhash(kind, seed, digest[i], src[i], size);
+}
+
 const char* hash_config_name(unsigned kind)
 {
 	switch (kind) {
@@ -601,6 +780,7 @@ const char* hash_config_name(unsigned kind)
 	case HASH_MURMUR3 : return "murmur3";
 	case HASH_SPOOKY2 : return "spooky2";
 	case HASH_METRO : return "metro";
+	case HASH_XXH3 : return "xxh3";
 	default :
 		/* LCOV_EXCL_START */
 		return "unknown";
@@ -608,6 +788,24 @@ const char* hash_config_name(unsigned kind)
 	}
 }
 
+unsigned hash_best(void)
+{
+	/* XXH3 if it has a SIMD implementation for the CPU */
+	if (hash_xxh3_simd)
+		return HASH_XXH3;
+
+	/* otherwise the default hash, selected by the architecture */
+#ifdef CONFIG_X86
+	if (sizeof(void*) == 4 && !raid_cpu_has_slowmult())
+		return HASH_MURMUR3;
+#else
+	if (sizeof(void*) == 4)
+		return HASH_MURMUR3;
+#endif
+
+	return HASH_SPOOKY2;
+}
+
 unsigned memdiff(const unsigned char* data1, const unsigned char* data2, size_t size)
 {
 	size_t i;
@@ -45,6 +45,30 @@ void** malloc_nofail_vector_align(int nd, int n, size_t size, void** freeptr);
  */
 void** malloc_nofail_vector_direct(int nd, int n, size_t size, void** freeptr);
 
+/**
+ * Safe aligned vector allocation using huge pages.
+ *
+ * The reserved huge pages are used if available, otherwise the
+ * transparent huge pages are requested to the kernel, and if also
+ * this is not possible, a normal allocation is done.
+ * Huge pages are used only if the vector fills at least one of them.
+ *
+ * The memory must be freed with free_huge() and not with free().
+ * If no memory is available, it aborts.
+ */
+void** malloc_nofail_vector_huge_align(int nd, int n, size_t size, void** freeptr);
+
+/**
+ * Safe vector allocation using huge pages. Usable for direct io.
+ * If no memory is available, it aborts.
+ */
+void** malloc_nofail_vector_huge_direct(int nd, int n, size_t size, void** freeptr);
+
+/**
+ * Free the memory allocated with malloc_nofail_vector_huge_*().
+ */
+void free_huge(void* freeptr);
+
 /**
  * Safe allocation with memory test.
  */
@@ -190,6 +214,12 @@ void crc32c_init(void);
 #define HASH_MURMUR3 1
 #define HASH_SPOOKY2 2
 #define HASH_METRO 3
+#define HASH_XXH3 4
+
+/**
+ * Initialize the hash functions, selecting the SIMD ones supported by the CPU.
+ */
+void memhash_init(void);
 
 /**
  * Compute the HASH of a memory block.
@@ -197,11 +227,25 @@ void crc32c_init(void);
  */
 void memhash(unsigned kind, const unsigned char* seed, void* digest, const void* src, size_t size);
 
+/**
+ * Compute the HASH of a vector of memory blocks of the same size.
+ * The result is the same of calling memhash() for each block,
+ * but the blocks may be processed in parallel with SIMD instructions.
+ */
+void memhash_vec(unsigned kind, const unsigned char* seed, void** digest, void** src, unsigned count, size_t size);
+
 /**
  * Return the hash name.
  */
 const char* hash_config_name(unsigned kind);
 
+/**
+ * Select the best hash for this machine.
+ * XXH3 is selected only if it has a SIMD implementation for the CPU.
+ * The choice depends only on the CPU features, to be the same at every run.
+ */
+unsigned hash_best(void);
+
 /**
  * Count the number of different bits in the two buffers.
  */
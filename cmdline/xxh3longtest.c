@@ -0,0 +1,12 @@
+{ 257, { 0xfb, 0xdf, 0xc6, 0xb3, 0x67, 0xc3, 0xc5, 0xf5, 0x45, 0xe5, 0x66, 0xb2, 0x15, 0x6a, 0x00, 0xb5 } },
+{ 300, { 0xdc, 0x49, 0x30, 0x87, 0x49, 0xe5, 0x90, 0x26, 0xc4, 0xf7, 0x5d, 0xc2, 0xdb, 0x8e, 0x77, 0x16 } },
+{ 511, { 0xbc, 0x3f, 0xc0, 0x3d, 0x08, 0xa6, 0x56, 0xf9, 0xdc, 0x27, 0x2c, 0x47, 0x97, 0x3c, 0xba, 0x4b } },
+{ 512, { 0x28, 0xad, 0xdf, 0x6a, 0x6c, 0x7e, 0x01, 0x08, 0x78, 0x24, 0xd8, 0x7d, 0xe2, 0x40, 0xee, 0xdc } },
+{ 1023, { 0xca, 0xdb, 0xd9, 0x72, 0xf4, 0xbc, 0x3c, 0x96, 0x68, 0xdf, 0x46, 0x5b, 0x92, 0xec, 0xf2, 0x41 } },
+{ 1024, { 0x0c, 0xd8, 0x04, 0x12, 0x3a, 0x2f, 0x1b, 0x11, 0x20, 0x46, 0x93, 0x75, 0x05, 0xdf, 0x7e, 0xd9 } },
+{ 1025, { 0x20, 0x30, 0x49, 0x42, 0xd2, 0x35, 0xad, 0xba, 0x49, 0x36, 0x02, 0x37, 0x40, 0x16, 0x11, 0x12 } },
+{ 2048, { 0xde, 0xd0, 0x6e, 0x1e, 0xc6, 0xd5, 0x83, 0x6a, 0xc2, 0x11, 0xcf, 0xfd, 0x54, 0x3a, 0xbd, 0x42 } },
+{ 4095, { 0xdb, 0x5f, 0x9a, 0x93, 0xf8, 0x64, 0x61, 0xec, 0xf3, 0x14, 0x1e, 0x43, 0xe1, 0xf3, 0xd2, 0xd1 } },
+{ 16384, { 0x28, 0x29, 0x0d, 0x3c, 0xa3, 0x3b, 0x64, 0xd1, 0xdd, 0xe7, 0x1c, 0x52, 0xa1, 0x3f, 0x1d, 0x5a } },
+{ 65543, { 0xcc, 0xf5, 0xad, 0x88, 0x54, 0xa1, 0x53, 0x15, 0x2f, 0x08, 0x76, 0x20, 0x01, 0x24, 0xf7, 0xd4 } },
+{ 262144, { 0x00, 0x96, 0x0e, 0xae, 0xe2, 0x7a, 0xa9, 0x5b, 0x65, 0xb5, 0x09, 0xec, 0xf7, 0x3b, 0x09, 0x79 } },
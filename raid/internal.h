@@ -114,6 +114,33 @@ static __always_inline void *__align_ptr(void *ptr, uintptr_t size)
 	return (void *)offset;
 }
 
+/*
+ * Cache size targeted by the tiled parity computation.
+ *
+ * Each tile of the data and parity blocks is expected to fit
+ * in this amount of memory. It matches the typical size of the
+ * L2 cache of modern CPUs.
+ */
+#define RAID_TILE_CACHE (1024 * 1024)
+
+/*
+ * Total size of the data blocks over which raid_gen()
+ * switches to the tiled computation.
+ *
+ * Below this value all the data blocks fit in the L2/L3 cache
+ * and the prefetcher is able to follow all the streams, so
+ * the plain computation is faster.
+ */
+#define RAID_TILE_THRESHOLD (8 * 1024 * 1024)
+
+/*
+ * Number of parity levels having a variant with cached stores.
+ *
+ * For more parities the computation is limited by the
+ * multiplications, and not by the memory bandwidth.
+ */
+#define RAID_CACHED_MAX 2
+
 /*
  * Includes the main interface headers.
  */
@@ -127,6 +154,8 @@ static __always_inline void *__align_ptr(void *ptr, uintptr_t size)
  */
 int raid_selftest(void);
 void raid_gen_ref(int nd, int np, size_t size, void **vv);
+void raid_gen_tiled(int nd, int np, size_t size, size_t tile, void **vv);
+size_t raid_gen_tile(int nd, int np, size_t size);
 void raid_invert(uint8_t *M, uint8_t *V, int n);
 void raid_delta_gen(int nr, int *id, int *ip, int nd, size_t size, void **v);
 void raid_rec1of1(int *id, int nd, size_t size, void **v);
@@ -135,11 +164,15 @@ void raid_gen1_int32(int nd, size_t size, void **vv);
 void raid_gen1_int64(int nd, size_t size, void **vv);
 void raid_gen1_sse2(int nd, size_t size, void **vv);
 void raid_gen1_avx2(int nd, size_t size, void **vv);
+void raid_gen1_sse2c(int nd, size_t size, void **vv);
+void raid_gen1_avx2c(int nd, size_t size, void **vv);
 void raid_gen2_int32(int nd, size_t size, void **vv);
 void raid_gen2_int64(int nd, size_t size, void **vv);
 void raid_gen2_sse2(int nd, size_t size, void **vv);
 void raid_gen2_avx2(int nd, size_t size, void **vv);
 void raid_gen2_sse2ext(int nd, size_t size, void **vv);
+void raid_gen2_sse2c(int nd, size_t size, void **vv);
+void raid_gen2_avx2c(int nd, size_t size, void **vv);
 void raid_genz_int32(int nd, size_t size, void **vv);
 void raid_genz_int64(int nd, size_t size, void **vv);
 void raid_genz_sse2(int nd, size_t size, void **vv);
@@ -171,6 +204,18 @@ void raid_rec1_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
 void raid_rec2_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
 void raid_recX_avx2(int nr, int *id, int *ip, int nd, size_t size, void **vv);
 
+/*
+ * Candidate implementations.
+ *
+ * These are intended to allow to select the implementation to use
+ * with a benchmark, instead of relying only on the CPU features.
+ */
+#define RAID_FUNC_MAX 8
+int raid_gen_list(int np, void (**f)(int nd, size_t size, void **vv));
+void raid_gen_set(int np, void (*f)(int nd, size_t size, void **vv));
+int raid_rec_list(int nr, void (**f)(int nr, int *id, int *ip, int nd, size_t size, void **vv));
+void raid_rec_set(int nr, void (*f)(int nr, int *id, int *ip, int nd, size_t size, void **vv));
+
 /*
  * Internal naming.
  *
@@ -186,6 +231,8 @@ const char *raid_gen6_tag(void);
 const char *raid_rec1_tag(void);
 const char *raid_rec2_tag(void);
 const char *raid_recX_tag(void);
+const char *raid_gen_name(void (*f)(int nd, size_t size, void **vv));
+const char *raid_rec_name(void (*f)(int nr, int *id, int *ip, int nd, size_t size, void **vv));
 
 /*
  * Internal forwarders.
@@ -194,6 +241,8 @@ extern void (*raid_gen3_ptr)(int nd, size_t size, void **vv);
 extern void (*raid_genz_ptr)(int nd, size_t size, void **vv);
 extern void (*raid_gen_ptr[RAID_PARITY_MAX])(
 	int nd, size_t size, void **vv);
+extern void (*raid_genc_ptr[RAID_CACHED_MAX])(
+	int nd, size_t size, void **vv);
 extern void (*raid_rec_ptr[RAID_PARITY_MAX])(
 	int nr, int *id, int *ip, int nd, size_t size, void **vv);
 
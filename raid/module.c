@@ -36,6 +36,10 @@ void raid_init(void)
 		raid_genz_ptr = raid_genz_int64;
 	}
 
+	/* the integer functions already use regular stores */
+	raid_genc_ptr[0] = raid_gen_ptr[0];
+	raid_genc_ptr[1] = raid_gen_ptr[1];
+
 	raid_rec_ptr[0] = raid_rec1_int8;
 	raid_rec_ptr[1] = raid_rec2_int8;
 	raid_rec_ptr[2] = raid_recX_int8;
@@ -47,6 +51,8 @@ void raid_init(void)
 #ifdef CONFIG_SSE2
 	if (raid_cpu_has_sse2()) {
 		raid_gen_ptr[0] = raid_gen1_sse2;
+		raid_genc_ptr[0] = raid_gen1_sse2c;
+		raid_genc_ptr[1] = raid_gen2_sse2c;
 #ifdef CONFIG_X86_64
 		if (raid_cpu_has_slowextendedreg()) {
 			raid_gen_ptr[1] = raid_gen2_sse2;
@@ -95,6 +101,8 @@ void raid_init(void)
 	if (raid_cpu_has_avx2()) {
 		raid_gen_ptr[0] = raid_gen1_avx2;
 		raid_gen_ptr[1] = raid_gen2_avx2;
+		raid_genc_ptr[0] = raid_gen1_avx2c;
+		raid_genc_ptr[1] = raid_gen2_avx2c;
 #ifdef CONFIG_X86_64
 		raid_gen3_ptr = raid_gen3_avx2ext;
 		raid_genz_ptr = raid_genz_avx2ext;
@@ -116,6 +124,199 @@ void raid_init(void)
 	raid_mode(RAID_MODE_CAUCHY);
 }
 
+/*
+ * Lists all the parity generation functions usable in the current CPU.
+ *
+ * The functions are returned from the most generic to the one using
+ * the most recent instruction set.
+ * The list depends on the current mode for the third parity level.
+ */
+int raid_gen_list(int np, void (**f)(int nd, size_t size, void **vv))
+{
+	int nf = 0;
+
+	BUG_ON(np < 1);
+	BUG_ON(np > RAID_PARITY_MAX);
+
+	if (np == 1) {
+		f[nf++] = raid_gen1_int32;
+		f[nf++] = raid_gen1_int64;
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSE2
+		if (raid_cpu_has_sse2())
+			f[nf++] = raid_gen1_sse2;
+#endif
+#ifdef CONFIG_AVX2
+		if (raid_cpu_has_avx2())
+			f[nf++] = raid_gen1_avx2;
+#endif
+#endif
+	} else if (np == 2) {
+		f[nf++] = raid_gen2_int32;
+		f[nf++] = raid_gen2_int64;
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSE2
+		if (raid_cpu_has_sse2()) {
+			f[nf++] = raid_gen2_sse2;
+#ifdef CONFIG_X86_64
+			f[nf++] = raid_gen2_sse2ext;
+#endif
+		}
+#endif
+#ifdef CONFIG_AVX2
+		if (raid_cpu_has_avx2())
+			f[nf++] = raid_gen2_avx2;
+#endif
+#endif
+	} else if (np == 3 && raid_gfgen == gfvandermonde) {
+		f[nf++] = raid_genz_int32;
+		f[nf++] = raid_genz_int64;
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSE2
+		if (raid_cpu_has_sse2()) {
+			f[nf++] = raid_genz_sse2;
+#ifdef CONFIG_X86_64
+			f[nf++] = raid_genz_sse2ext;
+#endif
+		}
+#endif
+#ifdef CONFIG_AVX2
+#ifdef CONFIG_X86_64
+		if (raid_cpu_has_avx2())
+			f[nf++] = raid_genz_avx2ext;
+#endif
+#endif
+#endif
+	} else {
+		static void (*gen_int8[RAID_PARITY_MAX])(int nd, size_t size, void **vv) = {
+			0, 0, raid_gen3_int8, raid_gen4_int8, raid_gen5_int8, raid_gen6_int8
+		};
+
+		f[nf++] = gen_int8[np - 1];
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSSE3
+		if (raid_cpu_has_ssse3()) {
+			static void (*gen_ssse3[RAID_PARITY_MAX])(int nd, size_t size, void **vv) = {
+				0, 0, raid_gen3_ssse3, raid_gen4_ssse3, raid_gen5_ssse3, raid_gen6_ssse3
+			};
+
+			f[nf++] = gen_ssse3[np - 1];
+#ifdef CONFIG_X86_64
+			{
+				static void (*gen_ssse3ext[RAID_PARITY_MAX])(int nd, size_t size, void **vv) = {
+					0, 0, raid_gen3_ssse3ext, raid_gen4_ssse3ext, raid_gen5_ssse3ext, raid_gen6_ssse3ext
+				};
+
+				f[nf++] = gen_ssse3ext[np - 1];
+			}
+#endif
+		}
+#endif
+#ifdef CONFIG_AVX2
+#ifdef CONFIG_X86_64
+		if (raid_cpu_has_avx2()) {
+			static void (*gen_avx2ext[RAID_PARITY_MAX])(int nd, size_t size, void **vv) = {
+				0, 0, raid_gen3_avx2ext, raid_gen4_avx2ext, raid_gen5_avx2ext, raid_gen6_avx2ext
+			};
+
+			f[nf++] = gen_avx2ext[np - 1];
+		}
+#endif
+#endif
+#endif
+	}
+
+	BUG_ON(nf > RAID_FUNC_MAX);
+
+	return nf;
+}
+
+/*
+ * Installs the parity generation function for the specified level.
+ */
+void raid_gen_set(int np, void (*f)(int nd, size_t size, void **vv))
+{
+	BUG_ON(np < 1);
+	BUG_ON(np > RAID_PARITY_MAX);
+
+	if (np == 3) {
+		/* keep the selection of the current mode */
+		if (raid_gfgen == gfvandermonde)
+			raid_genz_ptr = f;
+		else
+			raid_gen3_ptr = f;
+	}
+
+	raid_gen_ptr[np - 1] = f;
+}
+
+/*
+ * Lists all the recovering functions usable in the current CPU.
+ *
+ * The functions are returned from the most generic to the one using
+ * the most recent instruction set.
+ */
+int raid_rec_list(int nr, void (**f)(int nr, int *id, int *ip, int nd, size_t size, void **vv))
+{
+	int nf = 0;
+
+	BUG_ON(nr < 1);
+	BUG_ON(nr > RAID_PARITY_MAX);
+
+	if (nr == 1) {
+		f[nf++] = raid_rec1_int8;
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSSE3
+		if (raid_cpu_has_ssse3())
+			f[nf++] = raid_rec1_ssse3;
+#endif
+#ifdef CONFIG_AVX2
+		if (raid_cpu_has_avx2())
+			f[nf++] = raid_rec1_avx2;
+#endif
+#endif
+	} else if (nr == 2) {
+		f[nf++] = raid_rec2_int8;
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSSE3
+		if (raid_cpu_has_ssse3())
+			f[nf++] = raid_rec2_ssse3;
+#endif
+#ifdef CONFIG_AVX2
+		if (raid_cpu_has_avx2())
+			f[nf++] = raid_rec2_avx2;
+#endif
+#endif
+	} else {
+		f[nf++] = raid_recX_int8;
+#ifdef CONFIG_X86
+#ifdef CONFIG_SSSE3
+		if (raid_cpu_has_ssse3())
+			f[nf++] = raid_recX_ssse3;
+#endif
+#ifdef CONFIG_AVX2
+		if (raid_cpu_has_avx2())
+			f[nf++] = raid_recX_avx2;
+#endif
+#endif
+	}
+
+	BUG_ON(nf > RAID_FUNC_MAX);
+
+	return nf;
+}
+
+/*
+ * Installs the recovering function for the specified number of failures.
+ */
+void raid_rec_set(int nr, void (*f)(int nr, int *id, int *ip, int nd, size_t size, void **vv))
+{
+	BUG_ON(nr < 1);
+	BUG_ON(nr > RAID_PARITY_MAX);
+
+	raid_rec_ptr[nr - 1] = f;
+}
+
 /*
  * Reference parity computation.
  */
@@ -220,8 +220,86 @@ void (*raid_gen_ptr[RAID_PARITY_MAX])(int nd, size_t size, void **vv);
 void (*raid_gen3_ptr)(int nd, size_t size, void **vv);
 void (*raid_genz_ptr)(int nd, size_t size, void **vv);
 
+/*
+ * Forwarders for parity computation with cached stores.
+ *
+ * Like raid_gen_ptr[], but the parity is written with regular stores
+ * instead of the non-temporal ones, keeping it in the cache.
+ */
+void (*raid_genc_ptr[RAID_CACHED_MAX])(int nd, size_t size, void **vv);
+
+/**
+ * Computes the parity in tiles of the specified size.
+ *
+ * Instead of streaming all the data blocks from the start to the end,
+ * the blocks are processed in tiles, computing the parity of the same
+ * tile for all the disks before moving to the next one.
+ *
+ * With a lot of data disks and big blocks, this keeps the working set
+ * in the L2 cache, and limits the distance between the streams followed
+ * by the prefetcher.
+ *
+ * The guarantee to write the parities in order is kept for each tile.
+ *
+ * @tile Size of the tile. It must be a multiplier of 64.
+ */
+void raid_gen_tiled(int nd, int np, size_t size, size_t tile, void **vv)
+{
+	uint8_t **v = (uint8_t **)vv;
+	void *t[RAID_DATA_MAX + RAID_PARITY_MAX];
+	size_t i;
+	int j;
+
+	/* enforce limit on tile */
+	BUG_ON(tile == 0);
+	BUG_ON(tile % 64 != 0);
+
+	for (i = 0; i < size; i += tile) {
+		size_t run = size - i;
+
+		if (run > tile)
+			run = tile;
+
+		/* setup the vector of the tile */
+		for (j = 0; j < nd + np; ++j)
+			t[j] = v[j] + i;
+
+		raid_gen_ptr[np - 1](nd, run, t);
+	}
+}
+
+/**
+ * Selects the tile size to use for the specified parity computation.
+ *
+ * Returns 0 if the tiled computation is not convenient.
+ */
+size_t raid_gen_tile(int nd, int np, size_t size)
+{
+	size_t tile;
+
+	/* if all the data fits in the cache hierarchy, don't tile */
+	if (nd * size <= RAID_TILE_THRESHOLD)
+		return 0;
+
+	/* fit a tile of all the data and parity blocks in the cache */
+	tile = RAID_TILE_CACHE / (nd + np);
+
+	/* round down to the alignment required by the raid functions */
+	tile &= ~(size_t)63;
+	if (tile < 64)
+		tile = 64;
+
+	/* if a single tile covers the whole block, don't tile */
+	if (tile >= size)
+		return 0;
+
+	return tile;
+}
+
 void raid_gen(int nd, int np, size_t size, void **v)
 {
+	size_t tile;
+
 	/* enforce limit on size */
 	BUG_ON(size % 64 != 0);
 
@@ -229,9 +307,34 @@ void raid_gen(int nd, int np, size_t size, void **v)
 	BUG_ON(np < 1);
 	BUG_ON(np > RAID_PARITY_MAX);
 
+	tile = raid_gen_tile(nd, np, size);
+	if (tile != 0) {
+		raid_gen_tiled(nd, np, size, tile, v);
+		return;
+	}
+
 	raid_gen_ptr[np - 1](nd, size, v);
 }
 
+void raid_gen_cached(int nd, int np, size_t size, void **v)
+{
+	/* enforce limit on size */
+	BUG_ON(size % 64 != 0);
+
+	/* enforce limit on number of failures */
+	BUG_ON(np < 1);
+	BUG_ON(np > RAID_PARITY_MAX);
+
+	/* if there is no cached variant, or if the parity */
+	/* doesn't fit in the cache anyway, use the default one */
+	if (np > RAID_CACHED_MAX || raid_gen_tile(nd, np, size) != 0) {
+		raid_gen(nd, np, size, v);
+		return;
+	}
+
+	raid_genc_ptr[np - 1](nd, size, v);
+}
+
 /**
  * Inverts the square matrix M of size nxn into V.
  *
@@ -360,7 +463,8 @@ void raid_delta_gen(int nr, int *id, int *ip, int nd, size_t size, void **v)
 
 	/* recompute the parity, note that np may be smaller than the */
 	/* total number of parities available */
-	raid_gen(nd, np, size, v);
+	/* the delta parity is read back by the caller, so keep it in the cache */
+	raid_gen_cached(nd, np, size, v);
 
 	/* restore data buffers as before */
 	for (j = 0; j < nr; ++j)
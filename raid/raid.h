@@ -103,6 +103,21 @@ void raid_zero(void *zero);
  */
 void raid_gen(int nd, int np, size_t size, void **v);
 
+/**
+ * Computes parity blocks that are going to be read back.
+ *
+ * Like raid_gen(), but it keeps the parity blocks in the cache.
+ *
+ * raid_gen() writes the parity with non-temporal stores, as it's
+ * expected to be only written to disk. If you are going to
+ * read the parity just after computing it, like to compare it
+ * with the one read from disk, this function is faster.
+ *
+ * Only the first two levels of parity have a dedicated implementation.
+ * For more parities it's the same as raid_gen().
+ */
+void raid_gen_cached(int nd, int np, size_t size, void **v);
+
 /**
  * Recovers failures in data and parity blocks.
  *
@@ -39,6 +39,8 @@ static struct raid_func {
 	{ "sse2", (void_f*)raid_gen1_sse2 },
 	{ "sse2", (void_f*)raid_gen2_sse2 },
 	{ "sse2", (void_f*)raid_genz_sse2 },
+	{ "sse2c", (void_f*)raid_gen1_sse2c },
+	{ "sse2c", (void_f*)raid_gen2_sse2c },
 #endif
 #ifdef CONFIG_SSSE3
 	{ "ssse3", (void_f*)raid_gen3_ssse3 },
@@ -52,6 +54,8 @@ static struct raid_func {
 #ifdef CONFIG_AVX2
 	{ "avx2", (void_f*)raid_gen1_avx2 },
 	{ "avx2", (void_f*)raid_gen2_avx2 },
+	{ "avx2c", (void_f*)raid_gen1_avx2c },
+	{ "avx2c", (void_f*)raid_gen2_avx2c },
 	{ "avx2", (void_f*)raid_rec1_avx2 },
 	{ "avx2", (void_f*)raid_rec2_avx2 },
 	{ "avx2", (void_f*)raid_recX_avx2 },
@@ -145,3 +149,12 @@ const char *raid_recX_tag(void)
 	return raid_tag((void_f*)raid_rec_ptr[2]);
 }
 
+const char *raid_gen_name(void (*f)(int nd, size_t size, void **vv))
+{
+	return raid_tag((void_f*)f);
+}
+
+const char *raid_rec_name(void (*f)(int nr, int *id, int *ip, int nd, size_t size, void **vv))
+{
+	return raid_tag((void_f*)f);
+}
@@ -353,6 +353,8 @@ int raid_test_par(int mode, int nd, size_t size)
 	if (raid_cpu_has_sse2()) {
 		f[nf++] = raid_gen1_sse2;
 		f[nf++] = raid_gen2_sse2;
+		f[nf++] = raid_gen1_sse2c;
+		f[nf++] = raid_gen2_sse2c;
 #ifdef CONFIG_X86_64
 		f[nf++] = raid_gen2_sse2ext;
 #endif
@@ -363,6 +365,8 @@ int raid_test_par(int mode, int nd, size_t size)
 	if (raid_cpu_has_avx2()) {
 		f[nf++] = raid_gen1_avx2;
 		f[nf++] = raid_gen2_avx2;
+		f[nf++] = raid_gen1_avx2c;
+		f[nf++] = raid_gen2_avx2c;
 	}
 #endif
 #endif /* CONFIG_X86 */
@@ -438,6 +442,34 @@ int raid_test_par(int mode, int nd, size_t size)
 		}
 	}
 
+	/* check the tiled computation with the smallest tile */
+	for (i = 0; i < np; ++i)
+		memset(v[nd + i], 0, size);
+
+	raid_gen_tiled(nd, np, size, 64, v);
+
+	for (i = 0; i < np; ++i) {
+		if (memcmp(v[nd + np + i], v[nd + i], size) != 0) {
+			/* LCOV_EXCL_START */
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
+	/* check the computation with cached stores */
+	for (i = 0; i < np; ++i)
+		memset(v[nd + i], 0, size);
+
+	raid_gen_cached(nd, np, size, v);
+
+	for (i = 0; i < np; ++i) {
+		if (memcmp(v[nd + np + i], v[nd + i], size) != 0) {
+			/* LCOV_EXCL_START */
+			goto bail;
+			/* LCOV_EXCL_STOP */
+		}
+	}
+
 	free(v_alloc);
 	free(v);
 	return 0;
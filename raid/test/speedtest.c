@@ -824,6 +824,92 @@ void speed(void)
 	free(v);
 }
 
+/*
+ * Size of the blocks to test in the tiled computation.
+ */
+#define TILE_SIZE (1024 * 1024)
+
+/*
+ * Maximum number of data blocks to test in the tiled computation.
+ */
+#define TILE_COUNT (128)
+
+void speed_tile(void)
+{
+	struct timeval start;
+	struct timeval stop;
+	int64_t ds;
+	int64_t dt;
+	int i;
+	int count;
+	int delta = 1;
+	int size = TILE_SIZE;
+	int nd;
+	int np;
+	int nv;
+	void *v_alloc;
+	void **v;
+
+	nv = TILE_COUNT + RAID_PARITY_MAX;
+
+	v = raid_malloc_vector(TILE_COUNT, nv, size, &v_alloc);
+
+	/* initialize disks with fixed data */
+	for (i = 0; i < TILE_COUNT; ++i)
+		memset(v[i], i, size);
+
+	printf("Tiled parity computation using data buffers of %u bytes.\n", size);
+	printf("The tiled computation is automatically used over %u MiB of data.\n", RAID_TILE_THRESHOLD / (1024 * 1024));
+	printf("\n");
+
+	printf("%8s", "");
+	printf("%8s", "disks");
+	printf("%8s", "tile");
+	printf("%8s", "plain");
+	printf("%8s", "tiled");
+	printf("\n");
+
+	for (np = 2; np <= RAID_PARITY_MAX; np += 4) {
+		for (nd = 16; nd <= TILE_COUNT; nd *= 2) {
+			size_t tile;
+			void *t[TILE_COUNT + RAID_PARITY_MAX];
+
+			/* setup the vector with the parity just after the data */
+			for (i = 0; i < nd; ++i)
+				t[i] = v[i];
+			for (i = 0; i < np; ++i)
+				t[nd + i] = v[TILE_COUNT + i];
+
+			/* compute the tile as if the threshold was always reached */
+			tile = RAID_TILE_CACHE / (nd + np);
+			tile &= ~(size_t)63;
+
+			printf("%7s%u", "gen", np);
+			printf("%8u", nd);
+			printf("%8u", (unsigned)tile);
+			fflush(stdout);
+
+			SPEED_START {
+				raid_gen_ptr[np - 1](nd, size, t);
+			} SPEED_STOP
+
+			printf("%8" PRIu64, ds / dt);
+			fflush(stdout);
+
+			SPEED_START {
+				raid_gen_tiled(nd, np, size, tile, t);
+			} SPEED_STOP
+
+			printf("%8" PRIu64, ds / dt);
+			printf("\n");
+		}
+	}
+	printf("\n");
+
+	free(v_alloc);
+	free(v);
+}
+
 int main(void)
 {
 	printf("Speed test for the RAID Cauchy library\n\n");
@@ -846,6 +932,8 @@ int main(void)
 
 	speed();
 
+	speed_tile();
+
 	return 0;
 }
 
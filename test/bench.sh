@@ -0,0 +1,229 @@
+#!/bin/sh
+#
+# Benchmark of the SnapRAID commands on a synthetic array
+#
+# Usage: bench.sh SNAPRAID MKTEST
+#
+# The array is configured with the environment variables:
+#
+# BENCH_DISKS
+#   Number of data disks. Default 4.
+# BENCH_PARITY
+#   Number of parity levels, from 1 to 6. Default 2.
+# BENCH_FILES
+#   Files to create in each disk, as a comma separated list of COUNT:SIZE.
+#   For each entry, COUNT files with a random size up to SIZE bytes are
+#   created. Default "1000:65536,20:8388608", many small files and some
+#   big ones.
+# BENCH_BLOCKSIZE
+#   Block size in KiB. Default 256.
+# BENCH_SEED
+#   Seed of the random data. Default 1.
+# BENCH_DIR
+#   Directory where to create the array. Default a new temporary one,
+#   removed at the end.
+# BENCH_OUT
+#   File where to save the results in JSON. Default "bench.json".
+# BENCH_BASE
+#   Results of a previous run to compare with. Default none.
+# BENCH_MODEL
+#   Model of the disks to simulate, passed to the --test-io-model option.
+#   Default none.
+#
+# Note that the array is likely in the page cache, so the results measure
+# the CPU and the IO path more than the disks. Use a BENCH_FILES bigger
+# than the memory to measure the disks, or a BENCH_MODEL to simulate them.
+#
+
+SNAPRAID=$1
+MKTEST=$2
+
+if [ -z "$SNAPRAID" ] || [ -z "$MKTEST" ]; then
+	echo "Usage: bench.sh SNAPRAID MKTEST"
+	exit 1
+fi
+
+# The array is created in another directory
+SNAPRAID=`cd \`dirname $SNAPRAID\` && pwd`/`basename $SNAPRAID`
+MKTEST=`cd \`dirname $MKTEST\` && pwd`/`basename $MKTEST`
+
+DISKS=${BENCH_DISKS:-4}
+PARITY=${BENCH_PARITY:-2}
+FILES=${BENCH_FILES:-1000:65536,20:8388608}
+BLOCKSIZE=${BENCH_BLOCKSIZE:-256}
+SEED=${BENCH_SEED:-1}
+OUT=${BENCH_OUT:-bench.json}
+BASE=${BENCH_BASE:-}
+MODEL=${BENCH_MODEL:-}
+
+# The results are saved in the current directory
+case $OUT in
+/*) ;;
+*) OUT=`pwd`/$OUT ;;
+esac
+if [ -n "$BASE" ]; then
+	case $BASE in
+	/*) ;;
+	*) BASE=`pwd`/$BASE ;;
+	esac
+fi
+MODEL_NAME=
+if [ -n "$MODEL" ]; then
+	case $MODEL in
+	/*) ;;
+	*) MODEL=`pwd`/$MODEL ;;
+	esac
+	MODEL_NAME=`basename $MODEL`
+fi
+
+if [ -n "$BENCH_DIR" ]; then
+	DIR=$BENCH_DIR
+	mkdir -p $DIR || exit 1
+	CLEAN=
+else
+	DIR=`mktemp -d` || exit 1
+	CLEAN=$DIR
+fi
+
+cd $DIR || exit 1
+rm -rf bench bench.conf bench-*.log
+
+# Same options of the regression test, to run in a single disk
+FLAGS="--test-skip-device --no-warnings -c bench.conf"
+if [ -n "$MODEL" ]; then
+	FLAGS="$FLAGS --test-io-model $MODEL"
+fi
+
+fail()
+{
+	echo "Benchmark failed in '$1', see $DIR/bench-$1.log"
+	exit 1
+}
+
+# Current time in milliseconds
+now()
+{
+	T=`date +%s%N`
+	case $T in
+	*N) echo `date +%s`000 ;;
+	*) echo `expr $T / 1000000` ;;
+	esac
+}
+
+# Run and time a command, saving the time in seconds in the variable $1
+run()
+{
+	NAME=$1
+	shift
+	echo "===== $NAME"
+	START=`now`
+	if ! "$@" > bench-$NAME.log 2>&1; then
+		fail $NAME
+	fi
+	STOP=`now`
+	MS=`expr $STOP - $START`
+	eval "TIME_$NAME=`expr $MS / 1000`.`expr $MS % 1000 + 1000 | cut -c2-`"
+}
+
+# Configuration
+echo "blocksize $BLOCKSIZE" > bench.conf
+LEVEL=1
+while [ $LEVEL -le $PARITY ]; do
+	if [ $LEVEL -eq 1 ]; then
+		echo "parity bench/parity" >> bench.conf
+	else
+		echo "$LEVEL-parity bench/$LEVEL-parity" >> bench.conf
+	fi
+	LEVEL=`expr $LEVEL + 1`
+done
+echo "content bench/content" >> bench.conf
+mkdir bench
+DISK=1
+while [ $DISK -le $DISKS ]; do
+	echo "disk disk$DISK bench/disk$DISK/" >> bench.conf
+	mkdir bench/disk$DISK
+	DISK=`expr $DISK + 1`
+done
+
+# Data
+echo "===== generate"
+ENTRY_SEED=$SEED
+for ENTRY in `echo $FILES | tr ',' ' '`; do
+	COUNT=`echo $ENTRY | cut -d: -f1`
+	SIZE=`echo $ENTRY | cut -d: -f2`
+	if ! $MKTEST generate $ENTRY_SEED $DISKS $COUNT $SIZE; then
+		echo "Benchmark failed generating the files"
+		exit 1
+	fi
+	ENTRY_SEED=`expr $ENTRY_SEED + 1`
+done
+DATA_KB=`du -sk bench | cut -f1`
+
+run sync $SNAPRAID $FLAGS sync
+run diff $SNAPRAID $FLAGS diff
+run status $SNAPRAID $FLAGS status
+run scrub $SNAPRAID $FLAGS -p full scrub
+run check $SNAPRAID $FLAGS check
+
+# Simulate the loss of the first disk
+rm -rf bench/disk1
+mkdir bench/disk1
+run fix $SNAPRAID $FLAGS -d disk1 fix
+
+# Ensure that the fix was complete, not timed
+if ! $SNAPRAID $FLAGS -a check > bench-verify.log 2>&1; then
+	fail verify
+fi
+
+# Results
+VERSION=`$SNAPRAID -V | head -1`
+STEPS="sync diff status scrub check fix"
+
+{
+	echo "{"
+	echo "  \"version\": \"$VERSION\","
+	echo "  \"disks\": $DISKS,"
+	echo "  \"parity\": $PARITY,"
+	echo "  \"files\": \"$FILES\","
+	echo "  \"blocksize\": $BLOCKSIZE,"
+	echo "  \"seed\": $SEED,"
+	echo "  \"model\": \"$MODEL_NAME\","
+	echo "  \"data_kb\": $DATA_KB,"
+	echo "  \"seconds\": {"
+	SEP=","
+	for STEP in $STEPS; do
+		[ $STEP = fix ] && SEP=
+		eval "echo \"    \\\"$STEP\\\": \$TIME_$STEP$SEP\""
+	done
+	echo "  }"
+	echo "}"
+} > $OUT
+
+echo
+echo "$VERSION, $DISKS disks, $PARITY parity, $FILES files, $BLOCKSIZE KiB blocks, $DATA_KB KiB of data"
+echo
+if [ -n "$BASE" ]; then
+	printf "%-8s %10s %10s %8s\n" "command" "seconds" "base" "ratio"
+else
+	printf "%-8s %10s\n" "command" "seconds"
+fi
+for STEP in $STEPS; do
+	eval "T=\$TIME_$STEP"
+	if [ -n "$BASE" ]; then
+		# one value for line in the JSON file
+		B=`grep "\"$STEP\":" $BASE | sed -e 's/.*: *//' -e 's/,//'`
+		R=`awk "BEGIN { if ($B > 0) printf \"%.2f\", $T / $B; else print \"-\" }"`
+		printf "%-8s %10s %10s %8s\n" $STEP $T $B $R
+	else
+		printf "%-8s %10s\n" $STEP $T
+	fi
+done
+echo
+echo "Results saved in $OUT"
+
+cd /
+if [ -n "$CLEAN" ]; then
+	rm -rf $CLEAN
+fi
+
+exit 0
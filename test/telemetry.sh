@@ -0,0 +1,142 @@
+#!/bin/sh
+#
+# Check the telemetry file written by the 'telemetry' option
+#
+# Usage: telemetry.sh FILE
+#
+# The file is in the Prometheus text format if it ends with .prom,
+# otherwise it's in JSON, with one object for each line.
+#
+# The times are checked to be not negative, and not bigger than the
+# elapsed time of the command. Times computed with a wrong frequency
+# of the tick counter are likely to fail this check.
+#
+
+FILE=$1
+
+if [ -z "$FILE" ]; then
+	echo "Usage: telemetry.sh FILE"
+	exit 1
+fi
+
+if [ ! -s "$FILE" ]; then
+	echo "Missing telemetry file '$FILE'"
+	exit 1
+fi
+
+# Tolerance in seconds, as the elapsed time is truncated
+SLACK=2
+
+case $FILE in
+*.prom)
+	awk -v slack=$SLACK '
+	function fail(msg) {
+		print "Invalid telemetry in line " NR ": " msg
+		bad = 1
+		exit 1
+	}
+	/^#/ { next }
+	/^$/ { next }
+	{
+		if (NF != 2 || $2 !~ /^[0-9.e+-]+$/ || $2 + 0 < 0)
+			fail($0)
+
+		name = $1
+		labels = ""
+		i = index(name, "{")
+		if (i != 0) {
+			if (substr(name, length(name), 1) != "}")
+				fail($0)
+			labels = substr(name, i + 1, length(name) - i - 1)
+			name = substr(name, 1, i - 1)
+		}
+		if (name !~ /^snapraid_[a-z_]+$/)
+			fail($0)
+
+		if (name == "snapraid_elapsed_seconds")
+			elapsed = $2 + 0
+		if (name == "snapraid_stage_seconds_total")
+			stage += $2
+		if (name == "snapraid_disk_wait_seconds_total" && $2 + 0 > wait)
+			wait = $2 + 0
+
+		# the buckets of the histogram are cumulative
+		if (name == "snapraid_disk_latency_seconds_bucket") {
+			disk = labels
+			sub(/,le=.*/, "", disk)
+			if (disk == last_disk && $2 + 0 < last_count)
+				fail("not cumulative bucket " $0)
+			last_disk = disk
+			last_count = $2 + 0
+			if (labels ~ /le="\+Inf"/)
+				inf[disk] = $2 + 0
+		}
+		if (name == "snapraid_disk_latency_seconds_count") {
+			if (!(labels in inf) || inf[labels] != $2 + 0)
+				fail("count not matching the +Inf bucket " $0)
+		}
+	}
+	END {
+		if (bad)
+			exit 1
+		if (elapsed == "") {
+			print "Missing elapsed time"
+			exit 1
+		}
+		if (stage > elapsed + slack) {
+			print "Stage time " stage " bigger than the elapsed time " elapsed
+			exit 1
+		}
+		if (wait > elapsed + slack) {
+			print "Disk wait time " wait " bigger than the elapsed time " elapsed
+			exit 1
+		}
+	}' "$FILE" || exit 1
+	;;
+*)
+	awk -v slack=$SLACK '
+	function fail(msg) {
+		print "Invalid telemetry in line " NR ": " msg
+		bad = 1
+		exit 1
+	}
+	# extract the number following the specified key
+	function value(s, key) {
+		if (!match(s, "\"" key "\":[0-9.e+-]+"))
+			fail("missing " key)
+		return substr(s, RSTART + length(key) + 3, RLENGTH - length(key) - 3) + 0
+	}
+	{
+		if ($0 !~ /^\{"time":[0-9]+,"command":".*"disk":\[.*\]\}$/)
+			fail($0)
+
+		elapsed = value($0, "elapsed")
+
+		if (!match($0, /"stage":\{[^}]*\}/))
+			fail("missing stage")
+		s = substr($0, RSTART, RLENGTH)
+		stage = value(s, "raid") + value(s, "hash") + value(s, "sched") + value(s, "misc") + value(s, "io")
+		if (stage > elapsed + slack)
+			fail("stage time " stage " bigger than the elapsed time " elapsed)
+
+		# check all the disks
+		s = $0
+		while (match(s, /"wait":[0-9.e+-]+/)) {
+			wait = substr(s, RSTART + 7, RLENGTH - 7) + 0
+			if (wait > elapsed + slack)
+				fail("disk wait time " wait " bigger than the elapsed time " elapsed)
+			s = substr(s, RSTART + RLENGTH)
+		}
+	}
+	END {
+		if (bad)
+			exit 1
+		if (NR == 0) {
+			print "Empty telemetry"
+			exit 1
+		}
+	}' "$FILE" || exit 1
+	;;
+esac
+
+exit 0